@@ -4,10 +4,13 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 #include <libinput.h>
 #include <wlr/backend/session.h>
 #include <wlr/backend/interface.h>
 #include <wlr/backend/drm.h>
+#include <wlr/backend/headless.h>
 #include <wlr/backend/libinput.h>
 #include <wlr/backend/wayland.h>
 #include <wlr/backend/x11.h>
@@ -69,8 +72,117 @@ static struct wlr_backend *attempt_wl_backend(struct wl_display *display) {
 	return backend;
 }
 
+struct headless_output_spec {
+	unsigned int width, height;
+	int32_t refresh; // mHz
+};
+
+/**
+ * Parses an output spec of the form <width>x<height>[@<refresh>], the refresh
+ * rate being in Hz. Returns a pointer past the spec, or NULL if it's invalid.
+ */
+static const char *parse_headless_output_spec(const char *str,
+		struct headless_output_spec *spec) {
+	char *end;
+	long width = strtol(str, &end, 10);
+	if (end == str || *end != 'x' || width <= 0 || width > INT16_MAX) {
+		return NULL;
+	}
+	str = end + 1;
+	long height = strtol(str, &end, 10);
+	if (end == str || height <= 0 || height > INT16_MAX) {
+		return NULL;
+	}
+	float refresh = 0;
+	if (*end == '@') {
+		str = end + 1;
+		refresh = strtof(str, &end);
+		if (end == str || !(refresh > 0 && refresh <= INT32_MAX / 1000)) {
+			return NULL;
+		}
+	}
+
+	spec->width = width;
+	spec->height = height;
+	spec->refresh = refresh * 1000;
+	return end;
+}
+
+#define HEADLESS_MAX_OUTPUT_SPECS 16
+
+/**
+ * Parses WLR_HEADLESS_OUTPUTS: either a number of outputs of the default
+ * size, or a comma-separated list of output specs. Returns false if the value
+ * is invalid.
+ */
+static bool parse_headless_outputs(const char *str, int *outputs,
+		struct headless_output_spec *specs, size_t *specs_len) {
+	char *end;
+	long count = strtol(str, &end, 10);
+	if (end != str && *end == '\0') {
+		*outputs = count;
+		*specs_len = 0;
+		return count >= 0 && count <= INT_MAX;
+	}
+
+	size_t len = 0;
+	while (len < HEADLESS_MAX_OUTPUT_SPECS) {
+		str = parse_headless_output_spec(str, &specs[len]);
+		if (str == NULL) {
+			return false;
+		}
+		++len;
+		if (*str == '\0') {
+			*outputs = len;
+			*specs_len = len;
+			return true;
+		}
+		if (*str != ',') {
+			return false;
+		}
+		++str;
+	}
+	return false;
+}
+
+static struct wlr_backend *attempt_headless_backend(
+		struct wl_display *display, const char *_outputs) {
+	struct headless_output_spec specs[HEADLESS_MAX_OUTPUT_SPECS];
+	size_t specs_len;
+	int outputs;
+	if (!parse_headless_outputs(_outputs, &outputs, specs, &specs_len)) {
+		wlr_log(L_ERROR, "WLR_HEADLESS_OUTPUTS specified with invalid value, "
+			"using 1 output");
+		outputs = 1;
+		specs_len = 0;
+	}
+
+	struct wlr_backend *backend;
+	if (getenv("WLR_HEADLESS_PIXMAN")) {
+		backend = wlr_headless_backend_create_pixman(display);
+	} else {
+		backend = wlr_headless_backend_create(display);
+	}
+	if (backend) {
+		for (int i = 0; i < outputs; ++i) {
+			if ((size_t)i < specs_len) {
+				wlr_headless_add_output(backend, specs[i].width,
+					specs[i].height, specs[i].refresh);
+			} else {
+				wlr_headless_add_output(backend, 1280, 720, 0);
+			}
+		}
+	}
+	return backend;
+}
+
 struct wlr_backend *wlr_backend_autocreate(struct wl_display *display) {
 	struct wlr_backend *backend;
+	const char *headless_outputs = getenv("WLR_HEADLESS_OUTPUTS");
+	if (headless_outputs) {
+		return attempt_headless_backend(display, headless_outputs);
+	}
+
 	if (getenv("WAYLAND_DISPLAY") || getenv("_WAYLAND_DISPLAY")) {
 		backend = attempt_wl_backend(display);
 		if (backend) {
@@ -43,6 +43,25 @@ static bool atomic_end(int drm_fd, struct atomic *atom) {
 	return true;
 }
 
+/**
+ * Like atomic_end, but doesn't log failures, for configurations which are
+ * expected to be rejected.
+ */
+static bool atomic_try(int drm_fd, struct atomic *atom) {
+	if (atom->failed) {
+		return false;
+	}
+
+	uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_NONBLOCK;
+
+	if (drmModeAtomicCommit(drm_fd, atom->req, flags, NULL)) {
+		drmModeAtomicSetCursor(atom->req, atom->cursor);
+		return false;
+	}
+
+	return true;
+}
+
 static bool atomic_commit(int drm_fd, struct atomic *atom,
 		struct wlr_drm_connector *conn, uint32_t flag, bool modeset) {
 	if (atom->failed) {
@@ -96,6 +115,89 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
 	}
 }
 
+static void atomic_commit_crtc(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_connector *conn = crtc->pending_flip;
+	crtc->pending_flip = NULL;
+
+	struct atomic atom = {
+		.req = crtc->atomic,
+		.cursor = 0,
+	};
+	if (!atomic_commit(drm->fd, &atom, conn, DRM_MODE_ATOMIC_NONBLOCK,
+			false)) {
+		conn->pageflip_pending = false;
+		wl_event_source_timer_update(conn->retry_pageflip,
+			1000.0f / conn->output.current_mode->refresh);
+	}
+}
+
+/**
+ * Commits the pageflips queued since the last flush in one atomic request.
+ * The page flip events of all CRTCs carry the connector of the first one.
+ */
+static void atomic_flush(struct wlr_drm_backend *drm) {
+	if (drm->atomic_commit_idle) {
+		wl_event_source_remove(drm->atomic_commit_idle);
+		drm->atomic_commit_idle = NULL;
+	}
+
+	size_t pending = 0;
+	struct wlr_drm_connector *user = NULL;
+	for (size_t i = 0; i < drm->num_crtcs; ++i) {
+		struct wlr_drm_crtc *crtc = &drm->crtcs[i];
+		if (crtc->pending_flip) {
+			user = user ? user : crtc->pending_flip;
+			++pending;
+		}
+	}
+	if (pending == 0) {
+		return;
+	}
+
+	drmModeAtomicReq *req = NULL;
+	if (pending > 1) {
+		req = drmModeAtomicAlloc();
+		for (size_t i = 0; req && i < drm->num_crtcs; ++i) {
+			struct wlr_drm_crtc *crtc = &drm->crtcs[i];
+			if (crtc->pending_flip && drmModeAtomicMerge(req, crtc->atomic)) {
+				drmModeAtomicFree(req);
+				req = NULL;
+			}
+		}
+	}
+
+	uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
+	if (req && drmModeAtomicCommit(drm->fd, req, flags, user) == 0) {
+		for (size_t i = 0; i < drm->num_crtcs; ++i) {
+			struct wlr_drm_crtc *crtc = &drm->crtcs[i];
+			if (crtc->pending_flip) {
+				crtc->pending_flip = NULL;
+				drmModeAtomicSetCursor(crtc->atomic, 0);
+			}
+		}
+		drmModeAtomicFree(req);
+		return;
+	}
+
+	if (req) {
+		wlr_log_errno(L_ERROR, "Atomic commit of %zu CRTCs failed, "
+			"committing them one by one", pending);
+		drmModeAtomicFree(req);
+	}
+	for (size_t i = 0; i < drm->num_crtcs; ++i) {
+		if (drm->crtcs[i].pending_flip) {
+			atomic_commit_crtc(drm, &drm->crtcs[i]);
+		}
+	}
+}
+
+static void atomic_flush_idle(void *data) {
+	struct wlr_drm_backend *drm = data;
+	drm->atomic_commit_idle = NULL;
+	atomic_flush(drm);
+}
+
 static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn,
 		struct wlr_drm_crtc *crtc,
@@ -118,9 +220,47 @@ static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 	atomic_add(&atom, crtc->id, crtc->props.mode_id, crtc->mode_id);
 	atomic_add(&atom, crtc->id, crtc->props.active, 1);
 	set_plane_props(&atom, crtc->primary, crtc->id, fb_id, true);
-	return atomic_commit(drm->fd, &atom, conn,
-		mode ? DRM_MODE_ATOMIC_ALLOW_MODESET : DRM_MODE_ATOMIC_NONBLOCK,
-		mode);
+
+	if (mode || !drm->atomic_batch) {
+		return atomic_commit(drm->fd, &atom, conn,
+			mode ? DRM_MODE_ATOMIC_ALLOW_MODESET : DRM_MODE_ATOMIC_NONBLOCK,
+			mode);
+	}
+
+	// Not tested on its own, that would cost an ioctl per CRTC. If the
+	// merged request is rejected, atomic_flush commits the CRTCs one by one.
+	if (atom.failed) {
+		drmModeAtomicSetCursor(atom.req, atom.cursor);
+		return false;
+	}
+
+	crtc->pending_flip = conn;
+	if (!drm->atomic_commit_idle) {
+		struct wl_event_loop *event_loop =
+			wl_display_get_event_loop(drm->display);
+		drm->atomic_commit_idle =
+			wl_event_loop_add_idle(event_loop, atomic_flush_idle, drm);
+		if (!drm->atomic_commit_idle) {
+			atomic_flush(drm);
+		}
+	}
+	return true;
+}
+
+static bool atomic_crtc_test_pageflip(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id) {
+	struct atomic atom;
+
+	atomic_begin(crtc, &atom);
+	set_plane_props(&atom, crtc->primary, crtc->id, fb_id, true);
+	if (!atomic_try(drm->fd, &atom)) {
+		return false;
+	}
+
+	// Don't keep the tested properties for the next commit
+	drmModeAtomicSetCursor(atom.req, atom.cursor);
+	return true;
 }
 
 static void atomic_conn_enable(struct wlr_drm_backend *drm,
@@ -133,6 +273,40 @@ static void atomic_conn_enable(struct wlr_drm_backend *drm,
 	atomic_end(drm->fd, &atom);
 }
 
+static bool atomic_crtc_set_overlay(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, struct wlr_drm_plane *plane,
+		struct gbm_bo *bo, int x, int y) {
+	uint32_t id = plane->id;
+	const union wlr_drm_plane_props *props = &plane->props;
+
+	struct atomic atom;
+
+	atomic_begin(crtc, &atom);
+
+	if (bo) {
+		uint32_t width = gbm_bo_get_width(bo);
+		uint32_t height = gbm_bo_get_height(bo);
+
+		// The src_* properties are in 16.16 fixed point
+		atomic_add(&atom, id, props->src_x, 0);
+		atomic_add(&atom, id, props->src_y, 0);
+		atomic_add(&atom, id, props->src_w, width << 16);
+		atomic_add(&atom, id, props->src_h, height << 16);
+		atomic_add(&atom, id, props->crtc_x, x);
+		atomic_add(&atom, id, props->crtc_y, y);
+		atomic_add(&atom, id, props->crtc_w, width);
+		atomic_add(&atom, id, props->crtc_h, height);
+		atomic_add(&atom, id, props->fb_id, get_fb_for_bo(bo));
+		atomic_add(&atom, id, props->crtc_id, crtc->id);
+	} else {
+		atomic_add(&atom, id, props->fb_id, 0);
+		atomic_add(&atom, id, props->crtc_id, 0);
+	}
+
+	// Planes are often rejected because of their format or size
+	return atomic_try(drm->fd, &atom);
+}
+
 bool legacy_crtc_set_cursor(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, struct gbm_bo *bo);
 
@@ -184,6 +358,9 @@ static bool atomic_crtc_move_cursor(struct wlr_drm_backend *drm,
 const struct wlr_drm_interface atomic_iface = {
 	.conn_enable = atomic_conn_enable,
 	.crtc_pageflip = atomic_crtc_pageflip,
+	.crtc_test_pageflip = atomic_crtc_test_pageflip,
+	.crtc_set_overlay = atomic_crtc_set_overlay,
 	.crtc_set_cursor = atomic_crtc_set_cursor,
 	.crtc_move_cursor = atomic_crtc_move_cursor,
+	.flush = atomic_flush,
 };
@@ -16,6 +16,8 @@
 #include <wayland-server.h>
 #include <wlr/backend/interface.h>
 #include <wlr/interfaces/wlr_output.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/render/matrix.h>
 #include <wlr/render/gles2.h>
@@ -39,7 +41,29 @@ bool wlr_drm_check_features(struct wlr_drm_backend *drm) {
 	} else {
 		wlr_log(L_DEBUG, "Using atomic DRM interface");
 		drm->iface = &atomic_iface;
+
+		uint64_t cap;
+		drm->atomic_batch = !getenv("WLR_DRM_NO_ATOMIC_BATCH") &&
+			drmGetCap(drm->fd, DRM_CAP_CRTC_IN_VBLANK_EVENT, &cap) == 0 &&
+			cap;
+		wlr_log(L_DEBUG, "Atomic pageflip batching %s",
+			drm->atomic_batch ? "enabled" : "disabled");
+	}
+
+	drm->swapchain_depth = 2;
+	const char *depth = getenv("WLR_DRM_SWAPCHAIN_DEPTH");
+	if (depth) {
+		char *end;
+		unsigned long n = strtoul(depth, &end, 10);
+		if (*depth == '\0' || *end != '\0' || n < 2 ||
+				n > WLR_DRM_SURFACE_MAX_DEPTH) {
+			wlr_log(L_ERROR, "Invalid WLR_DRM_SWAPCHAIN_DEPTH, expected a "
+				"number between 2 and %d", WLR_DRM_SURFACE_MAX_DEPTH);
+		} else {
+			drm->swapchain_depth = n;
+		}
 	}
+	wlr_log(L_DEBUG, "Using a swapchain depth of %zu", drm->swapchain_depth);
 
 	return true;
 }
@@ -183,9 +207,226 @@ void wlr_drm_resources_free(struct wlr_drm_backend *drm) {
 	free(drm->planes);
 }
 
-static void wlr_drm_connector_make_current(struct wlr_output *output) {
+static bool wlr_drm_connector_make_current(struct wlr_output *output,
+		int *buffer_age) {
 	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
-	wlr_drm_surface_make_current(&conn->crtc->primary->surf);
+	return wlr_drm_surface_make_current(&conn->crtc->primary->surf,
+		buffer_age);
+}
+
+static void scanout_finish(struct wlr_drm_scanout *scanout) {
+	if (scanout->bo) {
+		gbm_bo_destroy(scanout->bo);
+	}
+	wlr_buffer_unlock(scanout->lock);
+	scanout->bo = NULL;
+	scanout->lock = NULL;
+}
+
+/**
+ * Keeps a directly scanned out buffer alive until it is no longer displayed.
+ * Must be called each time a pageflip is committed, with an empty scanout if
+ * the frame has been rendered.
+ */
+static void plane_push_scanout(struct wlr_drm_plane *plane,
+		struct wlr_drm_scanout *scanout) {
+	// Only one pageflip can be pending, the flip handler already released it
+	scanout_finish(&plane->scanout_prev);
+	plane->scanout_prev = plane->scanout;
+	if (scanout) {
+		plane->scanout = *scanout;
+	} else {
+		plane->scanout = (struct wlr_drm_scanout){0};
+	}
+}
+
+/**
+ * Gives the buffer replaced by the last pageflip back to its client, once
+ * the pageflip has completed.
+ */
+static void plane_release_scanout_prev(struct wlr_drm_plane *plane) {
+	if (plane) {
+		scanout_finish(&plane->scanout_prev);
+	}
+}
+
+static void plane_finish_scanout(struct wlr_drm_plane *plane) {
+	scanout_finish(&plane->pending);
+	scanout_finish(&plane->scanout_prev);
+	scanout_finish(&plane->scanout);
+}
+
+/**
+ * Imports the current buffer of a surface so that it can be put on a plane.
+ * Only wl_drm buffers can be imported, shm buffers need to be composited.
+ */
+static bool import_surface_buffer(struct wlr_drm_backend *drm,
+		struct wlr_surface *surface, struct wlr_drm_scanout *scanout) {
+	// The buffer would have to be copied to the other GPU anyway
+	if (drm->parent) {
+		return false;
+	}
+
+	struct wl_resource *buffer = surface->current->buffer;
+	struct gbm_bo *bo;
+	if (wlr_dmabuf_resource_is_buffer(buffer)) {
+		struct wlr_dmabuf_buffer_attribs *attribs =
+			&wlr_dmabuf_buffer_from_buffer_resource(buffer)->attributes;
+		// Explicit modifiers and multi-planar formats need
+		// GBM_BO_IMPORT_FD_MODIFIER, which isn't widely available yet
+		if (attribs->n_planes != 1 || attribs->offset[0] != 0 ||
+				attribs->modifier[0] != DRM_FORMAT_MOD_INVALID ||
+				attribs->flags != 0) {
+			return false;
+		}
+		struct gbm_import_fd_data data = {
+			.fd = attribs->fd[0],
+			.width = attribs->width,
+			.height = attribs->height,
+			.stride = attribs->stride[0],
+			.format = attribs->format,
+		};
+		bo = gbm_bo_import(drm->renderer.gbm, GBM_BO_IMPORT_FD, &data,
+			GBM_BO_USE_SCANOUT);
+	} else {
+		bo = gbm_bo_import(drm->renderer.gbm, GBM_BO_IMPORT_WL_BUFFER,
+			buffer, GBM_BO_USE_SCANOUT);
+	}
+	if (!bo) {
+		return false;
+	}
+
+	// Buffers with an alpha channel would not be blended with what is below
+	if (gbm_bo_get_format(bo) != GBM_FORMAT_XRGB8888 || !get_fb_for_bo(bo)) {
+		gbm_bo_destroy(bo);
+		return false;
+	}
+
+	struct wlr_buffer_lock *lock = wlr_buffer_lock(buffer);
+	if (!lock) {
+		gbm_bo_destroy(bo);
+		return false;
+	}
+
+	scanout->bo = bo;
+	scanout->lock = lock;
+	return true;
+}
+
+/**
+ * Whether the overlay plane is in use by crtc, either because realloc_planes
+ * assigned it or because it was free when a buffer was attached.
+ */
+static bool overlay_plane_is_used_by(struct wlr_drm_plane *plane,
+		struct wlr_drm_crtc *crtc) {
+	return plane == crtc->overlay || plane->overlay_crtc == crtc;
+}
+
+/**
+ * Whether the overlay plane can display a buffer on crtc. Besides the one
+ * assigned to it, a CRTC can borrow the overlay planes which aren't assigned
+ * to any CRTC and may be connected to it.
+ */
+static bool overlay_plane_is_available(struct wlr_drm_backend *drm,
+		struct wlr_drm_plane *plane, struct wlr_drm_crtc *crtc) {
+	if (overlay_plane_is_used_by(plane, crtc)) {
+		return true;
+	}
+	if (plane->overlay_crtc ||
+			!(plane->possible_crtcs & (1 << (crtc - drm->crtcs)))) {
+		return false;
+	}
+	for (size_t i = 0; i < drm->num_crtcs; ++i) {
+		if (drm->crtcs[i].overlay == plane) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Stops borrowing the overlay plane, its buffer is dropped right away.
+ */
+static void overlay_plane_give_back(struct wlr_drm_backend *drm,
+		struct wlr_drm_plane *plane) {
+	if (!plane->overlay_crtc) {
+		return;
+	}
+	if (drm->iface->crtc_set_overlay) {
+		drm->iface->crtc_set_overlay(drm, plane->overlay_crtc, plane,
+			NULL, 0, 0);
+	}
+	plane_finish_scanout(plane);
+	plane->overlay_crtc = NULL;
+}
+
+/**
+ * Queues the overlay plane assignments made since the last frame, to be
+ * committed along with the next pageflip.
+ */
+static void connector_flush_overlay(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		(struct wlr_drm_backend *)conn->output.backend;
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!drm->iface->crtc_set_overlay) {
+		return;
+	}
+
+	for (size_t i = 0; i < drm->num_overlay_planes; ++i) {
+		struct wlr_drm_plane *plane = &drm->overlay_planes[i];
+		if (!overlay_plane_is_used_by(plane, crtc)) {
+			continue;
+		}
+
+		if (!plane->pending.bo && plane->scanout.bo) {
+			drm->iface->crtc_set_overlay(drm, crtc, plane, NULL, 0, 0);
+		}
+
+		plane_push_scanout(plane, &plane->pending);
+		plane->pending = (struct wlr_drm_scanout){0};
+	}
+}
+
+/**
+ * Releases the buffers of the overlay planes of crtc which were replaced by
+ * the last pageflip. Borrowed planes which are now disabled become free.
+ */
+static void crtc_release_overlays(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc) {
+	for (size_t i = 0; i < drm->num_overlay_planes; ++i) {
+		struct wlr_drm_plane *plane = &drm->overlay_planes[i];
+		if (!overlay_plane_is_used_by(plane, crtc)) {
+			continue;
+		}
+
+		plane_release_scanout_prev(plane);
+		if (plane->overlay_crtc && !plane->scanout.bo && !plane->pending.bo) {
+			plane->overlay_crtc = NULL;
+		}
+	}
+}
+
+static void connector_pageflip(struct wlr_drm_connector *conn,
+		struct gbm_bo *bo) {
+	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)conn->output.backend;
+
+	connector_flush_overlay(conn);
+
+	uint32_t fb_id = get_fb_for_bo(bo);
+	if (drm->iface->crtc_pageflip(drm, conn, conn->crtc, fb_id, NULL)) {
+		conn->pageflip_pending = true;
+		plane_push_scanout(conn->crtc->primary, NULL);
+	} else {
+		wl_event_source_timer_update(conn->retry_pageflip,
+			1000.0f / conn->output.current_mode->refresh);
+	}
+}
+
+static void handle_early_frame(void *data) {
+	struct wlr_drm_connector *conn = data;
+	conn->early_frame = NULL;
+	conn->early_frame_sent = true;
+	wlr_output_send_frame(&conn->output);
 }
 
 static void wlr_drm_connector_swap_buffers(struct wlr_output *output) {
@@ -196,18 +437,120 @@ static void wlr_drm_connector_swap_buffers(struct wlr_output *output) {
 	struct wlr_drm_plane *plane = crtc->primary;
 
 	struct gbm_bo *bo = wlr_drm_surface_swap_buffers(&plane->surf);
+	if (!bo) {
+		return;
+	}
 	if (drm->parent) {
 		bo = wlr_drm_surface_mgpu_copy(&plane->mgpu_surf, bo);
+		connector_pageflip(conn, bo);
+		return;
 	}
 
-	uint32_t fb_id = get_fb_for_bo(bo);
-
-	if (drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
-		conn->pageflip_pending = true;
+	if (conn->pageflip_pending) {
+		// The buffer is flipped once the pending pageflip completes
+		wlr_drm_surface_queue_back(&plane->surf);
 	} else {
-		wl_event_source_timer_update(conn->retry_pageflip,
-			1000.0f / conn->output.current_mode->refresh);
+		connector_pageflip(conn, bo);
+	}
+
+	if (conn->pageflip_pending && !conn->early_frame &&
+			wlr_drm_surface_can_render(&plane->surf)) {
+		// There is room for another buffer, the next frame doesn't need to
+		// wait for the pageflip
+		struct wl_event_loop *ev = wl_display_get_event_loop(drm->display);
+		conn->early_frame = wl_event_loop_add_idle(ev, handle_early_frame,
+			conn);
+	}
+}
+
+static bool wlr_drm_connector_attach_overlay(struct wlr_output *output,
+		struct wlr_surface *surface, int x, int y) {
+	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
+	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)output->backend;
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!drm->iface->crtc_set_overlay) {
+		return false;
+	}
+
+	// Frames queued in the swapchain would be displayed after this one
+	if (conn->pageflip_pending) {
+		return false;
+	}
+
+	struct wlr_drm_scanout scanout = {0};
+	for (size_t i = 0; i < drm->num_overlay_planes; ++i) {
+		struct wlr_drm_plane *plane = &drm->overlay_planes[i];
+		if (plane->pending.bo ||
+				!overlay_plane_is_available(drm, plane, crtc)) {
+			continue;
+		}
+
+		if (!scanout.bo && !import_surface_buffer(drm, surface, &scanout)) {
+			return false;
+		}
+
+		// Planes have different capabilities, another one may accept it
+		if (!drm->iface->crtc_set_overlay(drm, crtc, plane, scanout.bo,
+				x, y)) {
+			continue;
+		}
+
+		if (plane != crtc->overlay) {
+			plane->overlay_crtc = crtc;
+		}
+		plane->pending = scanout;
+		return true;
+	}
+
+	scanout_finish(&scanout);
+	return false;
+}
+
+static bool wlr_drm_connector_scanout_surface(struct wlr_output *output,
+		struct wlr_surface *surface) {
+	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
+	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)output->backend;
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	struct wlr_drm_plane *plane = crtc->primary;
+
+	// Frames queued in the swapchain would be displayed after this one
+	if (conn->pageflip_pending) {
+		return false;
+	}
+
+	struct wlr_drm_scanout scanout;
+	if (!import_surface_buffer(drm, surface, &scanout)) {
+		return false;
+	}
+
+	if (gbm_bo_get_width(scanout.bo) != (uint32_t)output->width ||
+			gbm_bo_get_height(scanout.bo) != (uint32_t)output->height) {
+		goto error_scanout;
+	}
+
+	uint32_t fb_id = get_fb_for_bo(scanout.bo);
+	if (drm->iface->crtc_test_pageflip &&
+			!drm->iface->crtc_test_pageflip(drm, conn, crtc, fb_id)) {
+		goto error_scanout;
 	}
+
+	connector_flush_overlay(conn);
+
+	if (!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
+		goto error_scanout;
+	}
+
+	// The buffer is given back to the client once the next pageflip has
+	// completed, see page_flip_handler
+	conn->pageflip_pending = true;
+	plane_push_scanout(plane, &scanout);
+	return true;
+
+error_scanout:
+	scanout_finish(&scanout);
+	return false;
 }
 
 static void wlr_drm_connector_set_gamma(struct wlr_output *output,
@@ -236,6 +579,9 @@ void wlr_drm_connector_start_renderer(struct wlr_drm_connector *conn) {
 		drm->parent ? &plane->mgpu_surf : &plane->surf);
 	uint32_t fb_id = get_fb_for_bo(bo);
 
+	// The buffer we are about to display may not hold our last frame
+	wlr_output_damage_whole(&conn->output);
+
 	struct wlr_drm_mode *mode = (struct wlr_drm_mode *)conn->output.current_mode;
 	if (drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, &mode->drm_mode)) {
 		conn->pageflip_pending = true;
@@ -302,8 +648,11 @@ static void realloc_planes(struct wlr_drm_backend *drm, const uint32_t *crtc_in,
 				changed_outputs[crtc_res[i]] = true;
 				if (*old) {
 					wlr_drm_surface_finish(&(*old)->surf);
+					plane_finish_scanout(*old);
 				}
 				wlr_drm_surface_finish(&new->surf);
+				// The plane may have been borrowed by another CRTC
+				overlay_plane_give_back(drm, new);
 				*old = new;
 			}
 		}
@@ -493,6 +842,19 @@ static void wlr_drm_connector_transform(struct wlr_output *output,
 	output->transform = transform;
 }
 
+/**
+ * The atomic interface only applies cursor plane changes with the next
+ * pageflip, so the next frame must be swapped even if nothing was rendered.
+ * Fake cursor planes use the legacy interface, which applies them right away.
+ */
+static void cursor_needs_pageflip(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn) {
+	if (drm->iface == &atomic_iface && conn->crtc->cursor->id != 0) {
+		conn->output.needs_swap = true;
+		wlr_output_schedule_frame(&conn->output);
+	}
+}
+
 static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 		const uint8_t *buf, int32_t stride, uint32_t width, uint32_t height,
 		int32_t hotspot_x, int32_t hotspot_y, bool update_pixels) {
@@ -516,7 +878,11 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 	if (!buf && update_pixels) {
 		// Hide the cursor
 		plane->cursor_enabled = false;
-		return drm->iface->crtc_set_cursor(drm, crtc, NULL);
+		if (!drm->iface->crtc_set_cursor(drm, crtc, NULL)) {
+			return false;
+		}
+		cursor_needs_pageflip(drm, conn);
+		return true;
 	}
 	plane->cursor_enabled = true;
 
@@ -606,7 +972,7 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 		return false;
 	}
 
-	wlr_drm_surface_make_current(&plane->surf);
+	wlr_drm_surface_make_current(&plane->surf, NULL);
 
 	wlr_texture_upload_pixels(plane->wlr_tex, WL_SHM_FORMAT_ARGB8888,
 		stride, width, height, buf);
@@ -628,7 +994,11 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 
 	gbm_bo_unmap(bo, bo_data);
 
-	return drm->iface->crtc_set_cursor(drm, crtc, bo);
+	if (!drm->iface->crtc_set_cursor(drm, crtc, bo)) {
+		return false;
+	}
+	cursor_needs_pageflip(drm, conn);
+	return true;
 }
 
 static bool wlr_drm_connector_move_cursor(struct wlr_output *output,
@@ -659,7 +1029,11 @@ static bool wlr_drm_connector_move_cursor(struct wlr_output *output,
 		break;
 	}
 
-	return drm->iface->crtc_move_cursor(drm, conn->crtc, x, y);
+	if (!drm->iface->crtc_move_cursor(drm, conn->crtc, x, y)) {
+		return false;
+	}
+	cursor_needs_pageflip(drm, conn);
+	return true;
 }
 
 static void wlr_drm_connector_destroy(struct wlr_output *output) {
@@ -678,6 +1052,8 @@ static struct wlr_output_impl output_impl = {
 	.destroy = wlr_drm_connector_destroy,
 	.make_current = wlr_drm_connector_make_current,
 	.swap_buffers = wlr_drm_connector_swap_buffers,
+	.scanout_surface = wlr_drm_connector_scanout_surface,
+	.attach_overlay = wlr_drm_connector_attach_overlay,
 	.set_gamma = wlr_drm_connector_set_gamma,
 	.get_gamma_size = wlr_drm_connector_get_gamma_size,
 };
@@ -849,29 +1225,70 @@ void wlr_drm_scan_connectors(struct wlr_drm_backend *drm) {
 }
 
 static void page_flip_handler(int fd, unsigned seq,
-		unsigned tv_sec, unsigned tv_usec, void *user) {
+		unsigned tv_sec, unsigned tv_usec, unsigned crtc_id, void *user) {
 	struct wlr_drm_connector *conn = user;
 	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)conn->output.backend;
 
+	// A commit of several CRTCs carries the connector of the first one, find
+	// the one this event is for
+	if (crtc_id != 0 && (!conn->crtc || conn->crtc->id != crtc_id)) {
+		struct wlr_drm_connector *c;
+		conn = NULL;
+		wl_list_for_each(c, &drm->outputs, link) {
+			if (c->crtc && c->crtc->id == crtc_id) {
+				conn = c;
+				break;
+			}
+		}
+		if (!conn) {
+			return;
+		}
+	}
+
 	conn->pageflip_pending = false;
 	if (conn->state != WLR_DRM_CONN_CONNECTED) {
 		return;
 	}
 
-	wlr_drm_surface_post(&conn->crtc->primary->surf);
+	// The buffers displayed before this pageflip are off screen now
+	plane_release_scanout_prev(conn->crtc->primary);
+	crtc_release_overlays(drm, conn->crtc);
+
+	struct wlr_drm_surface *surf = &conn->crtc->primary->surf;
+	wlr_drm_surface_post(surf);
 	if (drm->parent) {
 		wlr_drm_surface_post(&conn->crtc->primary->mgpu_surf);
 	}
 
-	if (drm->session->active) {
-		wl_signal_emit(&conn->output.events.frame, &conn->output);
+	struct gbm_bo *bo = wlr_drm_surface_pop_queued(surf);
+	if (bo) {
+		connector_pageflip(conn, bo);
+	}
+
+	// The frame event below supersedes an early one which wasn't sent yet. If
+	// one was sent and nothing has been rendered since, the compositor has
+	// nothing to draw and schedules its next frame itself.
+	if (conn->early_frame) {
+		wl_event_source_remove(conn->early_frame);
+		conn->early_frame = NULL;
+	}
+	bool frame_sent = conn->early_frame_sent && !conn->output.frame_pending;
+	conn->early_frame_sent = false;
+
+	if (drm->session->active && !frame_sent) {
+		// The timestamp uses CLOCK_MONOTONIC, see DRM_CAP_TIMESTAMP_MONOTONIC
+		struct timespec when = {
+			.tv_sec = tv_sec,
+			.tv_nsec = tv_usec * 1000,
+		};
+		wlr_output_handle_vblank(&conn->output, &when);
 	}
 }
 
 int wlr_drm_event(int fd, uint32_t mask, void *data) {
 	drmEventContext event = {
 		.version = DRM_EVENT_CONTEXT_VERSION,
-		.page_flip_handler = page_flip_handler,
+		.page_flip_handler2 = page_flip_handler,
 	};
 
 	drmHandleEvent(fd, &event);
@@ -879,6 +1296,11 @@ int wlr_drm_event(int fd, uint32_t mask, void *data) {
 }
 
 void wlr_drm_restore_outputs(struct wlr_drm_backend *drm) {
+	// Queued pageflips must be committed to wait for them below
+	if (drm->iface->flush) {
+		drm->iface->flush(drm);
+	}
+
 	uint64_t to_close = (1 << wl_list_length(&drm->outputs)) - 1;
 
 	struct wlr_drm_connector *conn;
@@ -925,10 +1347,21 @@ void wlr_drm_connector_cleanup(struct wlr_drm_connector *conn) {
 
 	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)conn->output.backend;
 
+	if (conn->early_frame) {
+		wl_event_source_remove(conn->early_frame);
+		conn->early_frame = NULL;
+	}
+	conn->early_frame_sent = false;
+
 	switch (conn->state) {
 	case WLR_DRM_CONN_CONNECTED:
 	case WLR_DRM_CONN_CLEANUP:;
 		struct wlr_drm_crtc *crtc = conn->crtc;
+		if (crtc->pending_flip == conn) {
+			// Drop the queued pageflip, its buffers are about to go away
+			crtc->pending_flip = NULL;
+			drmModeAtomicSetCursor(crtc->atomic, 0);
+		}
 		for (int i = 0; i < 3; ++i) {
 			if (!crtc->planes[i]) {
 				continue;
@@ -936,11 +1369,19 @@ void wlr_drm_connector_cleanup(struct wlr_drm_connector *conn) {
 
 			wlr_drm_surface_finish(&crtc->planes[i]->surf);
 			wlr_drm_surface_finish(&crtc->planes[i]->mgpu_surf);
+			plane_finish_scanout(crtc->planes[i]);
 			if (crtc->planes[i]->id == 0) {
 				free(crtc->planes[i]);
 				crtc->planes[i] = NULL;
 			}
 		}
+		for (size_t i = 0; i < drm->num_overlay_planes; ++i) {
+			struct wlr_drm_plane *plane = &drm->overlay_planes[i];
+			if (plane->overlay_crtc == crtc) {
+				plane_finish_scanout(plane);
+				plane->overlay_crtc = NULL;
+			}
+		}
 
 		conn->crtc = NULL;
 		conn->possible_crtc = 0;
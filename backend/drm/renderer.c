@@ -1,5 +1,6 @@
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <gbm.h>
@@ -65,6 +66,7 @@ bool wlr_drm_surface_init(struct wlr_drm_surface *surf,
 	surf->renderer = renderer;
 	surf->width = width;
 	surf->height = height;
+	surf->depth = 2;
 
 	surf->gbm = gbm_surface_create(renderer->gbm, width, height,
 		format, GBM_BO_USE_RENDERING | flags);
@@ -96,11 +98,8 @@ void wlr_drm_surface_finish(struct wlr_drm_surface *surf) {
 	eglMakeCurrent(surf->renderer->egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
 		EGL_NO_CONTEXT);
 
-	if (surf->front) {
-		gbm_surface_release_buffer(surf->gbm, surf->front);
-	}
-	if (surf->back) {
-		gbm_surface_release_buffer(surf->gbm, surf->back);
+	for (size_t i = 0; i < surf->bufs_len; ++i) {
+		gbm_surface_release_buffer(surf->gbm, surf->bufs[i]);
 	}
 
 	if (surf->egl) {
@@ -113,29 +112,81 @@ void wlr_drm_surface_finish(struct wlr_drm_surface *surf) {
 	memset(surf, 0, sizeof(*surf));
 }
 
-void wlr_drm_surface_make_current(struct wlr_drm_surface *surf) {
-	eglMakeCurrent(surf->renderer->egl.display, surf->egl, surf->egl,
-		surf->renderer->egl.context);
+bool wlr_drm_surface_make_current(struct wlr_drm_surface *surf,
+		int *buffer_age) {
+	return wlr_egl_make_current(&surf->renderer->egl, surf->egl, buffer_age);
+}
+
+static void surface_release_buffer(struct wlr_drm_surface *surf, size_t i) {
+	gbm_surface_release_buffer(surf->gbm, surf->bufs[i]);
+	memmove(&surf->bufs[i], &surf->bufs[i + 1],
+		(surf->bufs_len - i - 1) * sizeof(surf->bufs[0]));
+	--surf->bufs_len;
 }
 
 struct gbm_bo *wlr_drm_surface_swap_buffers(struct wlr_drm_surface *surf) {
-	if (surf->front) {
-		gbm_surface_release_buffer(surf->gbm, surf->front);
+	if (surf->bufs_len == surf->depth) {
+		if (surf->queued > 0) {
+			// The new frame replaces the oldest one still in the queue
+			surface_release_buffer(surf, surf->bufs_len - surf->queued);
+			--surf->queued;
+		} else {
+			surface_release_buffer(surf, 0);
+		}
 	}
 
 	eglSwapBuffers(surf->renderer->egl.display, surf->egl);
 
-	surf->front = surf->back;
-	surf->back = gbm_surface_lock_front_buffer(surf->gbm);
-	return surf->back;
+	struct gbm_bo *bo = gbm_surface_lock_front_buffer(surf->gbm);
+	if (!bo) {
+		wlr_log(L_ERROR, "Failed to lock GBM front buffer");
+		return NULL;
+	}
+	surf->bufs[surf->bufs_len++] = bo;
+	return bo;
+}
+
+/**
+ * Returns true if a frame can be rendered without replacing one which hasn't
+ * been displayed yet.
+ */
+bool wlr_drm_surface_can_render(struct wlr_drm_surface *surf) {
+	return surf->bufs_len < surf->depth;
+}
+
+/**
+ * Keeps the last swapped buffer in the queue, until a pageflip can be
+ * submitted for it.
+ */
+void wlr_drm_surface_queue_back(struct wlr_drm_surface *surf) {
+	if (surf->queued < surf->bufs_len) {
+		++surf->queued;
+	}
+}
+
+/**
+ * Takes the oldest buffer out of the queue, the caller submits a pageflip for
+ * it.
+ */
+struct gbm_bo *wlr_drm_surface_pop_queued(struct wlr_drm_surface *surf) {
+	if (surf->queued == 0) {
+		return NULL;
+	}
+	return surf->bufs[surf->bufs_len - surf->queued--];
 }
 
 struct gbm_bo *wlr_drm_surface_get_front(struct wlr_drm_surface *surf) {
-	if (surf->front) {
-		return surf->front;
+	if (surf->bufs_len > 0) {
+		// Queued frames are skipped, the newest one is displayed right away
+		while (surf->queued > 1) {
+			surface_release_buffer(surf, surf->bufs_len - surf->queued);
+			--surf->queued;
+		}
+		surf->queued = 0;
+		return surf->bufs[surf->bufs_len - 1];
 	}
 
-	wlr_drm_surface_make_current(surf);
+	wlr_drm_surface_make_current(surf, NULL);
 	glViewport(0, 0, surf->width, surf->height);
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -143,9 +194,10 @@ struct gbm_bo *wlr_drm_surface_get_front(struct wlr_drm_surface *surf) {
 }
 
 void wlr_drm_surface_post(struct wlr_drm_surface *surf) {
-	if (surf->front) {
-		gbm_surface_release_buffer(surf->gbm, surf->front);
-		surf->front = NULL;
+	// The buffer which was on screen has been replaced by the next submitted
+	// one
+	if (surf->bufs_len - surf->queued > 1) {
+		surface_release_buffer(surf, 0);
 	}
 }
 
@@ -208,7 +260,7 @@ static struct wlr_texture *get_tex_for_bo(struct wlr_drm_renderer *renderer, str
 }
 
 struct gbm_bo *wlr_drm_surface_mgpu_copy(struct wlr_drm_surface *dest, struct gbm_bo *src) {
-	wlr_drm_surface_make_current(dest);
+	wlr_drm_surface_make_current(dest, NULL);
 
 	struct wlr_texture *tex = get_tex_for_bo(dest->renderer, src);
 
@@ -232,8 +284,12 @@ struct gbm_bo *wlr_drm_surface_mgpu_copy(struct wlr_drm_surface *dest, struct gb
 bool wlr_drm_plane_surfaces_init(struct wlr_drm_plane *plane, struct wlr_drm_backend *drm,
 		int32_t width, uint32_t height, uint32_t format) {
 	if (!drm->parent) {
-		return wlr_drm_surface_init(&plane->surf, &drm->renderer, width, height,
-			format, GBM_BO_USE_SCANOUT);
+		if (!wlr_drm_surface_init(&plane->surf, &drm->renderer, width, height,
+				format, GBM_BO_USE_SCANOUT)) {
+			return false;
+		}
+		plane->surf.depth = drm->swapchain_depth;
+		return true;
 	}
 
 	if (!wlr_drm_surface_init(&plane->surf, &drm->parent->renderer,
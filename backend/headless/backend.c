@@ -0,0 +1,107 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <wayland-server.h>
+#include <wlr/backend/interface.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/egl.h>
+#include <wlr/util/log.h>
+#include "backend/headless.h"
+
+static bool backend_start(struct wlr_backend *wlr_backend) {
+	struct wlr_headless_backend *backend =
+		(struct wlr_headless_backend *)wlr_backend;
+	wlr_log(L_INFO, "Starting headless backend");
+
+	struct wlr_headless_output *output;
+	wl_list_for_each(output, &backend->outputs, link) {
+		wlr_headless_output_start(output);
+	}
+
+	backend->started = true;
+	return true;
+}
+
+static void backend_destroy(struct wlr_backend *wlr_backend) {
+	struct wlr_headless_backend *backend =
+		(struct wlr_headless_backend *)wlr_backend;
+	if (!wlr_backend) {
+		return;
+	}
+
+	struct wlr_headless_output *output, *tmp_output;
+	wl_list_for_each_safe(output, tmp_output, &backend->outputs, link) {
+		wlr_output_destroy(&output->wlr_output);
+	}
+
+	if (!backend->pixman) {
+		wlr_egl_free(&backend->egl);
+	}
+	free(backend);
+}
+
+static struct wlr_egl *backend_get_egl(struct wlr_backend *wlr_backend) {
+	struct wlr_headless_backend *backend =
+		(struct wlr_headless_backend *)wlr_backend;
+	if (backend->pixman) {
+		return NULL;
+	}
+	return &backend->egl;
+}
+
+static const struct wlr_backend_impl backend_impl = {
+	.start = backend_start,
+	.destroy = backend_destroy,
+	.get_egl = backend_get_egl,
+};
+
+bool wlr_backend_is_headless(struct wlr_backend *backend) {
+	return backend->impl == &backend_impl;
+}
+
+static struct wlr_headless_backend *backend_create(
+		struct wl_display *display) {
+	struct wlr_headless_backend *backend =
+		calloc(1, sizeof(struct wlr_headless_backend));
+	if (!backend) {
+		wlr_log(L_ERROR, "Failed to allocate wlr_headless_backend");
+		return NULL;
+	}
+	wlr_backend_init(&backend->backend, &backend_impl);
+	backend->display = display;
+	wl_list_init(&backend->outputs);
+	return backend;
+}
+
+struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
+	wlr_log(L_INFO, "Creating headless backend");
+
+	struct wlr_headless_backend *backend = backend_create(display);
+	if (!backend) {
+		return NULL;
+	}
+
+	if (!wlr_egl_init(&backend->egl, EGL_PLATFORM_SURFACELESS_MESA,
+			EGL_DONT_CARE, EGL_DEFAULT_DISPLAY)) {
+		wlr_log(L_ERROR, "Failed to initialize surfaceless EGL");
+		free(backend);
+		return NULL;
+	}
+	wlr_egl_bind_display(&backend->egl, display);
+
+	return &backend->backend;
+}
+
+struct wlr_backend *wlr_headless_backend_create_pixman(
+		struct wl_display *display) {
+	wlr_log(L_INFO, "Creating headless backend rendering with pixman");
+
+	struct wlr_headless_backend *backend = backend_create(display);
+	if (!backend) {
+		return NULL;
+	}
+	backend->pixman = true;
+
+	return &backend->backend;
+}
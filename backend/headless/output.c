@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 199309L
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/egl.h>
+#include <wlr/render/pixman.h>
+#include <wlr/util/log.h>
+#include "backend/headless.h"
+
+static int signal_frame(void *data) {
+	struct wlr_headless_output *output = data;
+	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+
+	// There is no vblank, the timer stands for it
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wlr_output_handle_vblank(&output->wlr_output, &now);
+	return 0;
+}
+
+static bool create_pixman_image(struct wlr_headless_output *output,
+		int width, int height) {
+	pixman_image_t *image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
+		width, height, NULL, 0);
+	if (image == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate output image");
+		return false;
+	}
+	if (output->image != NULL) {
+		pixman_image_unref(output->image);
+	}
+	output->image = image;
+	output->image_has_frame = false;
+	return true;
+}
+
+static bool create_egl_surface(struct wlr_headless_output *output,
+		int width, int height) {
+	struct wlr_headless_backend *backend = output->backend;
+	EGLSurface surface = wlr_egl_create_pbuffer_surface(&backend->egl,
+		width, height);
+	if (surface == EGL_NO_SURFACE) {
+		return false;
+	}
+	if (output->egl_surface != EGL_NO_SURFACE) {
+		eglDestroySurface(backend->egl.display, output->egl_surface);
+	}
+	output->egl_surface = surface;
+	return true;
+}
+
+static bool output_set_mode(struct wlr_output *wlr_output,
+		struct wlr_output_mode *mode) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+
+	bool ok = output->backend->pixman ?
+		create_pixman_image(output, mode->width, mode->height) :
+		create_egl_surface(output, mode->width, mode->height);
+	if (!ok) {
+		return false;
+	}
+
+	// A delay of 0 would disarm the frame timer
+	output->frame_delay = 1000000 / mode->refresh;
+	if (output->frame_delay < 1) {
+		output->frame_delay = 1;
+	}
+	wlr_output->current_mode = mode;
+	wlr_output_update_size(wlr_output, mode->width, mode->height);
+	return true;
+}
+
+static void output_transform(struct wlr_output *wlr_output,
+		enum wl_output_transform transform) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	output->wlr_output.transform = transform;
+}
+
+static bool output_make_current(struct wlr_output *wlr_output,
+		int *buffer_age) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	if (output->backend->pixman) {
+		wlr_pixman_make_current(output->image);
+		if (buffer_age) {
+			// The image is drawn to in place, it still holds the last frame
+			*buffer_age = output->image_has_frame ? 1 : 0;
+		}
+		return true;
+	}
+	return wlr_egl_make_current(&output->backend->egl, output->egl_surface,
+		buffer_age);
+}
+
+static void output_swap_buffers(struct wlr_output *wlr_output) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	// Nothing needs to be done for pbuffers. The pixman image is the frame,
+	// users read it back with wlr_renderer_read_pixels.
+	output->image_has_frame = output->image != NULL;
+}
+
+static void output_destroy(struct wlr_output *wlr_output) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	struct wlr_headless_backend *backend = output->backend;
+
+	if (output->started) {
+		wl_signal_emit(&backend->backend.events.output_remove, wlr_output);
+	}
+	wl_list_remove(&output->link);
+
+	if (output->frame_timer) {
+		wl_event_source_remove(output->frame_timer);
+	}
+	if (output->egl_surface != EGL_NO_SURFACE) {
+		eglDestroySurface(backend->egl.display, output->egl_surface);
+	}
+	if (output->image != NULL) {
+		if (wlr_pixman_get_current() == output->image) {
+			wlr_pixman_make_current(NULL);
+		}
+		pixman_image_unref(output->image);
+	}
+	free(output);
+}
+
+static const struct wlr_output_impl output_impl = {
+	.set_mode = output_set_mode,
+	.transform = output_transform,
+	.destroy = output_destroy,
+	.make_current = output_make_current,
+	.swap_buffers = output_swap_buffers,
+};
+
+void wlr_headless_output_start(struct wlr_headless_output *output) {
+	struct wlr_headless_backend *backend = output->backend;
+	wlr_output_create_global(&output->wlr_output, backend->display);
+	output->started = true;
+	wl_signal_emit(&backend->backend.events.output_add, &output->wlr_output);
+	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+}
+
+struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
+		unsigned int width, unsigned int height, int32_t refresh) {
+	assert(wlr_backend_is_headless(wlr_backend));
+	struct wlr_headless_backend *backend =
+		(struct wlr_headless_backend *)wlr_backend;
+
+	if (refresh <= 0) {
+		refresh = HEADLESS_DEFAULT_REFRESH;
+	}
+
+	struct wlr_headless_output *output =
+		calloc(1, sizeof(struct wlr_headless_output));
+	if (output == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate wlr_headless_output");
+		return NULL;
+	}
+	output->backend = backend;
+	output->egl_surface = EGL_NO_SURFACE;
+	wl_list_init(&output->link);
+	wlr_output_init(&output->wlr_output, &backend->backend, &output_impl);
+	struct wlr_output *wlr_output = &output->wlr_output;
+
+	strncpy(wlr_output->make, "headless", sizeof(wlr_output->make));
+	strncpy(wlr_output->model, "headless", sizeof(wlr_output->model));
+	snprintf(wlr_output->name, sizeof(wlr_output->name), "HEADLESS-%d",
+		wl_list_length(&backend->outputs) + 1);
+
+	struct wlr_output_mode *mode = calloc(1, sizeof(struct wlr_output_mode));
+	if (mode == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate wlr_output_mode");
+		goto error;
+	}
+	mode->flags = WL_OUTPUT_MODE_PREFERRED;
+	mode->width = width;
+	mode->height = height;
+	mode->refresh = refresh;
+	wl_list_insert(&wlr_output->modes, &mode->link);
+
+	if (!wlr_output_set_mode(wlr_output, mode)) {
+		wlr_log(L_ERROR, "Failed to set headless output mode");
+		goto error;
+	}
+
+	struct wl_event_loop *ev = wl_display_get_event_loop(backend->display);
+	output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
+	if (output->frame_timer == NULL) {
+		wlr_log(L_ERROR, "Failed to create frame timer");
+		goto error;
+	}
+
+	wl_list_insert(&backend->outputs, &output->link);
+	if (backend->started) {
+		wlr_headless_output_start(output);
+	}
+	return wlr_output;
+
+error:
+	wlr_output_destroy(wlr_output);
+	return NULL;
+}
@@ -78,11 +78,23 @@ static bool wlr_libinput_backend_start(struct wlr_backend *_backend) {
 		}
 	}
 
-	struct wl_event_loop *event_loop =
-		wl_display_get_event_loop(backend->display);
+	wlr_libinput_thread_stop(backend);
 	if (backend->input_event) {
 		wl_event_source_remove(backend->input_event);
+		backend->input_event = NULL;
+	}
+
+	char *threaded = getenv("WLR_LIBINPUT_THREAD");
+	if (threaded && strcmp(threaded, "1") == 0) {
+		if (wlr_libinput_thread_start(backend)) {
+			wlr_log(L_DEBUG, "libinput sucessfully initialized");
+			return true;
+		}
+		wlr_log(L_ERROR, "Falling back to reading libinput on the main loop");
 	}
+
+	struct wl_event_loop *event_loop =
+		wl_display_get_event_loop(backend->display);
 	backend->input_event = wl_event_loop_add_fd(event_loop, libinput_fd,
 			WL_EVENT_READABLE, wlr_libinput_readable, backend);
 	if (!backend->input_event) {
@@ -98,6 +110,7 @@ static void wlr_libinput_backend_destroy(struct wlr_backend *_backend) {
 		return;
 	}
 	struct wlr_libinput_backend *backend = (struct wlr_libinput_backend *)_backend;
+	wlr_libinput_thread_stop(backend);
 	for (size_t i = 0; i < backend->wlr_device_lists->length; i++) {
 		struct wlr_list *wlr_devices = backend->wlr_device_lists->items[i];
 		for (size_t j = 0; j < wlr_devices->length; j++) {
@@ -108,7 +121,9 @@ static void wlr_libinput_backend_destroy(struct wlr_backend *_backend) {
 		wlr_list_free(wlr_devices);
 	}
 	wlr_list_free(backend->wlr_device_lists);
-	wl_event_source_remove(backend->input_event);
+	if (backend->input_event) {
+		wl_event_source_remove(backend->input_event);
+	}
 	libinput_unref(backend->libinput_context);
 	free(backend);
 }
@@ -130,11 +145,13 @@ static void session_signal(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	wlr_libinput_lock(backend);
 	if (session->active) {
 		libinput_resume(backend->libinput_context);
 	} else {
 		libinput_suspend(backend->libinput_context);
 	}
+	wlr_libinput_unlock(backend);
 }
 
 struct wlr_backend *wlr_libinput_backend_create(struct wl_display *display,
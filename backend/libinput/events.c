@@ -77,7 +77,8 @@ static void handle_device_added(struct wlr_libinput_backend *backend,
 		if (!wlr_dev) {
 			goto fail;
 		}
-		wlr_dev->keyboard = wlr_libinput_keyboard_create(libinput_dev);
+		wlr_dev->keyboard = wlr_libinput_keyboard_create(backend,
+			libinput_dev);
 		if (!wlr_dev->keyboard) {
 			free(wlr_dev);
 			goto fail;
@@ -9,12 +9,15 @@
 
 struct wlr_libinput_keyboard {
 	struct wlr_keyboard wlr_keyboard;
+	struct wlr_libinput_backend *backend;
 	struct libinput_device *libinput_dev;
 };
 
 static void wlr_libinput_keyboard_set_leds(struct wlr_keyboard *wlr_kb, uint32_t leds) {
 	struct wlr_libinput_keyboard *wlr_libinput_kb = (struct wlr_libinput_keyboard *)wlr_kb;
+	wlr_libinput_lock(wlr_libinput_kb->backend);
 	libinput_device_led_update(wlr_libinput_kb->libinput_dev, leds);
+	wlr_libinput_unlock(wlr_libinput_kb->backend);
 }
 
 static void wlr_libinput_keyboard_destroy(struct wlr_keyboard *wlr_kb) {
@@ -29,12 +32,14 @@ struct wlr_keyboard_impl impl = {
 };
 
 struct wlr_keyboard *wlr_libinput_keyboard_create(
+		struct wlr_libinput_backend *backend,
 		struct libinput_device *libinput_dev) {
 	assert(libinput_dev);
 	struct wlr_libinput_keyboard *wlr_libinput_kb;
 	if (!(wlr_libinput_kb= calloc(1, sizeof(struct wlr_libinput_keyboard)))) {
 		return NULL;
 	}
+	wlr_libinput_kb->backend = backend;
 	wlr_libinput_kb->libinput_dev = libinput_dev;
 	libinput_device_ref(libinput_dev);
 	libinput_device_led_update(libinput_dev, 0);
@@ -43,30 +48,40 @@ struct wlr_keyboard *wlr_libinput_keyboard_create(
 	return wlr_kb;
 }
 
-void handle_keyboard_key(struct libinput_event *event,
-		struct libinput_device *libinput_dev) {
-	struct wlr_input_device *wlr_dev =
-		get_appropriate_device(WLR_INPUT_DEVICE_KEYBOARD, libinput_dev);
-	if (!wlr_dev) {
-		wlr_log(L_DEBUG, "Got a keyboard event for a device with no keyboards?");
-		return;
-	}
+void translate_keyboard_key(struct libinput_event *event,
+		struct wlr_event_keyboard_key *wlr_event) {
 	struct libinput_event_keyboard *kbevent =
 		libinput_event_get_keyboard_event(event);
-	struct wlr_event_keyboard_key wlr_event = { 0 };
-	wlr_event.time_sec = libinput_event_keyboard_get_time(kbevent);
-	wlr_event.time_usec = libinput_event_keyboard_get_time_usec(kbevent);
-	wlr_event.keycode = libinput_event_keyboard_get_key(kbevent);
-	enum libinput_key_state state = 
+	wlr_event->time_sec = libinput_event_keyboard_get_time(kbevent);
+	wlr_event->time_usec = libinput_event_keyboard_get_time_usec(kbevent);
+	wlr_event->keycode = libinput_event_keyboard_get_key(kbevent);
+	enum libinput_key_state state =
 		libinput_event_keyboard_get_key_state(kbevent);
 	switch (state) {
 	case LIBINPUT_KEY_STATE_RELEASED:
-		wlr_event.state = WLR_KEY_RELEASED;
+		wlr_event->state = WLR_KEY_RELEASED;
 		break;
 	case LIBINPUT_KEY_STATE_PRESSED:
-		wlr_event.state = WLR_KEY_PRESSED;
+		wlr_event->state = WLR_KEY_PRESSED;
 		break;
 	}
-	wlr_event.update_state = true;
-	wlr_keyboard_notify_key(wlr_dev->keyboard, &wlr_event);
+	wlr_event->update_state = true;
+}
+
+void emit_keyboard_key(struct libinput_device *libinput_dev,
+		struct wlr_event_keyboard_key *wlr_event) {
+	struct wlr_input_device *wlr_dev =
+		get_appropriate_device(WLR_INPUT_DEVICE_KEYBOARD, libinput_dev);
+	if (!wlr_dev) {
+		wlr_log(L_DEBUG, "Got a keyboard event for a device with no keyboards?");
+		return;
+	}
+	wlr_keyboard_notify_key(wlr_dev->keyboard, wlr_event);
+}
+
+void handle_keyboard_key(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_event_keyboard_key wlr_event = { 0 };
+	translate_keyboard_key(event, &wlr_event);
+	emit_keyboard_key(libinput_dev, &wlr_event);
 }
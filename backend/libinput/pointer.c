@@ -19,83 +19,113 @@ struct wlr_pointer *wlr_libinput_pointer_create(
 	return wlr_pointer;
 }
 
-void handle_pointer_motion(struct libinput_event *event,
+static struct wlr_input_device *get_pointer_device(
 		struct libinput_device *libinput_dev) {
 	struct wlr_input_device *wlr_dev =
 		get_appropriate_device(WLR_INPUT_DEVICE_POINTER, libinput_dev);
 	if (!wlr_dev) {
 		wlr_log(L_DEBUG, "Got a pointer event for a device with no pointers?");
-		return;
 	}
+	return wlr_dev;
+}
+
+void translate_pointer_motion(struct libinput_event *event,
+		struct wlr_event_pointer_motion *wlr_event) {
 	struct libinput_event_pointer *pevent =
 		libinput_event_get_pointer_event(event);
-	struct wlr_event_pointer_motion wlr_event = { 0 };
-	wlr_event.device = wlr_dev;
-	wlr_event.time_sec = libinput_event_pointer_get_time(pevent);
-	wlr_event.time_usec = libinput_event_pointer_get_time_usec(pevent);
-	wlr_event.delta_x = libinput_event_pointer_get_dx(pevent);
-	wlr_event.delta_y = libinput_event_pointer_get_dy(pevent);
-	wl_signal_emit(&wlr_dev->pointer->events.motion, &wlr_event);
+	wlr_event->time_sec = libinput_event_pointer_get_time(pevent);
+	wlr_event->time_usec = libinput_event_pointer_get_time_usec(pevent);
+	wlr_event->delta_x = libinput_event_pointer_get_dx(pevent);
+	wlr_event->delta_y = libinput_event_pointer_get_dy(pevent);
+	wlr_event->unaccel_dx = libinput_event_pointer_get_dx_unaccelerated(pevent);
+	wlr_event->unaccel_dy = libinput_event_pointer_get_dy_unaccelerated(pevent);
 }
 
-void handle_pointer_motion_abs(struct libinput_event *event,
-		struct libinput_device *libinput_dev) {
-	struct wlr_input_device *wlr_dev =
-		get_appropriate_device(WLR_INPUT_DEVICE_POINTER, libinput_dev);
+void emit_pointer_motion(struct libinput_device *libinput_dev,
+		struct wlr_event_pointer_motion *wlr_event) {
+	struct wlr_input_device *wlr_dev = get_pointer_device(libinput_dev);
 	if (!wlr_dev) {
-		wlr_log(L_DEBUG, "Got a pointer event for a device with no pointers?");
 		return;
 	}
+	wlr_event->device = wlr_dev;
+	wl_signal_emit(&wlr_dev->pointer->events.motion, wlr_event);
+}
+
+void handle_pointer_motion(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_event_pointer_motion wlr_event = { 0 };
+	translate_pointer_motion(event, &wlr_event);
+	emit_pointer_motion(libinput_dev, &wlr_event);
+}
+
+void translate_pointer_motion_abs(struct libinput_event *event,
+		struct wlr_event_pointer_motion_absolute *wlr_event) {
 	struct libinput_event_pointer *pevent =
 		libinput_event_get_pointer_event(event);
-	struct wlr_event_pointer_motion_absolute wlr_event = { 0 };
-	wlr_event.device = wlr_dev;
-	wlr_event.time_sec = libinput_event_pointer_get_time(pevent);
-	wlr_event.time_usec = libinput_event_pointer_get_time_usec(pevent);
-	wlr_event.x_mm = libinput_event_pointer_get_absolute_x(pevent);
-	wlr_event.y_mm = libinput_event_pointer_get_absolute_y(pevent);
-	libinput_device_get_size(libinput_dev, &wlr_event.width_mm, &wlr_event.height_mm);
-	wl_signal_emit(&wlr_dev->pointer->events.motion_absolute, &wlr_event);
+	wlr_event->time_sec = libinput_event_pointer_get_time(pevent);
+	wlr_event->time_usec = libinput_event_pointer_get_time_usec(pevent);
+	wlr_event->x_mm = libinput_event_pointer_get_absolute_x(pevent);
+	wlr_event->y_mm = libinput_event_pointer_get_absolute_y(pevent);
+	libinput_device_get_size(libinput_event_get_device(event),
+		&wlr_event->width_mm, &wlr_event->height_mm);
 }
 
-void handle_pointer_button(struct libinput_event *event,
-		struct libinput_device *libinput_dev) {
-	struct wlr_input_device *wlr_dev =
-		get_appropriate_device(WLR_INPUT_DEVICE_POINTER, libinput_dev);
+void emit_pointer_motion_abs(struct libinput_device *libinput_dev,
+		struct wlr_event_pointer_motion_absolute *wlr_event) {
+	struct wlr_input_device *wlr_dev = get_pointer_device(libinput_dev);
 	if (!wlr_dev) {
-		wlr_log(L_DEBUG, "Got a pointer event for a device with no pointers?");
 		return;
 	}
+	wlr_event->device = wlr_dev;
+	wl_signal_emit(&wlr_dev->pointer->events.motion_absolute, wlr_event);
+}
+
+void handle_pointer_motion_abs(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_event_pointer_motion_absolute wlr_event = { 0 };
+	translate_pointer_motion_abs(event, &wlr_event);
+	emit_pointer_motion_abs(libinput_dev, &wlr_event);
+}
+
+void translate_pointer_button(struct libinput_event *event,
+		struct wlr_event_pointer_button *wlr_event) {
 	struct libinput_event_pointer *pevent =
 		libinput_event_get_pointer_event(event);
-	struct wlr_event_pointer_button wlr_event = { 0 };
-	wlr_event.device = wlr_dev;
-	wlr_event.time_sec = libinput_event_pointer_get_time(pevent);
-	wlr_event.time_usec = libinput_event_pointer_get_time_usec(pevent);
-	wlr_event.button = libinput_event_pointer_get_button(pevent);
+	wlr_event->time_sec = libinput_event_pointer_get_time(pevent);
+	wlr_event->time_usec = libinput_event_pointer_get_time_usec(pevent);
+	wlr_event->button = libinput_event_pointer_get_button(pevent);
 	switch (libinput_event_pointer_get_button_state(pevent)) {
 	case LIBINPUT_BUTTON_STATE_PRESSED:
-		wlr_event.state = WLR_BUTTON_PRESSED;
+		wlr_event->state = WLR_BUTTON_PRESSED;
 		break;
 	case LIBINPUT_BUTTON_STATE_RELEASED:
-		wlr_event.state = WLR_BUTTON_RELEASED;
+		wlr_event->state = WLR_BUTTON_RELEASED;
 		break;
 	}
-	wl_signal_emit(&wlr_dev->pointer->events.button, &wlr_event);
 }
 
-void handle_pointer_axis(struct libinput_event *event,
-		struct libinput_device *libinput_dev) {
-	struct wlr_input_device *wlr_dev =
-		get_appropriate_device(WLR_INPUT_DEVICE_POINTER, libinput_dev);
+void emit_pointer_button(struct libinput_device *libinput_dev,
+		struct wlr_event_pointer_button *wlr_event) {
+	struct wlr_input_device *wlr_dev = get_pointer_device(libinput_dev);
 	if (!wlr_dev) {
-		wlr_log(L_DEBUG, "Got a pointer event for a device with no pointers?");
 		return;
 	}
+	wlr_event->device = wlr_dev;
+	wl_signal_emit(&wlr_dev->pointer->events.button, wlr_event);
+}
+
+void handle_pointer_button(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_event_pointer_button wlr_event = { 0 };
+	translate_pointer_button(event, &wlr_event);
+	emit_pointer_button(libinput_dev, &wlr_event);
+}
+
+size_t translate_pointer_axis(struct libinput_event *event,
+		struct wlr_event_pointer_axis wlr_events[static 2]) {
 	struct libinput_event_pointer *pevent =
 		libinput_event_get_pointer_event(event);
 	struct wlr_event_pointer_axis wlr_event = { 0 };
-	wlr_event.device = wlr_dev;
 	wlr_event.time_sec = libinput_event_pointer_get_time(pevent);
 	wlr_event.time_usec = libinput_event_pointer_get_time_usec(pevent);
 	switch (libinput_event_pointer_get_axis_source(pevent)) {
@@ -116,6 +146,7 @@ void handle_pointer_axis(struct libinput_event *event,
 		LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL,
 		LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL,
 	};
+	size_t n = 0;
 	for (size_t i = 0; i < sizeof(axies) / sizeof(axies[0]); ++i) {
 		if (libinput_event_pointer_has_axis(pevent, axies[i])) {
 			switch (axies[i]) {
@@ -128,7 +159,27 @@ void handle_pointer_axis(struct libinput_event *event,
 			}
 			wlr_event.delta = libinput_event_pointer_get_axis_value(
 					pevent, axies[i]);
-			wl_signal_emit(&wlr_dev->pointer->events.axis, &wlr_event);
+			wlr_events[n++] = wlr_event;
 		}
 	}
+	return n;
+}
+
+void emit_pointer_axis(struct libinput_device *libinput_dev,
+		struct wlr_event_pointer_axis *wlr_event) {
+	struct wlr_input_device *wlr_dev = get_pointer_device(libinput_dev);
+	if (!wlr_dev) {
+		return;
+	}
+	wlr_event->device = wlr_dev;
+	wl_signal_emit(&wlr_dev->pointer->events.axis, wlr_event);
+}
+
+void handle_pointer_axis(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_event_pointer_axis wlr_events[2];
+	size_t n = translate_pointer_axis(event, wlr_events);
+	for (size_t i = 0; i < n; ++i) {
+		emit_pointer_axis(libinput_dev, &wlr_events[i]);
+	}
 }
@@ -0,0 +1,339 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <libinput.h>
+#include <wlr/util/log.h>
+#include "backend/libinput.h"
+
+/*
+ * libinput is read on a dedicated thread so that input keeps flowing while
+ * the main loop is busy rendering or handling clients. The thread translates
+ * the hot pointer and keyboard events into wlr events and hands them to the
+ * main loop through a single-producer single-consumer ring; an eventfd wakes
+ * up the main loop when new records are available. Everything else (device
+ * hotplug, touch, tablets) is passed through as a libinput event and handled
+ * on the main thread with the libinput lock held.
+ */
+
+// Must be a power of two
+#define RING_SIZE 1024
+
+enum record_type {
+	RECORD_LIBINPUT_EVENT,
+	RECORD_KEYBOARD_KEY,
+	RECORD_POINTER_MOTION,
+	RECORD_POINTER_MOTION_ABS,
+	RECORD_POINTER_BUTTON,
+	RECORD_POINTER_AXIS,
+};
+
+struct record {
+	enum record_type type;
+	struct libinput_device *device;
+	union {
+		struct libinput_event *event;
+		struct wlr_event_keyboard_key key;
+		struct wlr_event_pointer_motion motion;
+		struct wlr_event_pointer_motion_absolute motion_abs;
+		struct wlr_event_pointer_button button;
+		struct wlr_event_pointer_axis axis;
+	};
+};
+
+struct wlr_libinput_thread {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int event_fd; // signaled by the input thread when records are available
+	int wake_fd; // signaled by the main loop when the ring has room again
+	struct wl_event_source *event_source;
+	atomic_bool stop;
+	atomic_bool ring_full;
+
+	// Free-running indices, masked with RING_SIZE - 1 to address records.
+	// head - tail is the number of queued records, even once they wrap.
+	// Written by the input thread only
+	atomic_size_t head;
+	// Written by the main thread only
+	atomic_size_t tail;
+	struct record records[RING_SIZE];
+};
+
+static size_t ring_space(struct wlr_libinput_thread *thread) {
+	size_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+	size_t tail = atomic_load(&thread->tail);
+	return RING_SIZE - (head - tail);
+}
+
+static void ring_push(struct wlr_libinput_thread *thread,
+		const struct record *record) {
+	size_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+	thread->records[head & (RING_SIZE - 1)] = *record;
+	atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+static bool ring_pop(struct wlr_libinput_thread *thread, size_t head,
+		struct record *record) {
+	size_t tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+	if (tail == head) {
+		return false;
+	}
+	*record = thread->records[tail & (RING_SIZE - 1)];
+	atomic_store(&thread->tail, tail + 1);
+	return true;
+}
+
+static void push_event(struct wlr_libinput_thread *thread,
+		struct libinput_event *event) {
+	struct record record = { 0 };
+	record.device = libinput_event_get_device(event);
+	switch (libinput_event_get_type(event)) {
+	case LIBINPUT_EVENT_KEYBOARD_KEY:
+		record.type = RECORD_KEYBOARD_KEY;
+		translate_keyboard_key(event, &record.key);
+		break;
+	case LIBINPUT_EVENT_POINTER_MOTION:
+		record.type = RECORD_POINTER_MOTION;
+		translate_pointer_motion(event, &record.motion);
+		break;
+	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+		record.type = RECORD_POINTER_MOTION_ABS;
+		translate_pointer_motion_abs(event, &record.motion_abs);
+		break;
+	case LIBINPUT_EVENT_POINTER_BUTTON:
+		record.type = RECORD_POINTER_BUTTON;
+		translate_pointer_button(event, &record.button);
+		break;
+	case LIBINPUT_EVENT_POINTER_AXIS:;
+		struct wlr_event_pointer_axis axis[2];
+		size_t n = translate_pointer_axis(event, axis);
+		record.type = RECORD_POINTER_AXIS;
+		for (size_t i = 0; i < n; ++i) {
+			record.axis = axis[i];
+			ring_push(thread, &record);
+		}
+		libinput_event_destroy(event);
+		return;
+	default:
+		record.type = RECORD_LIBINPUT_EVENT;
+		record.event = event;
+		ring_push(thread, &record);
+		return;
+	}
+	libinput_event_destroy(event);
+	ring_push(thread, &record);
+}
+
+static bool ring_has_room(struct wlr_libinput_thread *thread) {
+	// A libinput event takes up to two records
+	if (ring_space(thread) >= 2) {
+		return true;
+	}
+	// Ask the main loop to wake us up once it has drained the ring, and check
+	// again in case it just did
+	atomic_store(&thread->ring_full, true);
+	if (ring_space(thread) >= 2) {
+		atomic_store(&thread->ring_full, false);
+		return true;
+	}
+	return false;
+}
+
+static void read_events(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = backend->thread;
+	bool pushed = false;
+
+	pthread_mutex_lock(&thread->lock);
+	if (libinput_dispatch(backend->libinput_context) != 0) {
+		wlr_log(L_ERROR, "Failed to dispatch libinput");
+	}
+	// Events which don't fit stay queued in libinput until the ring drains
+	struct libinput_event *event;
+	while (ring_has_room(thread) &&
+			(event = libinput_get_event(backend->libinput_context))) {
+		push_event(thread, event);
+		pushed = true;
+	}
+	pthread_mutex_unlock(&thread->lock);
+
+	if (pushed) {
+		eventfd_write(thread->event_fd, 1);
+	}
+}
+
+static void *input_thread(void *data) {
+	struct wlr_libinput_backend *backend = data;
+	struct wlr_libinput_thread *thread = backend->thread;
+	struct pollfd fds[] = {
+		{ .fd = libinput_get_fd(backend->libinput_context), .events = POLLIN },
+		{ .fd = thread->wake_fd, .events = POLLIN },
+	};
+	while (!atomic_load(&thread->stop)) {
+		if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			wlr_log_errno(L_ERROR, "Failed to poll libinput");
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			eventfd_t count;
+			eventfd_read(thread->wake_fd, &count);
+		}
+		read_events(backend);
+	}
+	return NULL;
+}
+
+static void handle_record(struct wlr_libinput_backend *backend,
+		struct record *record) {
+	switch (record->type) {
+	case RECORD_LIBINPUT_EVENT:
+		wlr_libinput_lock(backend);
+		wlr_libinput_event(backend, record->event);
+		libinput_event_destroy(record->event);
+		wlr_libinput_unlock(backend);
+		break;
+	case RECORD_KEYBOARD_KEY:
+		emit_keyboard_key(record->device, &record->key);
+		break;
+	case RECORD_POINTER_MOTION:
+		emit_pointer_motion(record->device, &record->motion);
+		break;
+	case RECORD_POINTER_MOTION_ABS:
+		emit_pointer_motion_abs(record->device, &record->motion_abs);
+		break;
+	case RECORD_POINTER_BUTTON:
+		emit_pointer_button(record->device, &record->button);
+		break;
+	case RECORD_POINTER_AXIS:
+		emit_pointer_axis(record->device, &record->axis);
+		break;
+	}
+}
+
+static int handle_thread_readable(int fd, uint32_t mask, void *data) {
+	struct wlr_libinput_backend *backend = data;
+	struct wlr_libinput_thread *thread = backend->thread;
+	eventfd_t count;
+	eventfd_read(fd, &count);
+
+	// Records pushed while these are dispatched signal the eventfd again, so
+	// a busy input thread can't keep us here forever. Devices outlive the
+	// records which refer to them: their removal event comes after these.
+	size_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+	struct record record;
+	while (ring_pop(thread, head, &record)) {
+		handle_record(backend, &record);
+	}
+
+	if (atomic_exchange(&thread->ring_full, false)) {
+		eventfd_write(thread->wake_fd, 1);
+	}
+	return 0;
+}
+
+bool wlr_libinput_thread_start(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread =
+		calloc(1, sizeof(struct wlr_libinput_thread));
+	if (!thread) {
+		wlr_log(L_ERROR, "Allocation failed: %s", strerror(errno));
+		return false;
+	}
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	// The main thread may re-enter, e.g. to update the LEDs of a keyboard
+	// from an input_add handler
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&thread->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	thread->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->event_fd < 0 || thread->wake_fd < 0) {
+		wlr_log_errno(L_ERROR, "Failed to create eventfd");
+		goto error_fds;
+	}
+
+	struct wl_event_loop *event_loop =
+		wl_display_get_event_loop(backend->display);
+	thread->event_source = wl_event_loop_add_fd(event_loop, thread->event_fd,
+		WL_EVENT_READABLE, handle_thread_readable, backend);
+	if (!thread->event_source) {
+		wlr_log(L_ERROR, "Failed to create input event on event loop");
+		goto error_fds;
+	}
+
+	backend->thread = thread;
+
+	// Signals are for the main thread to handle
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+	int ret = pthread_create(&thread->thread, NULL, input_thread, backend);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (ret != 0) {
+		wlr_log(L_ERROR, "Failed to create input thread: %s", strerror(ret));
+		backend->thread = NULL;
+		wl_event_source_remove(thread->event_source);
+		goto error_fds;
+	}
+	wlr_log(L_DEBUG, "Reading libinput events on a dedicated thread");
+	return true;
+
+error_fds:
+	if (thread->event_fd >= 0) {
+		close(thread->event_fd);
+	}
+	if (thread->wake_fd >= 0) {
+		close(thread->wake_fd);
+	}
+	pthread_mutex_destroy(&thread->lock);
+	free(thread);
+	return false;
+}
+
+void wlr_libinput_thread_stop(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = backend->thread;
+	if (!thread) {
+		return;
+	}
+	atomic_store(&thread->stop, true);
+	eventfd_write(thread->wake_fd, 1);
+	pthread_join(thread->thread, NULL);
+	backend->thread = NULL;
+
+	// Drop the records which were not dispatched yet
+	size_t head = atomic_load(&thread->head);
+	struct record record;
+	while (ring_pop(thread, head, &record)) {
+		if (record.type == RECORD_LIBINPUT_EVENT) {
+			libinput_event_destroy(record.event);
+		}
+	}
+
+	wl_event_source_remove(thread->event_source);
+	close(thread->event_fd);
+	close(thread->wake_fd);
+	pthread_mutex_destroy(&thread->lock);
+	free(thread);
+}
+
+void wlr_libinput_lock(struct wlr_libinput_backend *backend) {
+	if (backend->thread) {
+		pthread_mutex_lock(&backend->thread->lock);
+	}
+}
+
+void wlr_libinput_unlock(struct wlr_libinput_backend *backend) {
+	if (backend->thread) {
+		pthread_mutex_unlock(&backend->thread->lock);
+	}
+}
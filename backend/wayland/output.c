@@ -18,23 +18,22 @@ int os_create_anonymous_file(off_t size);
 static struct wl_callback_listener frame_listener;
 
 static void surface_frame_callback(void *data, struct wl_callback *cb, uint32_t time) {
-	struct wlr_output *wlr_output = data;
-	assert(wlr_output);
-	wl_signal_emit(&wlr_output->events.frame, wlr_output);
+	struct wlr_wl_backend_output *output = data;
+	assert(output);
 	wl_callback_destroy(cb);
+	output->frame_callback = NULL;
+	wlr_output_send_frame(&output->wlr_output);
 }
 
 static struct wl_callback_listener frame_listener = {
 	.done = surface_frame_callback
 };
 
-static void wlr_wl_output_make_current(struct wlr_output *_output) {
+static bool wlr_wl_output_make_current(struct wlr_output *_output,
+		int *buffer_age) {
 	struct wlr_wl_backend_output *output = (struct wlr_wl_backend_output *)_output;
-	if (!eglMakeCurrent(output->backend->egl.display,
-		output->egl_surface, output->egl_surface,
-		output->backend->egl.context)) {
-		wlr_log(L_ERROR, "eglMakeCurrent failed: %s", egl_error());
-	}
+	return wlr_egl_make_current(&output->backend->egl, output->egl_surface,
+		buffer_age);
 }
 
 static void wlr_wl_output_swap_buffers(struct wlr_output *_output) {
@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/gles2.h>
+#include <wlr/render/pixman.h>
+#include <wlr/util/log.h>
+#include "bench.h"
+
+#define BENCH_DEFAULT_SAMPLES 50
+// Each sample runs the operation enough times to last at least this long, so
+// that the clock overhead is negligible even for the cheapest operations
+#define BENCH_MIN_SAMPLE_NS 2000000
+
+static const struct bench *benches[] = {
+	&bench_matrix_mul,
+	&bench_texture_upload_pixels,
+	&bench_texture_update_pixels,
+	&bench_render_frame,
+	&bench_read_pixels,
+	&bench_surface_commit,
+	&bench_surface_commit_transformed,
+	&bench_surface_commit_subsurfaces,
+	&bench_view_at,
+	&bench_view_at_motion,
+	&bench_output_layout_output_at,
+};
+
+struct bench_result {
+	size_t samples;
+	size_t iterations; // per sample
+	double mean_ns, median_ns, min_ns, max_ns, stddev_ns; // per operation
+};
+
+uint32_t bench_rand(uint32_t *seed) {
+	// xorshift32
+	uint32_t x = *seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+	return x;
+}
+
+static int64_t get_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t time_run(const struct bench *bench, void *state, size_t n) {
+	int64_t start = get_time_ns();
+	bench->run(state, n);
+	return get_time_ns() - start;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+static bool run_bench(const struct bench *bench, struct bench_context *ctx,
+		size_t samples, struct bench_result *result) {
+	void *state = bench->setup(ctx);
+	if (!state) {
+		wlr_log(L_ERROR, "Failed to set up benchmark %s", bench->name);
+		return false;
+	}
+
+	// Warm up caches and find how many iterations fill a sample
+	size_t n = 1;
+	while (time_run(bench, state, n) < BENCH_MIN_SAMPLE_NS && n < (1 << 30)) {
+		n *= 2;
+	}
+
+	double *per_op = calloc(samples, sizeof(double));
+	if (!per_op) {
+		bench->teardown(state);
+		return false;
+	}
+	for (size_t i = 0; i < samples; ++i) {
+		per_op[i] = (double)time_run(bench, state, n) / n;
+	}
+	bench->teardown(state);
+
+	double sum = 0.0;
+	for (size_t i = 0; i < samples; ++i) {
+		sum += per_op[i];
+	}
+	double mean = sum / samples;
+	double var = 0.0;
+	for (size_t i = 0; i < samples; ++i) {
+		var += (per_op[i] - mean) * (per_op[i] - mean);
+	}
+
+	qsort(per_op, samples, sizeof(double), compare_double);
+	result->samples = samples;
+	result->iterations = n;
+	result->mean_ns = mean;
+	result->median_ns = samples % 2 ? per_op[samples / 2] :
+		(per_op[samples / 2 - 1] + per_op[samples / 2]) / 2;
+	result->min_ns = per_op[0];
+	result->max_ns = per_op[samples - 1];
+	result->stddev_ns = sqrt(var / samples);
+	free(per_op);
+	return true;
+}
+
+static void print_result(FILE *f, const struct bench *bench,
+		const struct bench_result *result, bool first) {
+	fprintf(f, "%s\n\t\t{\n", first ? "" : ",");
+	fprintf(f, "\t\t\t\"name\": \"%s\",\n", bench->name);
+	fprintf(f, "\t\t\t\"workload\": \"%s\",\n", bench->workload);
+	fprintf(f, "\t\t\t\"samples\": %zu,\n", result->samples);
+	fprintf(f, "\t\t\t\"iterations_per_sample\": %zu,\n", result->iterations);
+	fprintf(f, "\t\t\t\"mean_ns\": %.3f,\n", result->mean_ns);
+	fprintf(f, "\t\t\t\"median_ns\": %.3f,\n", result->median_ns);
+	fprintf(f, "\t\t\t\"min_ns\": %.3f,\n", result->min_ns);
+	fprintf(f, "\t\t\t\"max_ns\": %.3f,\n", result->max_ns);
+	fprintf(f, "\t\t\t\"stddev_ns\": %.3f\n", result->stddev_ns);
+	fprintf(f, "\t\t}");
+}
+
+static bool context_init(struct bench_context *ctx, bool pixman) {
+	ctx->display = wl_display_create();
+	if (!ctx->display) {
+		return false;
+	}
+	ctx->event_loop = wl_display_get_event_loop(ctx->display);
+	wl_display_init_shm(ctx->display);
+
+	if (pixman) {
+		ctx->backend = wlr_headless_backend_create_pixman(ctx->display);
+	} else {
+		ctx->backend = wlr_headless_backend_create(ctx->display);
+	}
+	if (!ctx->backend) {
+		return false;
+	}
+	ctx->output = wlr_headless_add_output(ctx->backend, 1920, 1080, 0);
+	if (!ctx->output || !wlr_backend_start(ctx->backend)) {
+		return false;
+	}
+	if (pixman) {
+		ctx->renderer = wlr_pixman_renderer_create();
+	} else {
+		ctx->renderer = wlr_gles2_renderer_create(ctx->backend);
+	}
+	if (!ctx->renderer) {
+		return false;
+	}
+	ctx->compositor = wlr_compositor_create(ctx->display, ctx->renderer);
+	if (!ctx->compositor) {
+		return false;
+	}
+
+	// Texture uploads need a current context, the headless output keeps its
+	// pbuffer (or pixman image) current for the whole run
+	return wlr_output_make_current(ctx->output, NULL);
+}
+
+static void context_finish(struct bench_context *ctx) {
+	if (ctx->compositor) {
+		wlr_compositor_destroy(ctx->compositor);
+	}
+	if (ctx->renderer) {
+		wlr_renderer_destroy(ctx->renderer);
+	}
+	if (ctx->backend) {
+		wlr_backend_destroy(ctx->backend);
+	}
+	if (ctx->display) {
+		wl_display_destroy(ctx->display);
+	}
+}
+
+static void usage(const char *name, int ret) {
+	fprintf(stderr,
+		"usage: %s [-n <SAMPLES>] [-f <FILTER>] [-r <RENDERER>] [-o <FILE>] "
+		"[-l]\n"
+		"\n"
+		" -n <SAMPLES>  Number of timed samples per benchmark.\n"
+		" -f <FILTER>   Only run benchmarks whose name contains FILTER.\n"
+		" -r <RENDERER> Renderer to use, gles2 (default) or pixman.\n"
+		" -o <FILE>     Write the JSON results to FILE instead of stdout.\n"
+		" -l            List the benchmarks and exit.\n",
+		name);
+	exit(ret);
+}
+
+int main(int argc, char **argv) {
+	size_t samples = BENCH_DEFAULT_SAMPLES;
+	const char *filter = NULL;
+	const char *out_path = NULL;
+	bool pixman = false;
+	size_t benches_len = sizeof(benches) / sizeof(benches[0]);
+
+	int c;
+	while ((c = getopt(argc, argv, "n:f:r:o:lh")) != -1) {
+		switch (c) {
+		case 'n':
+			samples = strtoul(optarg, NULL, 10);
+			if (samples == 0) {
+				usage(argv[0], 1);
+			}
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'r':
+			if (strcmp(optarg, "pixman") == 0) {
+				pixman = true;
+			} else if (strcmp(optarg, "gles2") != 0) {
+				usage(argv[0], 1);
+			}
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'l':
+			for (size_t i = 0; i < benches_len; ++i) {
+				printf("%s: %s\n", benches[i]->name, benches[i]->workload);
+			}
+			return 0;
+		case 'h':
+		case '?':
+			usage(argv[0], c != 'h');
+		}
+	}
+
+	wlr_log_init(NULL);
+
+	struct bench_context ctx = { 0 };
+	if (!context_init(&ctx, pixman)) {
+		wlr_log(L_ERROR, "Failed to initialize the benchmark context");
+		context_finish(&ctx);
+		return 1;
+	}
+
+	FILE *f = stdout;
+	if (out_path) {
+		f = fopen(out_path, "w");
+		if (!f) {
+			wlr_log_errno(L_ERROR, "Failed to open %s", out_path);
+			context_finish(&ctx);
+			return 1;
+		}
+	}
+
+	int ret = 0;
+	bool first = true;
+	fprintf(f, "{\n\t\"benchmarks\": [");
+	for (size_t i = 0; i < benches_len; ++i) {
+		const struct bench *bench = benches[i];
+		if (filter && !strstr(bench->name, filter)) {
+			continue;
+		}
+
+		wlr_log(L_INFO, "Running %s", bench->name);
+		struct bench_result result;
+		if (!run_bench(bench, &ctx, samples, &result)) {
+			ret = 1;
+			continue;
+		}
+		print_result(f, bench, &result, first);
+		first = false;
+	}
+	fprintf(f, "\n\t]\n}\n");
+
+	if (f != stdout) {
+		fclose(f);
+	}
+	context_finish(&ctx);
+	return ret;
+}
@@ -0,0 +1,88 @@
+#ifndef _WLR_BENCH_H
+#define _WLR_BENCH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/render.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+
+/**
+ * Everything a benchmark can use: a headless backend with one output, a GLES2
+ * or pixman renderer whose target is current and a compositor for client
+ * surfaces.
+ */
+struct bench_context {
+	struct wl_display *display;
+	struct wl_event_loop *event_loop;
+	struct wlr_backend *backend;
+	struct wlr_output *output;
+	struct wlr_renderer *renderer;
+	struct wlr_compositor *compositor;
+};
+
+struct bench {
+	const char *name;
+	// Description of the synthetic workload, copied to the results
+	const char *workload;
+	// Prepares the workload, returns NULL on failure
+	void *(*setup)(struct bench_context *ctx);
+	// Performs the measured operation `n` times
+	void (*run)(void *state, size_t n);
+	void (*teardown)(void *state);
+};
+
+extern const struct bench bench_matrix_mul;
+extern const struct bench bench_texture_upload_pixels;
+extern const struct bench bench_texture_update_pixels;
+extern const struct bench bench_render_frame;
+extern const struct bench bench_read_pixels;
+extern const struct bench bench_surface_commit;
+extern const struct bench bench_surface_commit_transformed;
+extern const struct bench bench_surface_commit_subsurfaces;
+extern const struct bench bench_view_at;
+extern const struct bench bench_view_at_motion;
+extern const struct bench bench_output_layout_output_at;
+
+/**
+ * Deterministic pseudo-random numbers, so that every run measures the same
+ * workload.
+ */
+uint32_t bench_rand(uint32_t *seed);
+
+/**
+ * An in-process Wayland client connected to the benchmark display. Requests
+ * are dispatched by the compositor on bench_client_sync.
+ */
+struct bench_client {
+	struct bench_context *ctx;
+	struct wl_client *wl_client; // compositor side
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+};
+
+struct bench_client *bench_client_create(struct bench_context *ctx);
+void bench_client_destroy(struct bench_client *client);
+/**
+ * Flushes the client requests, lets the compositor handle them and reads back
+ * the events it sent.
+ */
+void bench_client_sync(struct bench_client *client);
+/**
+ * Creates a XRGB8888 shm buffer filled with a pattern.
+ */
+struct wl_buffer *bench_client_create_buffer(struct bench_client *client,
+		int width, int height);
+/**
+ * Gets the compositor side of a client surface.
+ */
+struct wlr_surface *bench_client_get_surface(struct bench_client *client,
+		struct wl_surface *surface);
+
+#endif
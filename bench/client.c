@@ -0,0 +1,151 @@
+#define _XOPEN_SOURCE 700
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+#include "bench.h"
+#include "../backend/wayland/os-compatibility.c"
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct bench_client *client = data;
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor = wl_registry_bind(registry, name,
+			&wl_compositor_interface, 4);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client->subcompositor = wl_registry_bind(registry, name,
+			&wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	}
+}
+
+static void registry_handle_global_remove(void *data,
+		struct wl_registry *registry, uint32_t name) {
+	// This space intentionally left blank
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_handle_global,
+	.global_remove = registry_handle_global_remove,
+};
+
+void bench_client_sync(struct bench_client *client) {
+	wl_display_flush(client->display);
+	wl_event_loop_dispatch(client->ctx->event_loop, 0);
+	wl_display_flush_clients(client->ctx->display);
+
+	// Both ends live in the same thread, so events must be read without
+	// blocking
+	while (wl_display_prepare_read(client->display) != 0) {
+		wl_display_dispatch_pending(client->display);
+	}
+	struct pollfd pfd = {
+		.fd = wl_display_get_fd(client->display),
+		.events = POLLIN,
+	};
+	if (poll(&pfd, 1, 0) > 0) {
+		wl_display_read_events(client->display);
+	} else {
+		wl_display_cancel_read(client->display);
+	}
+	wl_display_dispatch_pending(client->display);
+}
+
+struct bench_client *bench_client_create(struct bench_context *ctx) {
+	struct bench_client *client = calloc(1, sizeof(struct bench_client));
+	if (!client) {
+		return NULL;
+	}
+	client->ctx = ctx;
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		wlr_log_errno(L_ERROR, "Failed to create socket pair");
+		free(client);
+		return NULL;
+	}
+	client->wl_client = wl_client_create(ctx->display, fds[0]);
+	if (!client->wl_client) {
+		close(fds[0]);
+		close(fds[1]);
+		free(client);
+		return NULL;
+	}
+	client->display = wl_display_connect_to_fd(fds[1]);
+	if (!client->display) {
+		close(fds[1]);
+		wl_client_destroy(client->wl_client);
+		free(client);
+		return NULL;
+	}
+
+	client->registry = wl_display_get_registry(client->display);
+	wl_registry_add_listener(client->registry, &registry_listener, client);
+	// Once to get the globals, once more to bind them
+	bench_client_sync(client);
+	bench_client_sync(client);
+
+	if (!client->compositor || !client->subcompositor || !client->shm) {
+		wlr_log(L_ERROR, "Compositor globals are missing");
+		bench_client_destroy(client);
+		return NULL;
+	}
+	return client;
+}
+
+void bench_client_destroy(struct bench_client *client) {
+	if (!client) {
+		return;
+	}
+	wl_display_disconnect(client->display);
+	wl_client_destroy(client->wl_client);
+	free(client);
+}
+
+struct wl_buffer *bench_client_create_buffer(struct bench_client *client,
+		int width, int height) {
+	int stride = width * 4;
+	int size = stride * height;
+
+	int fd = os_create_anonymous_file(size);
+	if (fd < 0) {
+		wlr_log_errno(L_ERROR, "Failed to create a %d B buffer file", size);
+		return NULL;
+	}
+
+	uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, 0);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(L_ERROR, "mmap failed");
+		close(fd);
+		return NULL;
+	}
+	for (int i = 0; i < width * height; ++i) {
+		data[i] = 0xFF000000 | (i * 2654435761u >> 8);
+	}
+	munmap(data, size);
+
+	struct wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, size);
+	close(fd);
+	struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width,
+		height, stride, WL_SHM_FORMAT_XRGB8888);
+	wl_shm_pool_destroy(pool);
+	return buffer;
+}
+
+struct wlr_surface *bench_client_get_surface(struct bench_client *client,
+		struct wl_surface *surface) {
+	struct wl_resource *resource = wl_client_get_object(client->wl_client,
+		wl_proxy_get_id((struct wl_proxy *)surface));
+	if (!resource) {
+		return NULL;
+	}
+	return wl_resource_get_user_data(resource);
+}
@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <wayland-client.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/types/wlr_list.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_surface.h>
+#include "rootston/desktop.h"
+#include "rootston/server.h"
+#include "rootston/view.h"
+#include "bench.h"
+
+// rootston/main.c is not part of the benchmark
+struct roots_server server = { 0 };
+
+#define LAYOUT_WIDTH 3840
+#define LAYOUT_HEIGHT 2160
+#define VIEWS 128
+#define VIEW_BUFFERS 4
+
+struct view_at_state {
+	struct bench_client *client;
+	struct roots_desktop desktop;
+	struct roots_view views[VIEWS];
+	struct wl_surface *surfaces[VIEWS];
+	struct wl_buffer *buffers[VIEW_BUFFERS];
+	uint32_t seed;
+};
+
+static void view_at_teardown(void *data) {
+	struct view_at_state *state = data;
+	for (size_t i = 0; i < VIEWS; ++i) {
+		if (state->surfaces[i]) {
+			wl_surface_destroy(state->surfaces[i]);
+		}
+	}
+	for (size_t i = 0; i < VIEW_BUFFERS; ++i) {
+		if (state->buffers[i]) {
+			wl_buffer_destroy(state->buffers[i]);
+		}
+	}
+	if (state->client) {
+		bench_client_sync(state->client);
+		bench_client_destroy(state->client);
+	}
+	desktop_finish_view_index(&state->desktop);
+	wlr_list_free(state->desktop.views);
+	free(state);
+}
+
+static void *view_at_setup(struct bench_context *ctx) {
+	static const int sizes[VIEW_BUFFERS][2] = {
+		{ 640, 480 }, { 800, 600 }, { 320, 240 }, { 1280, 720 },
+	};
+
+	struct view_at_state *state = calloc(1, sizeof(struct view_at_state));
+	if (!state) {
+		return NULL;
+	}
+	state->seed = 0xC0FFEE;
+	state->desktop.views = wlr_list_create();
+	state->client = bench_client_create(ctx);
+	if (!state->desktop.views || !state->client) {
+		goto error;
+	}
+
+	// Buffers are shared between surfaces to keep the memory usage low
+	for (size_t i = 0; i < VIEW_BUFFERS; ++i) {
+		state->buffers[i] = bench_client_create_buffer(state->client,
+			sizes[i][0], sizes[i][1]);
+		if (!state->buffers[i]) {
+			goto error;
+		}
+	}
+
+	for (size_t i = 0; i < VIEWS; ++i) {
+		struct wl_surface *surface =
+			wl_compositor_create_surface(state->client->compositor);
+		state->surfaces[i] = surface;
+		wl_surface_attach(surface, state->buffers[i % VIEW_BUFFERS], 0, 0);
+		wl_surface_commit(surface);
+		bench_client_sync(state->client);
+
+		// Views are set up by hand, without any shell
+		struct roots_view *view = &state->views[i];
+		view->desktop = &state->desktop;
+		view->type = ROOTS_XWAYLAND_VIEW;
+		view->wlr_surface = bench_client_get_surface(state->client, surface);
+		view->x = bench_rand(&state->seed) % LAYOUT_WIDTH;
+		view->y = bench_rand(&state->seed) % LAYOUT_HEIGHT;
+		if (!view->wlr_surface) {
+			goto error;
+		}
+		wlr_list_add(state->desktop.views, view);
+	}
+	return state;
+
+error:
+	view_at_teardown(state);
+	return NULL;
+}
+
+static void view_at_run(void *data, size_t n) {
+	struct view_at_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		double lx = bench_rand(&state->seed) % LAYOUT_WIDTH;
+		double ly = bench_rand(&state->seed) % LAYOUT_HEIGHT;
+		struct wlr_surface *surface;
+		double sx, sy;
+		view_at(&state->desktop, lx, ly, &surface, &sx, &sy);
+	}
+}
+
+const struct bench bench_view_at = {
+	.name = "view_at",
+	.workload = "128 overlapping views on a 3840x2160 layout, "
+		"random points",
+	.setup = view_at_setup,
+	.run = view_at_run,
+	.teardown = view_at_teardown,
+};
+
+static void view_at_motion_run(void *data, size_t n) {
+	struct view_at_state *state = data;
+	// Pointer motion inside the topmost view, a few pixels per event
+	struct roots_view *view = &state->views[VIEWS - 1];
+	int width = view->wlr_surface->current->width;
+	int height = view->wlr_surface->current->height;
+	for (size_t i = 0; i < n; ++i) {
+		double lx = view->x + (i * 3) % width;
+		double ly = view->y + (i * 2) % height;
+		struct wlr_surface *surface;
+		double sx, sy;
+		view_at(&state->desktop, lx, ly, &surface, &sx, &sy);
+	}
+}
+
+const struct bench bench_view_at_motion = {
+	.name = "view_at_motion",
+	.workload = "128 overlapping views on a 3840x2160 layout, "
+		"pointer motion inside the topmost view",
+	.setup = view_at_setup,
+	.run = view_at_motion_run,
+	.teardown = view_at_teardown,
+};
+
+#define LAYOUT_COLUMNS 4
+#define LAYOUT_ROWS 4
+
+static const struct wlr_output_impl output_impl = { 0 };
+
+struct output_at_state {
+	struct wlr_output_layout *layout;
+	struct wlr_output *outputs[LAYOUT_COLUMNS * LAYOUT_ROWS];
+	uint32_t seed;
+};
+
+static void output_at_teardown(void *data) {
+	struct output_at_state *state = data;
+	wlr_output_layout_destroy(state->layout);
+	for (size_t i = 0; i < LAYOUT_COLUMNS * LAYOUT_ROWS; ++i) {
+		wlr_output_destroy(state->outputs[i]);
+	}
+	free(state);
+}
+
+static void *output_at_setup(struct bench_context *ctx) {
+	struct output_at_state *state = calloc(1, sizeof(struct output_at_state));
+	if (!state) {
+		return NULL;
+	}
+	state->seed = 0xC0FFEE;
+	state->layout = wlr_output_layout_create();
+	if (!state->layout) {
+		free(state);
+		return NULL;
+	}
+
+	// Outputs only need a size to be laid out, they have no backend
+	for (int y = 0; y < LAYOUT_ROWS; ++y) {
+		for (int x = 0; x < LAYOUT_COLUMNS; ++x) {
+			struct wlr_output *output = calloc(1, sizeof(struct wlr_output));
+			if (!output) {
+				output_at_teardown(state);
+				return NULL;
+			}
+			wlr_output_init(output, ctx->backend, &output_impl);
+			wlr_output_update_size(output, 1920, 1080);
+			wlr_output_layout_add(state->layout, output, x * 1920, y * 1080);
+			state->outputs[y * LAYOUT_COLUMNS + x] = output;
+		}
+	}
+	return state;
+}
+
+static void output_at_run(void *data, size_t n) {
+	struct output_at_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		double lx = bench_rand(&state->seed) % (LAYOUT_COLUMNS * 1920);
+		double ly = bench_rand(&state->seed) % (LAYOUT_ROWS * 1080);
+		wlr_output_layout_output_at(state->layout, lx, ly);
+	}
+}
+
+const struct bench bench_output_layout_output_at = {
+	.name = "output_layout_output_at",
+	.workload = "4x4 grid of 1920x1080 outputs, random points",
+	.setup = output_at_setup,
+	.run = output_at_run,
+	.teardown = output_at_teardown,
+};
@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <wlr/render.h>
+#include <wlr/render/matrix.h>
+#include "bench.h"
+
+struct matrix_state {
+	float projection[16];
+	float transform[16];
+	float matrix[16];
+};
+
+static void *matrix_mul_setup(struct bench_context *ctx) {
+	struct matrix_state *state = calloc(1, sizeof(struct matrix_state));
+	if (!state) {
+		return NULL;
+	}
+	wlr_matrix_texture(state->projection, 1920, 1080,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+	wlr_matrix_rotate(&state->transform, 0.1f);
+	wlr_matrix_identity(&state->matrix);
+	return state;
+}
+
+static void matrix_mul_run(void *data, size_t n) {
+	struct matrix_state *state = data;
+	// Same chain as wlr_surface_get_matrix: translate, transform, scale and
+	// project
+	for (size_t i = 0; i < n; ++i) {
+		float translate[16], scale[16];
+		wlr_matrix_translate(&translate, (float)(i & 1023), 64.0f, 0.0f);
+		wlr_matrix_scale(&scale, 256.0f, 256.0f, 1.0f);
+		wlr_matrix_mul(&translate, &state->transform, &state->matrix);
+		wlr_matrix_mul(&state->matrix, &scale, &state->matrix);
+		wlr_matrix_mul(&state->projection, &state->matrix, &state->matrix);
+	}
+}
+
+static void matrix_mul_teardown(void *state) {
+	free(state);
+}
+
+const struct bench bench_matrix_mul = {
+	.name = "matrix_mul",
+	.workload = "surface matrix chain, 3 wlr_matrix_mul per iteration",
+	.setup = matrix_mul_setup,
+	.run = matrix_mul_run,
+	.teardown = matrix_mul_teardown,
+};
+
+#define UPLOAD_WIDTH 1920
+#define UPLOAD_HEIGHT 1080
+#define UPDATE_SIZE 256
+
+struct texture_state {
+	struct wlr_texture *texture;
+	unsigned char *pixels;
+};
+
+static void *texture_setup(struct bench_context *ctx) {
+	struct texture_state *state = calloc(1, sizeof(struct texture_state));
+	if (!state) {
+		return NULL;
+	}
+	state->pixels = malloc(UPLOAD_WIDTH * UPLOAD_HEIGHT * 4);
+	state->texture = wlr_render_texture_create(ctx->renderer);
+	if (!state->pixels || !state->texture) {
+		goto error;
+	}
+	for (size_t i = 0; i < UPLOAD_WIDTH * UPLOAD_HEIGHT * 4; ++i) {
+		state->pixels[i] = i * 31;
+	}
+	if (!wlr_texture_upload_pixels(state->texture, WL_SHM_FORMAT_ARGB8888,
+			UPLOAD_WIDTH, UPLOAD_WIDTH, UPLOAD_HEIGHT, state->pixels)) {
+		goto error;
+	}
+	return state;
+
+error:
+	if (state->texture) {
+		wlr_texture_destroy(state->texture);
+	}
+	free(state->pixels);
+	free(state);
+	return NULL;
+}
+
+static void texture_teardown(void *data) {
+	struct texture_state *state = data;
+	wlr_texture_destroy(state->texture);
+	free(state->pixels);
+	free(state);
+}
+
+static void texture_upload_pixels_run(void *data, size_t n) {
+	struct texture_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		wlr_texture_upload_pixels(state->texture, WL_SHM_FORMAT_ARGB8888,
+			UPLOAD_WIDTH, UPLOAD_WIDTH, UPLOAD_HEIGHT, state->pixels);
+	}
+}
+
+const struct bench bench_texture_upload_pixels = {
+	.name = "texture_upload_pixels",
+	.workload = "full 1920x1080 ARGB8888 texture upload",
+	.setup = texture_setup,
+	.run = texture_upload_pixels_run,
+	.teardown = texture_teardown,
+};
+
+static void texture_update_pixels_run(void *data, size_t n) {
+	struct texture_state *state = data;
+	uint32_t seed = 0xC0FFEE;
+	for (size_t i = 0; i < n; ++i) {
+		int x = bench_rand(&seed) % (UPLOAD_WIDTH - UPDATE_SIZE);
+		int y = bench_rand(&seed) % (UPLOAD_HEIGHT - UPDATE_SIZE);
+		wlr_texture_update_pixels(state->texture, WL_SHM_FORMAT_ARGB8888,
+			UPLOAD_WIDTH, x, y, UPDATE_SIZE, UPDATE_SIZE, state->pixels);
+	}
+}
+
+const struct bench bench_texture_update_pixels = {
+	.name = "texture_update_pixels",
+	.workload = "256x256 sub-rectangle update of a 1920x1080 texture",
+	.setup = texture_setup,
+	.run = texture_update_pixels_run,
+	.teardown = texture_teardown,
+};
+
+#define FRAME_TEXTURES 4
+#define FRAME_QUADS 64
+
+struct frame_state {
+	struct bench_context *ctx;
+	struct wlr_texture *textures[FRAME_TEXTURES];
+};
+
+static void frame_teardown(void *data) {
+	struct frame_state *state = data;
+	for (size_t i = 0; i < FRAME_TEXTURES; ++i) {
+		wlr_texture_destroy(state->textures[i]);
+	}
+	free(state);
+}
+
+static void *frame_setup(struct bench_context *ctx) {
+	struct frame_state *state = calloc(1, sizeof(struct frame_state));
+	if (!state) {
+		return NULL;
+	}
+	state->ctx = ctx;
+	unsigned char pixels[64 * 64 * 4];
+	for (size_t i = 0; i < sizeof(pixels); ++i) {
+		pixels[i] = i * 31;
+	}
+	for (size_t i = 0; i < FRAME_TEXTURES; ++i) {
+		state->textures[i] = wlr_render_texture_create(ctx->renderer);
+		if (!state->textures[i] || !wlr_texture_upload_pixels(
+				state->textures[i], WL_SHM_FORMAT_ARGB8888, 64, 64, 64,
+				pixels)) {
+			frame_teardown(state);
+			return NULL;
+		}
+	}
+	return state;
+}
+
+static void frame_run(void *data, size_t n) {
+	struct frame_state *state = data;
+	struct wlr_output *output = state->ctx->output;
+	const float color[4] = { 0.5f, 0.25f, 0.125f, 0.5f };
+	for (size_t i = 0; i < n; ++i) {
+		wlr_renderer_begin(state->ctx->renderer, output);
+		for (int j = 0; j < FRAME_QUADS; ++j) {
+			float matrix[16];
+			// Popups and decorations alternate with the windows
+			struct wlr_texture *texture =
+				state->textures[j / (FRAME_QUADS / FRAME_TEXTURES)];
+			wlr_texture_get_matrix(texture, &matrix,
+				&output->transform_matrix, j * 24, j * 12);
+			wlr_render_with_matrix(state->ctx->renderer, texture, &matrix);
+			if (j % 2 == 0) {
+				wlr_render_colored_quad(state->ctx->renderer, &color,
+					&matrix);
+			}
+		}
+		wlr_renderer_end(state->ctx->renderer);
+	}
+}
+
+const struct bench bench_render_frame = {
+	.name = "render_frame",
+	.workload = "64 textured quads from 4 textures and 32 colored quads "
+		"per frame",
+	.setup = frame_setup,
+	.run = frame_run,
+	.teardown = frame_teardown,
+};
+
+#define READ_PIXELS_SIZE 256
+
+struct read_pixels_state {
+	struct bench_context *ctx;
+	uint32_t *pixels;
+};
+
+static void *read_pixels_setup(struct bench_context *ctx) {
+	struct read_pixels_state *state =
+		calloc(1, sizeof(struct read_pixels_state));
+	if (!state) {
+		return NULL;
+	}
+	state->ctx = ctx;
+	state->pixels = calloc(READ_PIXELS_SIZE * READ_PIXELS_SIZE,
+		sizeof(uint32_t));
+	if (!state->pixels) {
+		free(state);
+		return NULL;
+	}
+
+	// Something to read back
+	const float color[4] = { 0.5f, 0.25f, 0.125f, 1.0f };
+	float scale[16], matrix[16];
+	wlr_matrix_scale(&scale, READ_PIXELS_SIZE, READ_PIXELS_SIZE, 1.0f);
+	wlr_matrix_mul(&ctx->output->transform_matrix, &scale, &matrix);
+	wlr_renderer_begin(ctx->renderer, ctx->output);
+	wlr_render_colored_quad(ctx->renderer, &color, &matrix);
+	wlr_renderer_end(ctx->renderer);
+	return state;
+}
+
+static void read_pixels_run(void *data, size_t n) {
+	struct read_pixels_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		wlr_renderer_read_pixels(state->ctx->renderer, 0, 0, READ_PIXELS_SIZE,
+			READ_PIXELS_SIZE, state->pixels);
+	}
+}
+
+static void read_pixels_teardown(void *data) {
+	struct read_pixels_state *state = data;
+	free(state->pixels);
+	free(state);
+}
+
+const struct bench bench_read_pixels = {
+	.name = "read_pixels",
+	.workload = "256x256 read back of the output, as done by the screenshooter",
+	.setup = read_pixels_setup,
+	.run = read_pixels_run,
+	.teardown = read_pixels_teardown,
+};
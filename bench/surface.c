@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <wayland-client.h>
+#include <wlr/types/wlr_surface.h>
+#include "bench.h"
+
+#define COMMIT_SURFACES 64
+#define COMMIT_SIZE 256
+#define COMMIT_DAMAGE_RECTS 16
+#define TRANSFORMED_DAMAGE_RECTS 64
+#define SUBSURFACE_CHILDREN 8
+#define SUBSURFACE_GRANDCHILDREN 4
+
+struct bench_surface {
+	struct wl_surface *surface;
+	struct wl_subsurface *subsurface;
+	struct wl_buffer *buffer;
+};
+
+struct commit_state {
+	struct bench_client *client;
+	struct bench_surface *surfaces;
+	size_t surfaces_len;
+	size_t damage_rects;
+	uint32_t seed;
+	size_t next;
+};
+
+static bool surface_init(struct commit_state *state, struct bench_surface *s,
+		struct wl_surface *parent) {
+	struct bench_client *client = state->client;
+	s->surface = wl_compositor_create_surface(client->compositor);
+	s->buffer = bench_client_create_buffer(client, COMMIT_SIZE, COMMIT_SIZE);
+	if (!s->surface || !s->buffer) {
+		return false;
+	}
+	if (parent) {
+		s->subsurface = wl_subcompositor_get_subsurface(client->subcompositor,
+			s->surface, parent);
+		wl_subsurface_set_position(s->subsurface, COMMIT_SIZE / 4,
+			COMMIT_SIZE / 4);
+	}
+	bench_client_sync(client);
+	return true;
+}
+
+static void surface_damage(struct commit_state *state,
+		struct bench_surface *s) {
+	for (size_t i = 0; i < state->damage_rects; ++i) {
+		int x = bench_rand(&state->seed) % COMMIT_SIZE;
+		int y = bench_rand(&state->seed) % COMMIT_SIZE;
+		int w = 1 + bench_rand(&state->seed) % 32;
+		int h = 1 + bench_rand(&state->seed) % 32;
+		wl_surface_damage(s->surface, x, y, w, h);
+	}
+}
+
+static void surface_commit(struct commit_state *state,
+		struct bench_surface *s) {
+	wl_surface_attach(s->surface, s->buffer, 0, 0);
+	surface_damage(state, s);
+	wl_surface_commit(s->surface);
+}
+
+static struct commit_state *commit_state_create(struct bench_context *ctx,
+		size_t surfaces_len, size_t damage_rects) {
+	struct commit_state *state = calloc(1, sizeof(struct commit_state));
+	if (!state) {
+		return NULL;
+	}
+	state->surfaces = calloc(surfaces_len, sizeof(struct bench_surface));
+	state->client = bench_client_create(ctx);
+	if (!state->surfaces || !state->client) {
+		bench_client_destroy(state->client);
+		free(state->surfaces);
+		free(state);
+		return NULL;
+	}
+	state->surfaces_len = surfaces_len;
+	state->damage_rects = damage_rects;
+	state->seed = 0xC0FFEE;
+	return state;
+}
+
+static void commit_teardown(void *data) {
+	struct commit_state *state = data;
+	for (size_t i = 0; i < state->surfaces_len; ++i) {
+		struct bench_surface *s = &state->surfaces[i];
+		if (s->subsurface) {
+			wl_subsurface_destroy(s->subsurface);
+		}
+		if (s->buffer) {
+			wl_buffer_destroy(s->buffer);
+		}
+		if (s->surface) {
+			wl_surface_destroy(s->surface);
+		}
+	}
+	bench_client_sync(state->client);
+	bench_client_destroy(state->client);
+	free(state->surfaces);
+	free(state);
+}
+
+static void *commit_setup_with(struct bench_context *ctx, size_t damage_rects,
+		int32_t scale, enum wl_output_transform transform) {
+	struct commit_state *state =
+		commit_state_create(ctx, COMMIT_SURFACES, damage_rects);
+	if (!state) {
+		return NULL;
+	}
+	for (size_t i = 0; i < state->surfaces_len; ++i) {
+		struct bench_surface *s = &state->surfaces[i];
+		if (!surface_init(state, s, NULL)) {
+			commit_teardown(state);
+			return NULL;
+		}
+		wl_surface_set_buffer_scale(s->surface, scale);
+		wl_surface_set_buffer_transform(s->surface, transform);
+		// The first commit allocates the texture, later ones only update it
+		surface_commit(state, s);
+		bench_client_sync(state->client);
+	}
+	return state;
+}
+
+static void commit_run(void *data, size_t n) {
+	struct commit_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		surface_commit(state, &state->surfaces[state->next]);
+		state->next = (state->next + 1) % state->surfaces_len;
+		bench_client_sync(state->client);
+	}
+}
+
+static void *commit_setup(struct bench_context *ctx) {
+	return commit_setup_with(ctx, COMMIT_DAMAGE_RECTS, 1,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+}
+
+const struct bench bench_surface_commit = {
+	.name = "surface_commit",
+	.workload = "64 surfaces 256x256, attach + 16 damage rects + commit",
+	.setup = commit_setup,
+	.run = commit_run,
+	.teardown = commit_teardown,
+};
+
+static void *commit_transformed_setup(struct bench_context *ctx) {
+	// Surface damage goes through wlr_surface_to_buffer_region
+	return commit_setup_with(ctx, TRANSFORMED_DAMAGE_RECTS, 2,
+		WL_OUTPUT_TRANSFORM_90);
+}
+
+const struct bench bench_surface_commit_transformed = {
+	.name = "surface_commit_transformed",
+	.workload = "64 surfaces 256x256, scale 2, transform 90, "
+		"attach + 64 damage rects + commit",
+	.setup = commit_transformed_setup,
+	.run = commit_run,
+	.teardown = commit_teardown,
+};
+
+static void *commit_subsurfaces_setup(struct bench_context *ctx) {
+	size_t len = 1 + SUBSURFACE_CHILDREN +
+		SUBSURFACE_CHILDREN * SUBSURFACE_GRANDCHILDREN;
+	struct commit_state *state =
+		commit_state_create(ctx, len, COMMIT_DAMAGE_RECTS);
+	if (!state) {
+		return NULL;
+	}
+
+	struct bench_surface *root = &state->surfaces[0];
+	size_t k = 1;
+	bool ok = surface_init(state, root, NULL);
+	for (size_t i = 0; ok && i < SUBSURFACE_CHILDREN; ++i) {
+		struct bench_surface *child = &state->surfaces[k++];
+		ok = surface_init(state, child, root->surface);
+		for (size_t j = 0; ok && j < SUBSURFACE_GRANDCHILDREN; ++j) {
+			ok = surface_init(state, &state->surfaces[k++], child->surface);
+		}
+	}
+	if (!ok) {
+		commit_teardown(state);
+		return NULL;
+	}
+
+	// Subsurfaces are synchronized by default, the root commit applies
+	// the whole tree
+	for (size_t i = 0; i < state->surfaces_len; ++i) {
+		surface_commit(state, &state->surfaces[len - 1 - i]);
+		bench_client_sync(state->client);
+	}
+	return state;
+}
+
+static void commit_subsurfaces_run(void *data, size_t n) {
+	struct commit_state *state = data;
+	for (size_t i = 0; i < n; ++i) {
+		// Children first, so that their state is cached until the root
+		// commits
+		for (size_t j = 0; j < state->surfaces_len; ++j) {
+			surface_commit(state,
+				&state->surfaces[state->surfaces_len - 1 - j]);
+			if (j % 8 == 7) {
+				// Keep the client buffer from filling up
+				bench_client_sync(state->client);
+			}
+		}
+		bench_client_sync(state->client);
+	}
+}
+
+const struct bench bench_surface_commit_subsurfaces = {
+	.name = "surface_commit_subsurfaces",
+	.workload = "tree of 1 + 8 + 32 synchronized 256x256 surfaces, "
+		"attach + 16 damage rects + commit on each",
+	.setup = commit_subsurfaces_setup,
+	.run = commit_subsurfaces_run,
+	.teardown = commit_teardown,
+};
@@ -20,6 +20,15 @@
 #include "properties.h"
 #include "renderer.h"
 
+/**
+ * A client buffer directly scanned out. The wl_buffer is locked so that the
+ * client doesn't draw into it while it is on screen.
+ */
+struct wlr_drm_scanout {
+	struct gbm_bo *bo;
+	struct wlr_buffer_lock *lock;
+};
+
 struct wlr_drm_plane {
 	uint32_t type;
 	uint32_t id;
@@ -29,6 +38,18 @@ struct wlr_drm_plane {
 	struct wlr_drm_surface surf;
 	struct wlr_drm_surface mgpu_surf;
 
+	// Only used by primary and overlay, client buffers being directly scanned
+	// out. The previous one stays on screen until the pending pageflip
+	// completes.
+	struct wlr_drm_scanout scanout, scanout_prev;
+
+	// Only used by overlay, the client buffer to display with the next
+	// pageflip
+	struct wlr_drm_scanout pending;
+	// Only used by overlay planes realloc_planes didn't assign to any CRTC,
+	// the CRTC displaying a buffer on it
+	struct wlr_drm_crtc *overlay_crtc;
+
 	// Only used by cursor
 	float matrix[16];
 	struct wlr_texture *wlr_tex;
@@ -38,10 +59,15 @@ struct wlr_drm_plane {
 	union wlr_drm_plane_props props;
 };
 
+struct wlr_drm_connector;
+
 struct wlr_drm_crtc {
 	uint32_t id;
 	uint32_t mode_id; // atomic modesetting only
 	drmModeAtomicReq *atomic;
+	// Atomic modesetting only, the connector whose pageflip is waiting to be
+	// committed with the others, see atomic_batch
+	struct wlr_drm_connector *pending_flip;
 
 	union {
 		struct {
@@ -91,6 +117,15 @@ struct wlr_drm_backend {
 	struct wl_display *display;
 	struct wl_event_source *drm_event;
 
+	// Atomic modesetting only: pageflips are queued and committed together,
+	// in a single ioctl, once the event loop is idle. Requires the kernel to
+	// report which CRTC each pageflip event belongs to.
+	bool atomic_batch;
+	struct wl_event_source *atomic_commit_idle;
+
+	// Swapchain depth of the primary planes, see WLR_DRM_SWAPCHAIN_DEPTH
+	size_t swapchain_depth;
+
 	struct wl_listener session_signal;
 	struct wl_listener drm_invalidated;
 
@@ -130,6 +165,10 @@ struct wlr_drm_connector {
 
 	bool pageflip_pending;
 	struct wl_event_source *retry_pageflip;
+	// Frame event sent before the pageflip completes, because the swapchain
+	// had room for another buffer
+	struct wl_event_source *early_frame;
+	bool early_frame_sent;
 	struct wl_list link;
 };
 
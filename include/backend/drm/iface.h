@@ -11,6 +11,7 @@
 struct wlr_drm_backend;
 struct wlr_drm_connector;
 struct wlr_drm_crtc;
+struct wlr_drm_plane;
 
 // Used to provide atomic or legacy DRM functions
 struct wlr_drm_interface {
@@ -21,12 +22,27 @@ struct wlr_drm_interface {
 	bool (*crtc_pageflip)(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
 		uint32_t fb_id, drmModeModeInfo *mode);
+	// Check whether a pageflip to fb_id would succeed, without performing it.
+	// Optional, only atomic modesetting supports this.
+	bool (*crtc_test_pageflip)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id);
+	// Display bo on the overlay plane on crtc at the given position with the
+	// next pageflip. Set bo to NULL to disable. Returns false if the
+	// configuration is rejected. Optional, only atomic modesetting supports
+	// this.
+	bool (*crtc_set_overlay)(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, struct wlr_drm_plane *plane,
+		struct gbm_bo *bo, int x, int y);
 	// Enable the cursor buffer on crtc. Set bo to NULL to disable
 	bool (*crtc_set_cursor)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, struct gbm_bo *bo);
 	// Move the cursor on crtc
 	bool (*crtc_move_cursor)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, int x, int y);
+	// Commit the pageflips which crtc_pageflip queued instead of committing
+	// them right away. Optional.
+	void (*flush)(struct wlr_drm_backend *drm);
 };
 
 extern const struct wlr_drm_interface atomic_iface;
@@ -20,6 +20,9 @@ struct wlr_drm_renderer {
 	struct wlr_renderer *wlr_rend;
 };
 
+// GBM surfaces in Mesa have 4 buffers
+#define WLR_DRM_SURFACE_MAX_DEPTH 4
+
 struct wlr_drm_surface {
 	struct wlr_drm_renderer *renderer;
 
@@ -29,8 +32,15 @@ struct wlr_drm_surface {
 	struct gbm_surface *gbm;
 	EGLSurface egl;
 
-	struct gbm_bo *front;
-	struct gbm_bo *back;
+	// Maximum number of buffers locked at once: 2 for double buffering, 3 to
+	// let rendering get one frame ahead of the display
+	size_t depth;
+	// Locked buffers, oldest first: the one on screen, then the ones
+	// submitted for a pageflip, then the `queued` ones which are still
+	// waiting for a pageflip to be submitted
+	struct gbm_bo *bufs[WLR_DRM_SURFACE_MAX_DEPTH];
+	size_t bufs_len;
+	size_t queued;
 };
 
 bool wlr_drm_renderer_init(struct wlr_drm_backend *drm,
@@ -45,8 +55,12 @@ bool wlr_drm_plane_surfaces_init(struct wlr_drm_plane *plane, struct wlr_drm_bac
 		int32_t width, uint32_t height, uint32_t format);
 
 void wlr_drm_surface_finish(struct wlr_drm_surface *surf);
-void wlr_drm_surface_make_current(struct wlr_drm_surface *surf);
+bool wlr_drm_surface_make_current(struct wlr_drm_surface *surf,
+	int *buffer_age);
 struct gbm_bo *wlr_drm_surface_swap_buffers(struct wlr_drm_surface *surf);
+bool wlr_drm_surface_can_render(struct wlr_drm_surface *surf);
+void wlr_drm_surface_queue_back(struct wlr_drm_surface *surf);
+struct gbm_bo *wlr_drm_surface_pop_queued(struct wlr_drm_surface *surf);
 struct gbm_bo *wlr_drm_surface_get_front(struct wlr_drm_surface *surf);
 void wlr_drm_surface_post(struct wlr_drm_surface *surf);
 struct gbm_bo *wlr_drm_surface_mgpu_copy(struct wlr_drm_surface *dest, struct gbm_bo *src);
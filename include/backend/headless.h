@@ -0,0 +1,38 @@
+#ifndef BACKEND_HEADLESS_H
+#define BACKEND_HEADLESS_H
+
+#include <stdbool.h>
+#include <EGL/egl.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/egl.h>
+#include <wlr/types/wlr_output.h>
+
+#define HEADLESS_DEFAULT_REFRESH (60 * 1000) // 60 Hz
+
+struct wlr_headless_backend {
+	struct wlr_backend backend;
+	struct wl_display *display;
+	struct wl_list outputs;
+	struct wlr_egl egl;
+	bool pixman; // render into pixman images instead of EGL pbuffers
+	bool started;
+};
+
+struct wlr_headless_output {
+	struct wlr_output wlr_output;
+
+	struct wlr_headless_backend *backend;
+	EGLSurface egl_surface;
+	pixman_image_t *image; // if the backend renders with pixman
+	bool image_has_frame; // the image holds the previous frame
+	struct wl_event_source *frame_timer;
+	int frame_delay; // ms
+	struct wl_list link;
+	bool started; // announced with output_add
+};
+
+void wlr_headless_output_start(struct wlr_headless_output *output);
+
+#endif
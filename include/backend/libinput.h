@@ -1,11 +1,14 @@
 #ifndef BACKEND_LIBINPUT_H
 #define BACKEND_LIBINPUT_H
 #include <libinput.h>
+#include <stddef.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/backend/interface.h>
 #include <wlr/interfaces/wlr_input_device.h>
+#include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_list.h>
+#include <wlr/types/wlr_pointer.h>
 
 struct wlr_libinput_backend {
 	struct wlr_backend backend;
@@ -19,6 +22,9 @@ struct wlr_libinput_backend {
 	struct wl_listener session_signal;
 
 	struct wlr_list *wlr_device_lists;
+
+	// NULL unless events are read on a dedicated thread, see thread.c
+	struct wlr_libinput_thread *thread;
 };
 
 struct wlr_libinput_input_device {
@@ -30,14 +36,28 @@ struct wlr_libinput_input_device {
 void wlr_libinput_event(struct wlr_libinput_backend *state,
 		struct libinput_event *event);
 
+bool wlr_libinput_thread_start(struct wlr_libinput_backend *backend);
+void wlr_libinput_thread_stop(struct wlr_libinput_backend *backend);
+/**
+ * The libinput context is not thread-safe: while the input thread runs, the
+ * main thread must hold this lock around any libinput call. The lock is
+ * recursive and is a no-op when there is no input thread.
+ */
+void wlr_libinput_lock(struct wlr_libinput_backend *backend);
+void wlr_libinput_unlock(struct wlr_libinput_backend *backend);
+
 struct wlr_input_device *get_appropriate_device(
 		enum wlr_input_device_type desired_type,
 		struct libinput_device *device);
 
 struct wlr_keyboard *wlr_libinput_keyboard_create(
-		struct libinput_device *device);
+		struct wlr_libinput_backend *backend, struct libinput_device *device);
 void handle_keyboard_key(struct libinput_event *event,
 		struct libinput_device *device);
+void translate_keyboard_key(struct libinput_event *event,
+		struct wlr_event_keyboard_key *wlr_event);
+void emit_keyboard_key(struct libinput_device *device,
+		struct wlr_event_keyboard_key *wlr_event);
 
 struct wlr_pointer *wlr_libinput_pointer_create(
 		struct libinput_device *device);
@@ -49,6 +69,26 @@ void handle_pointer_button(struct libinput_event *event,
 		struct libinput_device *device);
 void handle_pointer_axis(struct libinput_event *event,
 		struct libinput_device *device);
+void translate_pointer_motion(struct libinput_event *event,
+		struct wlr_event_pointer_motion *wlr_event);
+void emit_pointer_motion(struct libinput_device *device,
+		struct wlr_event_pointer_motion *wlr_event);
+void translate_pointer_motion_abs(struct libinput_event *event,
+		struct wlr_event_pointer_motion_absolute *wlr_event);
+void emit_pointer_motion_abs(struct libinput_device *device,
+		struct wlr_event_pointer_motion_absolute *wlr_event);
+void translate_pointer_button(struct libinput_event *event,
+		struct wlr_event_pointer_button *wlr_event);
+void emit_pointer_button(struct libinput_device *device,
+		struct wlr_event_pointer_button *wlr_event);
+/**
+ * Fills one event per scroll axis present in the libinput event and returns
+ * how many were filled.
+ */
+size_t translate_pointer_axis(struct libinput_event *event,
+		struct wlr_event_pointer_axis wlr_events[static 2]);
+void emit_pointer_axis(struct libinput_device *device,
+		struct wlr_event_pointer_axis *wlr_event);
 
 struct wlr_touch *wlr_libinput_touch_create(
 		struct libinput_device *device);
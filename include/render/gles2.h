@@ -20,13 +20,45 @@ struct pixel_format {
 	uint32_t wl_format;
 	GLint gl_format, gl_type;
 	int depth, bpp;
+	bool has_alpha;
 	GLuint *shader;
 };
 
+struct gles2_vertex {
+	GLfloat x, y; // clip space
+	GLfloat s, t;
+	GLfloat r, g, b, a;
+};
+
+// Maximum number of quads drawn by a single call
+#define GLES2_BATCH_QUADS 1024
+
 struct wlr_gles2_renderer {
 	struct wlr_renderer wlr_renderer;
 
 	struct wlr_egl *egl;
+
+	// Consecutive quads using the same program, texture and blending are
+	// queued and drawn together from a persistent vertex buffer
+	struct {
+		GLuint vbo, ibo;
+		GLuint program;
+		GLenum target;
+		GLuint tex_id;
+		bool blend;
+		size_t len; // queued quads
+		struct gles2_vertex vertices[GLES2_BATCH_QUADS * 4];
+	} batch;
+
+	// GL state set by the renderer, only trusted between begin and end
+	struct {
+		bool valid;
+		GLuint program;
+		GLenum target;
+		GLuint tex_id;
+		bool blend;
+	} bound;
+	bool in_frame;
 };
 
 struct wlr_gles2_texture {
@@ -34,6 +66,7 @@ struct wlr_gles2_texture {
 
 	struct wlr_egl *egl;
 	GLuint tex_id;
+	GLenum target;
 	const struct pixel_format *pixel_format;
 	EGLImageKHR image;
 };
@@ -52,7 +85,6 @@ const struct pixel_format *gl_format_for_wl_format(enum wl_shm_format fmt);
 
 struct wlr_texture *gles2_texture_create();
 
-extern const GLchar quad_vertex_src[];
 extern const GLchar quad_fragment_src[];
 extern const GLchar ellipse_fragment_src[];
 extern const GLchar vertex_src[];
@@ -0,0 +1,37 @@
+#ifndef RENDER_PIXMAN_H
+#define RENDER_PIXMAN_H
+
+#include <stdbool.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wlr/render.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+
+struct wlr_pixman_renderer {
+	struct wlr_renderer wlr_renderer;
+
+	pixman_region32_t damage; // image coordinates
+};
+
+struct wlr_pixman_texture {
+	struct wlr_texture wlr_texture;
+
+	pixman_image_t *image;
+
+	// set if the image wraps the memory of a wl_shm buffer
+	struct wl_resource *buffer;
+	struct wl_listener buffer_destroy;
+};
+
+pixman_format_code_t pixman_format_for_wl_format(enum wl_shm_format fmt);
+
+struct wlr_texture *pixman_texture_create(void);
+/**
+ * Returns the texture image, ready to be sampled, or NULL. Must be paired
+ * with pixman_texture_end_access.
+ */
+pixman_image_t *pixman_texture_begin_access(struct wlr_pixman_texture *texture);
+void pixman_texture_end_access(struct wlr_pixman_texture *texture);
+
+#endif
@@ -13,6 +13,7 @@ struct output_config {
 		int width, height;
 		float refresh_rate;
 	} mode;
+	int frame_margin; // ms, see wlr_output_set_frame_margin
 };
 
 struct device_config {
@@ -43,10 +44,13 @@ struct keyboard_config {
 
 struct roots_config {
 	bool xwayland;
+	bool xwayland_lazy;
+	int xwayland_idle_timeout; // seconds
 	// TODO: Multiple cursors, multiseat
 	struct {
 		char *mapped_output;
 		struct wlr_box *mapped_box;
+		bool coalesce_motion;
 	} cursor;
 
 	struct wl_list outputs;
@@ -1,6 +1,7 @@
 #ifndef _ROOTSTON_DESKTOP_H
 #define _ROOTSTON_DESKTOP_H
 #include <time.h>
+#include <pixman.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
@@ -9,20 +10,55 @@
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/types/wlr_gamma_control.h>
 #include <wlr/types/wlr_screenshooter.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
 #include <wlr/types/wlr_list.h>
 #include "rootston/view.h"
 #include "rootston/config.h"
 
+#define ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN 2
+
 struct roots_output {
 	struct roots_desktop *desktop;
 	struct wlr_output *wlr_output;
 	struct wl_listener frame;
+	struct wl_listener resolution;
 	struct timespec last_frame;
+	pixman_region32_t damage; // output-local coordinates
+	// Damage of the last frames, used with the buffer age
+	pixman_region32_t previous_damage[ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN];
+	size_t previous_damage_idx;
+	bool scanned_out; // the last frame wasn't rendered, see get_scanout_surface
+	pixman_region32_t overlay; // area covered by overlay planes, output-local
+	// Surfaces drawn by the current frame, reused between frames
+	struct render_item *render_items;
+	size_t render_items_len, render_items_cap;
 	struct wl_list link;
 };
 
+/**
+ * Uniform grid over the layout, each cell lists the views which may cover it
+ * from top to bottom. Views with popups can't be bounded cheaply and are
+ * listed in every cell.
+ */
+struct roots_view_index {
+	bool valid;
+	struct wlr_box extents; // of the bounded views, in layout coordinates
+	int cell_width, cell_height;
+	int columns, rows;
+	// Views of cell i are views[cells[i]] to views[cells[i + 1]], the last
+	// cell is for points outside of the extents
+	size_t *cells;
+	size_t cells_cap;
+	struct roots_view **views;
+	size_t views_cap;
+
+	// Last view hit by view_at, if it only has a main surface
+	struct roots_view *last_view;
+};
+
 struct roots_desktop {
 	struct wlr_list *views;
+	struct roots_view_index view_index;
 
 	struct wl_list outputs;
 	struct timespec last_frame;
@@ -38,9 +74,12 @@ struct roots_desktop {
 	struct wlr_gamma_control_manager *gamma_control_manager;
 	struct wlr_screenshooter *screenshooter;
 	struct wlr_server_decoration_manager *server_decoration_manager;
+	struct wlr_linux_dmabuf *linux_dmabuf; // NULL if EGL can't import dmabufs
 
 	struct wl_listener output_add;
 	struct wl_listener output_remove;
+	struct wl_listener layout_change;
+	struct wl_listener create_surface;
 	struct wl_listener xdg_shell_v6_surface;
 	struct wl_listener wl_shell_surface;
 	struct wl_listener decoration_new;
@@ -52,6 +91,7 @@ struct roots_desktop {
 };
 
 struct roots_server;
+struct roots_drag_icon;
 
 struct roots_desktop *desktop_create(struct roots_server *server,
 		struct roots_config *config);
@@ -60,11 +100,33 @@ void desktop_destroy(struct roots_desktop *desktop);
 void view_destroy(struct roots_view *view);
 struct roots_view *view_at(struct roots_desktop *desktop, double lx, double ly,
 		struct wlr_surface **surface, double *sx, double *sy);
+/**
+ * Marks the spatial index used by view_at as outdated. This is needed whenever
+ * a view is moved, rotated, restacked, mapped or unmapped, or when one of its
+ * surfaces commits. Damaging the whole view does it too.
+ */
+void desktop_invalidate_view_index(struct roots_desktop *desktop);
+void desktop_finish_view_index(struct roots_desktop *desktop);
 void view_activate(struct roots_view *view, bool activate);
+void view_damage_whole(struct roots_view *view);
+void desktop_damage_whole(struct roots_desktop *desktop);
 
 void output_add_notify(struct wl_listener *listener, void *data);
 void output_remove_notify(struct wl_listener *listener, void *data);
 
+void output_damage_whole(struct roots_output *output);
+void output_damage_whole_view(struct roots_output *output,
+		struct roots_view *view);
+void output_damage_whole_drag_icon(struct roots_output *output,
+		struct roots_drag_icon *icon);
+/**
+ * Damages the parts of the output covered by the surface damage of the given
+ * surface and of its subsurfaces. The surface can belong to any view or drag
+ * icon.
+ */
+void output_damage_from_surface(struct roots_output *output,
+		struct wlr_surface *surface);
+
 void handle_xdg_shell_v6_surface(struct wl_listener *listener, void *data);
 void handle_wl_shell_surface(struct wl_listener *listener, void *data);
 void handle_xwayland_surface(struct wl_listener *listener, void *data);
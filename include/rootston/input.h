@@ -66,11 +66,13 @@ struct roots_input_event {
 };
 
 struct roots_drag_icon {
+	struct roots_input *input;
 	struct wlr_surface *surface;
 	struct wl_list link; // roots_input::drag_icons
 
 	int32_t sx;
 	int32_t sy;
+	double x, y; // layout coordinates of the last rendered position
 
 	struct wl_listener surface_destroy;
 	struct wl_listener surface_commit;
@@ -18,6 +18,15 @@ struct wlr_backend {
 	} events;
 };
 
+/**
+ * Creates the backend best suited to the environment. If WLR_HEADLESS_OUTPUTS
+ * is set, a headless backend is created instead. Its value is either a number
+ * of 1280x720 outputs, or a comma-separated list of outputs of the form
+ * <width>x<height>[@<refresh>], with the refresh rate in Hz, e.g.
+ * "1920x1080@60,800x600@30.5". Outputs are refreshed at 60 Hz by default.
+ * If WLR_HEADLESS_PIXMAN is set as well, the headless backend doesn't use EGL
+ * and wlr_backend_get_egl returns NULL: render with a pixman renderer.
+ */
 struct wlr_backend *wlr_backend_autocreate(struct wl_display *display);
 bool wlr_backend_start(struct wlr_backend *backend);
 void wlr_backend_destroy(struct wlr_backend *backend);
@@ -0,0 +1,32 @@
+#ifndef WLR_BACKEND_HEADLESS_H
+#define WLR_BACKEND_HEADLESS_H
+
+#include <stdbool.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_output.h>
+
+/**
+ * Creates a headless backend. A headless backend has no outputs or inputs by
+ * default. Rendering is done offscreen with a surfaceless EGL display.
+ */
+struct wlr_backend *wlr_headless_backend_create(struct wl_display *display);
+/**
+ * Creates a headless backend which doesn't use EGL, for machines without a GPU.
+ * Its outputs render into pixman images and must be drawn with a pixman
+ * renderer, see wlr_pixman_renderer_create.
+ */
+struct wlr_backend *wlr_headless_backend_create_pixman(
+	struct wl_display *display);
+/**
+ * Adds a virtual output of the given size to this backend. `refresh` is in mHz
+ * and paces the frame events, the default refresh rate is used if it's <= 0.
+ */
+struct wlr_output *wlr_headless_add_output(struct wlr_backend *backend,
+	unsigned int width, unsigned int height, int32_t refresh);
+/**
+ * True if the given backend is a headless backend.
+ */
+bool wlr_backend_is_headless(struct wlr_backend *backend);
+
+#endif
@@ -9,6 +9,11 @@
 
 struct wlr_backend *wlr_libinput_backend_create(struct wl_display *display,
 		struct wlr_session *session);
+/**
+ * Gets the libinput device backing a wlr input device. When libinput events
+ * are read on a dedicated thread (WLR_LIBINPUT_THREAD=1), the device may only
+ * be configured from input_add handlers.
+ */
 struct libinput_device *wlr_libinput_get_device_handle(struct wlr_input_device *dev);
 
 bool wlr_backend_is_libinput(struct wlr_backend *backend);
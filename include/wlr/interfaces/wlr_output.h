@@ -15,8 +15,12 @@ struct wlr_output_impl {
 		int32_t hotspot_x, int32_t hotspot_y, bool update_pixels);
 	bool (*move_cursor)(struct wlr_output *output, int x, int y);
 	void (*destroy)(struct wlr_output *output);
-	void (*make_current)(struct wlr_output *output);
+	bool (*make_current)(struct wlr_output *output, int *buffer_age);
 	void (*swap_buffers)(struct wlr_output *output);
+	bool (*scanout_surface)(struct wlr_output *output,
+		struct wlr_surface *surface);
+	bool (*attach_overlay)(struct wlr_output *output,
+		struct wlr_surface *surface, int x, int y);
 	void (*set_gamma)(struct wlr_output *output,
 		uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b);
 	uint32_t (*get_gamma_size)(struct wlr_output *output);
@@ -30,5 +34,25 @@ void wlr_output_update_size(struct wlr_output *output, int32_t width,
 struct wl_global *wlr_output_create_global(struct wlr_output *wlr_output,
 	struct wl_display *display);
 void wlr_output_destroy_global(struct wlr_output *wlr_output);
+/**
+ * Sends the frame event. Pending hardware cursor moves are applied first.
+ * Backends which stage cursor changes until the next page flip instead of
+ * applying them right away must set `needs_swap` and call
+ * wlr_output_schedule_frame whenever they do, so that compositors which skip
+ * frames with nothing to repaint still swap buffers.
+ */
+void wlr_output_send_frame(struct wlr_output *output);
+/**
+ * Marks the whole output as damaged, e.g. because the backend lost its
+ * contents, and makes sure the next frame is swapped.
+ */
+void wlr_output_damage_whole(struct wlr_output *output);
+/**
+ * Notifies the output that a buffer has been displayed at `when`, which must
+ * use CLOCK_MONOTONIC. Sends the frame event right away, or a bit before the
+ * next vblank if frame scheduling is enabled.
+ */
+void wlr_output_handle_vblank(struct wlr_output *output,
+	const struct timespec *when);
 
 #endif
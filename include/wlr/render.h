@@ -5,13 +5,30 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <wayland-server-protocol.h>
+#include <pixman.h>
 #include <wlr/types/wlr_output.h>
 
 struct wlr_texture;
 struct wlr_renderer;
+struct wlr_box;
 
 void wlr_renderer_begin(struct wlr_renderer *r, struct wlr_output *output);
+/**
+ * Begins rendering to the output, but only clears the given damage region, in
+ * output-local coordinates. The rest of the back buffer is left untouched and
+ * rendering is restricted to the extents of the damage. Use this with the
+ * buffer age to only repaint what changed since the back buffer was last
+ * displayed. Passing NULL is equivalent to wlr_renderer_begin.
+ */
+void wlr_renderer_begin_with_damage(struct wlr_renderer *r,
+	struct wlr_output *output, pixman_region32_t *damage);
 void wlr_renderer_end(struct wlr_renderer *r);
+/**
+ * Restricts rendering to the given box, in framebuffer coordinates (that is,
+ * after the output projection matrix has been applied). Passing NULL disables
+ * scissoring.
+ */
+void wlr_renderer_scissor(struct wlr_renderer *r, struct wlr_box *box);
 /**
  * Requests a texture handle from this renderer.
  */
@@ -31,6 +48,13 @@ struct wlr_texture *wlr_render_texture_create(struct wlr_renderer *r);
  */
 bool wlr_render_with_matrix(struct wlr_renderer *r,
 	struct wlr_texture *texture, const float (*matrix)[16]);
+/**
+ * Same as wlr_render_with_matrix, but the caller guarantees that the part of
+ * the texture drawn inside the current scissor box is fully opaque, so that it
+ * can replace what is below instead of being blended with it.
+ */
+bool wlr_render_with_matrix_opaque(struct wlr_renderer *r,
+	struct wlr_texture *texture, const float (*matrix)[16]);
 /**
  * Renders a solid quad in the specified color.
  */
@@ -68,9 +92,16 @@ struct wlr_texture {
 
 	bool valid;
 	uint32_t format;
+	// false if all the pixels are opaque, e.g. for XRGB8888 buffers
+	bool has_alpha;
+	// true if the first row of the buffer is the bottom one
+	bool inverted_y;
 	int width, height;
 	struct wl_signal destroy_signal;
 	struct wl_resource *resource;
+
+	// bytes read from the buffer by the last shm upload or update
+	size_t upload_bytes;
 };
 
 /**
@@ -107,13 +138,34 @@ bool wlr_texture_upload_eglimage(struct wlr_texture *tex,
 	EGLImageKHR image, uint32_t width, uint32_t height);
 
 /**
- * Copies a rectangle of pixels from a wl_shm_buffer onto the texture. The
- * buffer is not accessed after this function returns. Under some circumstances,
- * this function may re-upload the entire buffer - therefore, the entire buffer
- * must be valid.
+ * Attaches the contents from the given linux-dmabuf wl_buffer resource onto
+ * the texture without copying. The dmabuf stays in use until the texture is
+ * destroyed or another buffer is uploaded.
+ */
+bool wlr_texture_upload_dmabuf(struct wlr_texture *tex,
+	struct wl_resource *dmabuf_resource);
+
+/**
+ * Copies the damaged region of a wl_shm_buffer onto the texture. The damage is
+ * in buffer coordinates. Rectangles may be merged when uploading their
+ * bounding box is cheaper than uploading them separately. The buffer is not
+ * accessed after this function returns. Under some circumstances, this
+ * function may re-upload the entire buffer - therefore, the entire buffer must
+ * be valid.
  */
 bool wlr_texture_update_shm(struct wlr_texture *surf, uint32_t format,
-		int x, int y, int width, int height, struct wl_shm_buffer *shm);
+		pixman_region32_t *damage, struct wl_shm_buffer *shm);
+/**
+ * Makes the texture sample the given wl_shm buffer directly instead of copying
+ * it. The buffer must not be released while the texture uses it. Returns false
+ * if the renderer can't do that, in which case the buffer has to be uploaded
+ * with wlr_texture_upload_shm.
+ *
+ * Passing NULL drops the imported buffer, which must be done before it is
+ * released. The texture is invalid afterwards.
+ */
+bool wlr_texture_import_shm(struct wlr_texture *tex,
+	struct wl_resource *shm_buffer);
 /**
  * Prepares a matrix with the appropriate scale for the given texture and
  * multiplies it with the projection, producing a matrix that the shader can
@@ -4,6 +4,11 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <stdbool.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
 
 struct wlr_egl {
 	EGLDisplay display;
@@ -12,6 +17,10 @@ struct wlr_egl {
 
 	const char *egl_exts;
 	const char *gl_exts;
+	bool has_buffer_age; // EGL_EXT_buffer_age
+	bool has_surfaceless_context; // EGL_KHR_surfaceless_context
+	bool has_dmabuf_import; // EGL_EXT_image_dma_buf_import
+	bool has_dmabuf_import_modifiers; // EGL_EXT_image_dma_buf_import_modifiers
 
 	struct wl_display *wl_display;
 };
@@ -47,12 +56,54 @@ bool wlr_egl_query_buffer(struct wlr_egl *egl, struct wl_resource *buf,
  */
 EGLSurface wlr_egl_create_surface(struct wlr_egl *egl, void *window);
 
+/**
+ * Returns an offscreen pbuffer surface of the given size. Mostly useful with
+ * EGL_PLATFORM_SURFACELESS_MESA, which has no native windows.
+ */
+EGLSurface wlr_egl_create_pbuffer_surface(struct wlr_egl *egl, int width,
+	int height);
+
+/**
+ * Makes the given surface and the context current. If `buffer_age` is not
+ * NULL, it is set to the age of the surface's back buffer as defined by
+ * EGL_EXT_buffer_age, or -1 if the extension is not supported. An age of 0
+ * means that the contents of the back buffer are undefined.
+ */
+bool wlr_egl_make_current(struct wlr_egl *egl, EGLSurface surface,
+	int *buffer_age);
+
 /**
  * Creates an egl image from the given client buffer and attributes.
  */
 EGLImageKHR wlr_egl_create_image(struct wlr_egl *egl,
 		EGLenum target, EGLClientBuffer buffer, const EGLint *attribs);
 
+/**
+ * Creates an egl image from the given dmabuf attributes. Returns
+ * EGL_NO_IMAGE_KHR on failure.
+ */
+EGLImageKHR wlr_egl_create_image_from_dmabuf(struct wlr_egl *egl,
+		struct wlr_dmabuf_buffer_attribs *attributes);
+
+/**
+ * Returns true if the dmabuf can be imported.
+ */
+bool wlr_egl_check_import_dmabuf(struct wlr_egl *egl,
+		struct wlr_dmabuf_buffer_attribs *attributes);
+
+/**
+ * Gets the DRM formats which can be imported from dmabufs. Returns the number
+ * of formats, or -1 on error. The array must be freed by the caller.
+ */
+int wlr_egl_get_dmabuf_formats(struct wlr_egl *egl, int **formats);
+
+/**
+ * Gets the modifiers which can be used with a DRM format. Returns the number
+ * of modifiers, or -1 on error. The array must be freed by the caller.
+ */
+int wlr_egl_get_dmabuf_modifiers(struct wlr_egl *egl, int format,
+		uint64_t **modifiers);
+
 /**
  * Destroys an egl image created with the given wlr_egl.
  */
@@ -5,7 +5,9 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <stdbool.h>
+#include <pixman.h>
 #include <wlr/render.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output.h>
 
 struct wlr_renderer_impl;
@@ -16,10 +18,15 @@ struct wlr_renderer {
 
 struct wlr_renderer_impl {
 	void (*begin)(struct wlr_renderer *renderer, struct wlr_output *output);
+	void (*begin_with_damage)(struct wlr_renderer *renderer,
+		struct wlr_output *output, pixman_region32_t *damage);
 	void (*end)(struct wlr_renderer *renderer);
+	void (*scissor)(struct wlr_renderer *renderer, struct wlr_box *box);
 	struct wlr_texture *(*texture_create)(struct wlr_renderer *renderer);
 	bool (*render_with_matrix)(struct wlr_renderer *renderer,
 		struct wlr_texture *texture, const float (*matrix)[16]);
+	bool (*render_with_matrix_opaque)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const float (*matrix)[16]);
 	void (*render_quad)(struct wlr_renderer *renderer,
 		const float (*color)[4], const float (*matrix)[16]);
 	void (*render_ellipse)(struct wlr_renderer *renderer,
@@ -46,11 +53,15 @@ struct wlr_texture_impl {
 	bool (*upload_shm)(struct wlr_texture *texture, uint32_t format,
 		struct wl_shm_buffer *shm);
 	bool (*update_shm)(struct wlr_texture *texture, uint32_t format,
-		int x, int y, int width, int height, struct wl_shm_buffer *shm);
+		pixman_region32_t *damage, struct wl_shm_buffer *shm);
+	bool (*import_shm)(struct wlr_texture *texture,
+		struct wl_resource *shm_buf);
 	bool (*upload_drm)(struct wlr_texture *texture,
 		struct wl_resource *drm_buf);
 	bool (*upload_eglimage)(struct wlr_texture *texture, EGLImageKHR image,
 		uint32_t width, uint32_t height);
+	bool (*upload_dmabuf)(struct wlr_texture *texture,
+		struct wl_resource *dmabuf_resource);
 	void (*get_matrix)(struct wlr_texture *state,
 		float (*matrix)[16], const float (*projection)[16], int x, int y);
 	void (*get_buffer_size)(struct wlr_texture *texture,
@@ -0,0 +1,30 @@
+#ifndef WLR_RENDER_PIXMAN_H
+#define WLR_RENDER_PIXMAN_H
+
+#include <stdbool.h>
+#include <pixman.h>
+#include <wlr/render.h>
+
+/**
+ * Creates a renderer drawing on the CPU with pixman. Pixman renderers draw into
+ * the current image, see wlr_pixman_make_current.
+ */
+struct wlr_renderer *wlr_pixman_renderer_create(void);
+/**
+ * Makes `image` the target of the pixman renderers, like making an EGL surface
+ * current does for the GLES2 renderer. Backends call this from their
+ * make_current implementation. The image is in framebuffer coordinates (the
+ * output transform is already applied) and in PIXMAN_a8r8g8b8 format. A
+ * reference is held until another image is made current, NULL releases it.
+ */
+void wlr_pixman_make_current(pixman_image_t *image);
+/**
+ * Returns the current image, or NULL.
+ */
+pixman_image_t *wlr_pixman_get_current(void);
+/**
+ * True if the given renderer is a pixman renderer.
+ */
+bool wlr_renderer_is_pixman(struct wlr_renderer *renderer);
+
+#endif
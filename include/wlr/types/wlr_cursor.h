@@ -16,6 +16,8 @@ struct wlr_cursor {
 
 	struct {
 		struct wl_signal motion;
+		// every relative motion event, even when they are coalesced
+		struct wl_signal motion_sample;
 		struct wl_signal motion_absolute;
 		struct wl_signal button;
 		struct wl_signal axis;
@@ -62,6 +64,26 @@ void wlr_cursor_warp_absolute(struct wlr_cursor *cur,
 void wlr_cursor_move(struct wlr_cursor *cur, struct wlr_input_device *dev,
 		double delta_x, double delta_y);
 
+/**
+ * Enables or disables motion coalescing. When enabled, relative motion events
+ * of pointer devices are accumulated instead of being emitted right away. The
+ * sum is emitted as a single motion event by wlr_cursor_flush_motion, or before
+ * any other event of the cursor so that their order is kept. A frame is
+ * scheduled on the outputs of the layout when motion starts to accumulate.
+ * Motion isn't coalesced while the layout has no output sending frame events.
+ *
+ * The motion_sample event is still emitted for every relative motion event,
+ * before it is accumulated, for users which need each sample, e.g. to forward
+ * the unaccelerated deltas to clients.
+ */
+void wlr_cursor_set_coalesce_motion(struct wlr_cursor *cur, bool coalesce);
+
+/**
+ * Emits the motion accumulated since the last flush, if any. Compositors
+ * coalescing motion should call this at the beginning of each output frame.
+ */
+void wlr_cursor_flush_motion(struct wlr_cursor *cur);
+
 /**
  * Attaches this input device to this cursor. The input device must be one of:
  *
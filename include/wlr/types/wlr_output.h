@@ -3,7 +3,10 @@
 
 #include <wayland-util.h>
 #include <wayland-server.h>
+#include <pixman.h>
 #include <stdbool.h>
+#include <time.h>
+#include <wlr/types/wlr_box.h>
 
 struct wlr_output_mode {
 	uint32_t flags; // enum wl_output_mode
@@ -18,6 +21,7 @@ struct wlr_output {
 	const struct wlr_output_impl *impl;
 	struct wlr_backend *backend;
 
+	struct wl_display *display;
 	struct wl_global *wl_global;
 	struct wl_list wl_resources;
 
@@ -33,6 +37,26 @@ struct wlr_output {
 
 	float transform_matrix[16];
 
+	// true if the next frame must be swapped even if the compositor has
+	// nothing new to draw (e.g. the hardware cursor moved and is only updated
+	// with the next page flip)
+	bool needs_swap;
+	// regions whose contents changed outside of the compositor's control (e.g.
+	// the software cursor moved) and must be repainted with the next frame, in
+	// output-local coordinates. Cleared when buffers are swapped.
+	pixman_region32_t damage;
+	// true between a buffer swap and the frame event that follows it
+	bool frame_pending;
+	struct wl_event_source *idle_frame;
+
+	// see wlr_output_set_frame_margin
+	struct {
+		int margin; // ms, 0 if disabled
+		int render_time; // us, measured from the frame event to the swap
+		struct timespec frame_sent;
+		struct wl_event_source *timer;
+	} frame_schedule;
+
 	/* Note: some backends may have zero modes */
 	struct wl_list modes;
 	struct wlr_output_mode *current_mode;
@@ -51,6 +75,12 @@ struct wlr_output {
 		int32_t hotspot_x, hotspot_y;
 		struct wlr_renderer *renderer;
 		struct wlr_texture *texture;
+		// hardware cursor moves are applied once per frame
+		bool move_pending;
+		// whether the backend rejected the last applied move
+		bool move_failed;
+		// where the software cursor was drawn by the last buffer swap
+		struct wlr_box drawn_box;
 
 		// only when using a cursor surface
 		struct wlr_surface *surface;
@@ -65,6 +95,7 @@ struct wlr_output {
 };
 
 struct wlr_surface;
+struct wlr_box;
 
 void wlr_output_enable(struct wlr_output *output, bool enable);
 bool wlr_output_set_mode(struct wlr_output *output,
@@ -77,12 +108,88 @@ bool wlr_output_set_cursor(struct wlr_output *output,
 	int32_t hotspot_x, int32_t hotspot_y);
 void wlr_output_set_cursor_surface(struct wlr_output *output,
 	struct wlr_surface *surface, int32_t hotspot_x, int32_t hotspot_y);
+/**
+ * Moves the cursor to the given output-local position. A hardware cursor is
+ * moved by the next frame event, so that it is updated at most once per
+ * refresh cycle. A software cursor damages the rectangles it leaves and
+ * enters, see `damage`.
+ *
+ * Returns false if the backend can't move a hardware cursor at all, or if the
+ * output isn't advertised yet and the backend rejected the move. Otherwise the
+ * move is only attempted with the next frame: true is returned right away and
+ * a failure then is logged.
+ */
 bool wlr_output_move_cursor(struct wlr_output *output, int x, int y);
 void wlr_output_destroy(struct wlr_output *output);
 void wlr_output_effective_resolution(struct wlr_output *output,
 	int *width, int *height);
-void wlr_output_make_current(struct wlr_output *output);
+/**
+ * Converts a box in output-local coordinates to framebuffer coordinates, as
+ * expected by wlr_renderer_scissor. `box` and `dest` may be the same.
+ */
+void wlr_output_project_box(struct wlr_output *output, const struct wlr_box *box,
+	struct wlr_box *dest);
+/**
+ * Makes the output rendering context current. If `buffer_age` is not NULL, it
+ * is set to the age of the back buffer: the number of frames since it was last
+ * displayed, 0 if its contents are undefined, or -1 if unknown. Compositors can
+ * use it to only repaint the regions damaged since then.
+ */
+bool wlr_output_make_current(struct wlr_output *output, int *buffer_age);
 void wlr_output_swap_buffers(struct wlr_output *output);
+/**
+ * Attempts to display the surface's current buffer directly, without
+ * compositing it. This replaces rendering and swapping buffers for this frame.
+ * The buffer must cover the whole output and match its transform, and the
+ * surface must not have any mapped subsurface. Returns false if the buffer
+ * cannot be scanned out, in which case the frame must be rendered as usual.
+ *
+ * The next rendered frame must repaint the whole output, the back buffers
+ * don't contain what has been displayed meanwhile.
+ */
+bool wlr_output_scanout_surface(struct wlr_output *output,
+	struct wlr_surface *surface);
+/**
+ * Attempts to display the surface's current buffer on a hardware overlay plane
+ * during the next frame, at the given output-local position. Overlay planes
+ * are displayed above the rendered frame, so nothing must be drawn on top of
+ * the surface. The surface doesn't need to be rendered if this succeeds.
+ * Returns false if no plane is available or if the buffer cannot be displayed
+ * this way, e.g. because the surface or the output is scaled or transformed,
+ * in which case the surface must be rendered as usual.
+ *
+ * The assignment only lasts until the next buffer swap, it must be renewed for
+ * each frame.
+ */
+bool wlr_output_attach_overlay(struct wlr_output *output,
+	struct wlr_surface *surface, int x, int y);
+/**
+ * Requests a frame event for this output. Backends only send frame events
+ * after a buffer swap, so a compositor which skips frames with nothing to
+ * repaint must call this to resume rendering once something changes. Does
+ * nothing if a frame event is already on its way.
+ *
+ * Otherwise the output is idle and the frame event is sent once the event loop
+ * has dispatched all pending events, so that the changes they make are
+ * rendered in a single frame.
+ */
+void wlr_output_schedule_frame(struct wlr_output *output);
+
+#define WLR_OUTPUT_FRAME_MARGIN_ADAPTIVE -1
+
+/**
+ * Enables frame scheduling. By default, the frame event is sent as soon as the
+ * previous frame has been displayed, so rendering happens almost a whole
+ * refresh cycle before the result reaches the screen. With a margin, the frame
+ * event is delayed until `margin_ms` milliseconds before the next vblank,
+ * which reduces the latency between input and output. The margin must leave
+ * enough time to render, otherwise a vblank is missed.
+ *
+ * WLR_OUTPUT_FRAME_MARGIN_ADAPTIVE measures how long rendering takes and picks
+ * the margin accordingly. A margin of 0 disables frame scheduling. This only
+ * has an effect on backends which report vblank timestamps.
+ */
+void wlr_output_set_frame_margin(struct wlr_output *output, int margin_ms);
 void wlr_output_set_gamma(struct wlr_output *output,
 	uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b);
 uint32_t wlr_output_get_gamma_size(struct wlr_output *output);
@@ -25,6 +25,8 @@ struct wlr_event_pointer_motion {
 	uint32_t time_sec;
 	uint64_t time_usec;
 	double delta_x, delta_y;
+	// without pointer acceleration, for clients which want raw motion
+	double unaccel_dx, unaccel_dy;
 };
 
 struct wlr_event_pointer_motion_absolute {
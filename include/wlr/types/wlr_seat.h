@@ -21,6 +21,8 @@ struct wlr_seat_handle {
 	struct wl_resource *data_device;
 
 	struct wl_list link;
+	// Handles of the same client, for all seats, newest first
+	struct wl_list client_link;
 };
 
 struct wlr_seat_pointer_grab;
@@ -5,6 +5,7 @@
 #include <pixman.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <wlr/types/wlr_box.h>
 
 struct wlr_frame_callback {
 	struct wl_resource *resource;
@@ -26,6 +27,9 @@ struct wlr_surface_state {
 	struct wl_resource *buffer;
 	struct wl_listener buffer_destroy_listener;
 	int32_t sx, sy;
+	// In the current state, the damage is only valid during the commit event.
+	// surface_damage also includes the area the surface covered before a
+	// resize.
 	pixman_region32_t surface_damage, buffer_damage;
 	pixman_region32_t opaque, input;
 	enum wl_output_transform transform;
@@ -57,6 +61,11 @@ struct wlr_subsurface {
 	struct wl_listener parent_destroy_listener;
 };
 
+struct wlr_surface_tree_entry {
+	struct wlr_surface *surface;
+	struct wlr_box box; // relative to the root of the tree
+};
+
 struct wlr_surface {
 	struct wl_resource *resource;
 	struct wlr_renderer *renderer;
@@ -67,6 +76,11 @@ struct wlr_surface {
 	float buffer_to_surface_matrix[16];
 	float surface_to_buffer_matrix[16];
 
+	// bytes uploaded to the texture by the last commit
+	size_t upload_bytes;
+	// region of the surface known to be fully opaque, in surface coordinates
+	pixman_region32_t opaque_region;
+
 	struct {
 		struct wl_signal commit;
 		struct wl_signal destroy;
@@ -82,6 +96,14 @@ struct wlr_surface {
 
 	// wlr_subsurface::parent_pending_link
 	struct wl_list subsurface_pending_list;
+
+	// Flattened subsurface tree, see wlr_surface_get_tree
+	struct {
+		struct wlr_surface_tree_entry *entries;
+		size_t len, cap;
+		bool dirty;
+	} tree;
+
 	void *data;
 };
 
@@ -135,4 +157,32 @@ struct wlr_surface *wlr_surface_get_main_surface(struct wlr_surface *surface);
  */
 struct wlr_subsurface *wlr_surface_subsurface_at(struct wlr_surface *surface,
 		double sx, double sy, double *sub_x, double *sub_y);
+
+/**
+ * Get this surface and its subsurfaces as an array in rendering order, from
+ * bottom to top. The first entry is the surface itself at <0, 0>, the boxes of
+ * the others are in its coordinate system. Subsurfaces of surfaces without a
+ * buffer are left out.
+ *
+ * The array is cached and only rebuilt after a commit of a surface in the tree
+ * or after subsurfaces have been added or removed. It stays valid until then.
+ */
+const struct wlr_surface_tree_entry *wlr_surface_get_tree(
+		struct wlr_surface *surface, size_t *len);
+
+struct wlr_buffer_lock;
+
+/**
+ * Keep a wl_buffer from being released to its client, for instance while it
+ * is being scanned out. Surfaces committing a new buffer defer the release of
+ * the previous one until all of its locks are dropped. Returns NULL on
+ * allocation failure.
+ */
+struct wlr_buffer_lock *wlr_buffer_lock(struct wl_resource *buffer);
+
+/**
+ * Drop a lock taken with wlr_buffer_lock, releasing the buffer if a surface
+ * was done with it. The lock stays valid if the buffer is destroyed.
+ */
+void wlr_buffer_unlock(struct wlr_buffer_lock *lock);
 #endif
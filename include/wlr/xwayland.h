@@ -22,6 +22,14 @@ struct wlr_xwayland {
 	struct wlr_compositor *compositor;
 	time_t server_start;
 
+	// Lazy mode: Xwayland is only started once an X11 client connects
+	bool lazy;
+	struct wl_event_source *x_fd_source[2];
+	// Stops Xwayland once no X11 window is left, see
+	// wlr_xwayland_set_idle_timeout
+	int idle_timeout;
+	struct wl_event_source *idle_source;
+
 	struct wl_event_source *sigusr1_source;
 	struct wl_listener destroy_listener;
 	struct wlr_xwm *xwm;
@@ -30,6 +38,13 @@ struct wlr_xwayland {
 		struct wl_signal new_surface;
 	} events;
 
+	struct {
+		uint64_t processed_events; // X11 events handled by the window manager
+		// ConfigureRequest and ConfigureNotify events dropped because a later
+		// one for the same window superseded them
+		uint64_t collapsed_events;
+	} stats;
+
 	void *data;
 };
 
@@ -69,7 +84,8 @@ struct wlr_xwayland_surface {
 	uint32_t surface_id;
 
 	struct wl_list link;
-	struct wl_list unpaired_link;
+	struct wl_list pending_props_link;
+	uint32_t pending_props; // properties which changed and need to be read
 
 	struct wlr_surface *surface;
 	int16_t x, y;
@@ -143,8 +159,20 @@ struct wlr_xwayland_resize_event {
 	uint32_t edges;
 };
 
+/**
+ * Creates the X11 display. If lazy is true, Xwayland is only started when the
+ * first X11 client connects.
+ */
 struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
-	struct wlr_compositor *compositor);
+	struct wlr_compositor *compositor, bool lazy);
+
+/**
+ * In lazy mode, stops Xwayland once no X11 window has been left for
+ * timeout_ms. It is started again when the next client connects. A timeout of
+ * 0 keeps it running.
+ */
+void wlr_xwayland_set_idle_timeout(struct wlr_xwayland *wlr_xwayland,
+	int timeout_ms);
 
 void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland);
 
@@ -1,7 +1,10 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/util/log.h>
 #include <wlr/render/egl.h>
 #include "render/glapi.h"
@@ -47,7 +50,8 @@ const char *egl_error(void) {
 	}
 }
 
-static bool egl_get_config(EGLDisplay disp, EGLConfig *out, EGLint visual_id) {
+static bool egl_get_config(EGLDisplay disp, const EGLint *attribs,
+		EGLConfig *out, EGLint visual_id) {
 	EGLint count = 0, matched = 0, ret;
 
 	ret = eglGetConfigs(disp, NULL, 0, &count);
@@ -58,7 +62,7 @@ static bool egl_get_config(EGLDisplay disp, EGLConfig *out, EGLint visual_id) {
 
 	EGLConfig configs[count];
 
-	ret = eglChooseConfig(disp, NULL, configs, count, &matched);
+	ret = eglChooseConfig(disp, attribs, configs, count, &matched);
 	if (ret == EGL_FALSE) {
 		wlr_log(L_ERROR, "eglChooseConfig failed");
 		return false;
@@ -71,7 +75,7 @@ static bool egl_get_config(EGLDisplay disp, EGLConfig *out, EGLint visual_id) {
 			continue;
 		}
 
-		if (visual == visual_id) {
+		if (visual_id == EGL_DONT_CARE || visual == visual_id) {
 			*out = configs[i];
 			return true;
 		}
@@ -104,7 +108,24 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, EGLint visual_id,
 		goto error;
 	}
 
-	if (!egl_get_config(egl->display, &egl->config, visual_id)) {
+	// Surfaceless displays have no native windows, outputs render to pbuffers
+	static const EGLint pbuffer_config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 1,
+		EGL_GREEN_SIZE, 1,
+		EGL_BLUE_SIZE, 1,
+		EGL_ALPHA_SIZE, 1,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_NONE,
+	};
+	const EGLint *config_attribs = NULL;
+	if (platform == EGL_PLATFORM_SURFACELESS_MESA) {
+		config_attribs = pbuffer_config_attribs;
+		visual_id = EGL_DONT_CARE;
+	}
+
+	if (!egl_get_config(egl->display, config_attribs, &egl->config,
+			visual_id)) {
 		wlr_log(L_ERROR, "Failed to get EGL config");
 		goto error;
 	}
@@ -127,6 +148,16 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, EGLint visual_id,
 		goto error;
 	}
 
+	egl->has_buffer_age =
+		strstr(egl->egl_exts, "EGL_EXT_buffer_age") != NULL;
+	egl->has_surfaceless_context =
+		strstr(egl->egl_exts, "EGL_KHR_surfaceless_context") != NULL;
+	egl->has_dmabuf_import =
+		strstr(egl->egl_exts, "EGL_EXT_image_dma_buf_import") != NULL;
+	egl->has_dmabuf_import_modifiers = eglQueryDmaBufFormatsEXT &&
+		eglQueryDmaBufModifiersEXT && strstr(egl->egl_exts,
+			"EGL_EXT_image_dma_buf_import_modifiers") != NULL;
+
 	egl->gl_exts = (const char*) glGetString(GL_EXTENSIONS);
 	wlr_log(L_INFO, "Using EGL %d.%d", (int)major, (int)minor);
 	wlr_log(L_INFO, "Supported EGL extensions: %s", egl->egl_exts);
@@ -183,6 +214,192 @@ EGLImage wlr_egl_create_image(struct wlr_egl *egl, EGLenum target,
 		buffer, attribs);
 }
 
+#ifndef DRM_FORMAT_BIG_ENDIAN
+#define DRM_FORMAT_BIG_ENDIAN 0x80000000
+#endif
+bool wlr_egl_check_import_dmabuf(struct wlr_egl *egl,
+		struct wlr_dmabuf_buffer_attribs *attributes) {
+	switch (attributes->format & ~DRM_FORMAT_BIG_ENDIAN) {
+		/* TODO: YUV based formats not yet supported, require multiple
+		 * wlr_create_image_from_dmabuf */
+	case WL_SHM_FORMAT_YUYV:
+	case WL_SHM_FORMAT_YVYU:
+	case WL_SHM_FORMAT_UYVY:
+	case WL_SHM_FORMAT_VYUY:
+	case WL_SHM_FORMAT_AYUV:
+		return false;
+	default:
+		break;
+	}
+
+	EGLImage egl_image = wlr_egl_create_image_from_dmabuf(egl, attributes);
+	if (egl_image == EGL_NO_IMAGE_KHR) {
+		return false;
+	}
+	// We can import the image, good. No need to keep it since
+	// wlr_texture_upload_dmabuf will import it again
+	wlr_egl_destroy_image(egl, egl_image);
+	return true;
+}
+
+EGLImage wlr_egl_create_image_from_dmabuf(struct wlr_egl *egl,
+		struct wlr_dmabuf_buffer_attribs *attributes) {
+	if (!eglCreateImageKHR || !egl->has_dmabuf_import) {
+		return EGL_NO_IMAGE_KHR;
+	}
+
+	bool has_modifier = false;
+	if (attributes->modifier[0] != DRM_FORMAT_MOD_INVALID) {
+		if (!egl->has_dmabuf_import_modifiers) {
+			return EGL_NO_IMAGE_KHR;
+		}
+		has_modifier = true;
+	}
+
+	unsigned int atti = 0;
+	EGLint attribs[50];
+	attribs[atti++] = EGL_WIDTH;
+	attribs[atti++] = attributes->width;
+	attribs[atti++] = EGL_HEIGHT;
+	attribs[atti++] = attributes->height;
+	attribs[atti++] = EGL_LINUX_DRM_FOURCC_EXT;
+	attribs[atti++] = attributes->format;
+
+	struct {
+		EGLint fd;
+		EGLint offset;
+		EGLint pitch;
+		EGLint mod_lo;
+		EGLint mod_hi;
+	} attr_names[WLR_LINUX_DMABUF_MAX_PLANES] = {
+		{
+			EGL_DMA_BUF_PLANE0_FD_EXT,
+			EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+			EGL_DMA_BUF_PLANE0_PITCH_EXT,
+			EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT,
+			EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT,
+		}, {
+			EGL_DMA_BUF_PLANE1_FD_EXT,
+			EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+			EGL_DMA_BUF_PLANE1_PITCH_EXT,
+			EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT,
+			EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT,
+		}, {
+			EGL_DMA_BUF_PLANE2_FD_EXT,
+			EGL_DMA_BUF_PLANE2_OFFSET_EXT,
+			EGL_DMA_BUF_PLANE2_PITCH_EXT,
+			EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT,
+			EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT,
+		}, {
+			EGL_DMA_BUF_PLANE3_FD_EXT,
+			EGL_DMA_BUF_PLANE3_OFFSET_EXT,
+			EGL_DMA_BUF_PLANE3_PITCH_EXT,
+			EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT,
+			EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT,
+		}
+	};
+
+	for (int i = 0; i < attributes->n_planes; i++) {
+		attribs[atti++] = attr_names[i].fd;
+		attribs[atti++] = attributes->fd[i];
+		attribs[atti++] = attr_names[i].offset;
+		attribs[atti++] = attributes->offset[i];
+		attribs[atti++] = attr_names[i].pitch;
+		attribs[atti++] = attributes->stride[i];
+		if (has_modifier) {
+			attribs[atti++] = attr_names[i].mod_lo;
+			attribs[atti++] = attributes->modifier[i] & 0xFFFFFFFF;
+			attribs[atti++] = attr_names[i].mod_hi;
+			attribs[atti++] = attributes->modifier[i] >> 32;
+		}
+	}
+	attribs[atti++] = EGL_NONE;
+	assert(atti < sizeof(attribs)/sizeof(attribs[0]));
+
+	// EGL_LINUX_DMA_BUF_EXT images must be created without a context
+	return eglCreateImageKHR(egl->display, EGL_NO_CONTEXT,
+		EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+}
+
+int wlr_egl_get_dmabuf_formats(struct wlr_egl *egl, int **formats) {
+	if (!egl->has_dmabuf_import) {
+		wlr_log(L_DEBUG, "dmabuf import extension not present");
+		return -1;
+	}
+
+	*formats = NULL;
+
+	if (!egl->has_dmabuf_import_modifiers) {
+		// Without the modifiers extension the formats can't be queried,
+		// advertise the ones every implementation supports
+		static const int fallback_formats[] = {
+			DRM_FORMAT_ARGB8888,
+			DRM_FORMAT_XRGB8888,
+		};
+		int num = sizeof(fallback_formats) / sizeof(fallback_formats[0]);
+		*formats = calloc(num, sizeof(int));
+		if (*formats == NULL) {
+			wlr_log_errno(L_ERROR, "Allocation failed");
+			return -1;
+		}
+		memcpy(*formats, fallback_formats, sizeof(fallback_formats));
+		return num;
+	}
+
+	EGLint num;
+	if (!eglQueryDmaBufFormatsEXT(egl->display, 0, NULL, &num)) {
+		wlr_log(L_ERROR, "failed to query number of dmabuf formats");
+		return -1;
+	}
+
+	*formats = calloc(num, sizeof(int));
+	if (*formats == NULL) {
+		wlr_log_errno(L_ERROR, "Allocation failed");
+		return -1;
+	}
+
+	if (!eglQueryDmaBufFormatsEXT(egl->display, num, *formats, &num)) {
+		wlr_log(L_ERROR, "failed to query dmabuf format");
+		free(*formats);
+		*formats = NULL;
+		return -1;
+	}
+	return num;
+}
+
+int wlr_egl_get_dmabuf_modifiers(struct wlr_egl *egl, int format,
+		uint64_t **modifiers) {
+	*modifiers = NULL;
+	if (!egl->has_dmabuf_import_modifiers) {
+		return 0;
+	}
+
+	EGLint num;
+	if (!eglQueryDmaBufModifiersEXT(egl->display, format, 0,
+			NULL, NULL, &num)) {
+		wlr_log(L_ERROR, "failed to query dmabuf number of modifiers");
+		return -1;
+	}
+	if (num == 0) {
+		return 0;
+	}
+
+	*modifiers = calloc(num, sizeof(uint64_t));
+	if (*modifiers == NULL) {
+		wlr_log_errno(L_ERROR, "Allocation failed");
+		return -1;
+	}
+
+	if (!eglQueryDmaBufModifiersEXT(egl->display, format, num,
+			(EGLuint64KHR *)*modifiers, NULL, &num)) {
+		wlr_log(L_ERROR, "failed to query dmabuf modifiers");
+		free(*modifiers);
+		*modifiers = NULL;
+		return -1;
+	}
+	return num;
+}
+
 bool wlr_egl_destroy_image(struct wlr_egl *egl, EGLImage image) {
 	if (!eglDestroyImageKHR) {
 		return false;
@@ -201,3 +418,40 @@ EGLSurface wlr_egl_create_surface(struct wlr_egl *egl, void *window) {
 	}
 	return surf;
 }
+
+EGLSurface wlr_egl_create_pbuffer_surface(struct wlr_egl *egl, int width,
+		int height) {
+	const EGLint attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE,
+	};
+	EGLSurface surf = eglCreatePbufferSurface(egl->display, egl->config,
+		attribs);
+	if (surf == EGL_NO_SURFACE) {
+		wlr_log(L_ERROR, "Failed to create EGL pbuffer surface: %s",
+			egl_error());
+		return EGL_NO_SURFACE;
+	}
+	return surf;
+}
+
+bool wlr_egl_make_current(struct wlr_egl *egl, EGLSurface surface,
+		int *buffer_age) {
+	if (!eglMakeCurrent(egl->display, surface, surface, egl->context)) {
+		wlr_log(L_ERROR, "eglMakeCurrent failed: %s", egl_error());
+		return false;
+	}
+
+	if (buffer_age != NULL) {
+		EGLint age = -1;
+		if (egl->has_buffer_age && !eglQuerySurface(egl->display, surface,
+				EGL_BUFFER_AGE_EXT, &age)) {
+			wlr_log(L_ERROR, "Failed to query buffer age: %s", egl_error());
+			return false;
+		}
+		*buffer_age = age;
+	}
+
+	return true;
+}
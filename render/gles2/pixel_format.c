@@ -10,6 +10,7 @@ struct pixel_format formats[] = {
 		.bpp = 32,
 		.gl_format = GL_BGRA_EXT,
 		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = true,
 		.shader = &shaders.rgba
 	},
 	{
@@ -30,6 +31,7 @@ struct pixel_format formats[] = {
 		.wl_format = WL_SHM_FORMAT_ABGR8888,
 		.gl_format = GL_RGBA,
 		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = true,
 		.shader = &shaders.rgba
 	},
 };
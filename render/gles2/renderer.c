@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,6 +11,7 @@
 #include <wlr/render/egl.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/matrix.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/util/log.h>
 #include "render/gles2.h"
 #include "render/glapi.h"
@@ -49,6 +51,10 @@ static bool compile_program(const GLchar *vert_src,
 	*program = GL_CALL(glCreateProgram());
 	GL_CALL(glAttachShader(*program, vertex));
 	GL_CALL(glAttachShader(*program, fragment));
+	// All programs share the vertex layout of struct gles2_vertex
+	GL_CALL(glBindAttribLocation(*program, 0, "pos"));
+	GL_CALL(glBindAttribLocation(*program, 1, "texcoord"));
+	GL_CALL(glBindAttribLocation(*program, 2, "color"));
 	GL_CALL(glLinkProgram(*program));
 	GLint success;
 	GL_CALL(glGetProgramiv(*program, GL_LINK_STATUS, &success));
@@ -82,14 +88,14 @@ static void init_default_shaders() {
 	if (!compile_program(vertex_src, fragment_src_rgbx, &shaders.rgbx)) {
 		goto error;
 	}
-	if (!compile_program(quad_vertex_src, quad_fragment_src, &shaders.quad)) {
+	if (!compile_program(vertex_src, quad_fragment_src, &shaders.quad)) {
 		goto error;
 	}
-	if (!compile_program(quad_vertex_src, ellipse_fragment_src, &shaders.ellipse)) {
+	if (!compile_program(vertex_src, ellipse_fragment_src, &shaders.ellipse)) {
 		goto error;
 	}
 	if (glEGLImageTargetTexture2DOES) {
-		if (!compile_program(quad_vertex_src, fragment_src_external, &shaders.external)) {
+		if (!compile_program(vertex_src, fragment_src_external, &shaders.external)) {
 			goto error;
 		}
 	}
@@ -105,8 +111,190 @@ static void init_globals() {
 	init_default_shaders();
 }
 
+static bool init_buffers(struct wlr_gles2_renderer *renderer) {
+	if (renderer->batch.vbo) {
+		return true;
+	}
+
+	// Quads are drawn as two triangles, the indices never change
+	GLushort *indices = malloc(GLES2_BATCH_QUADS * 6 * sizeof(GLushort));
+	if (!indices) {
+		wlr_log(L_ERROR, "Failed to allocate quad indices");
+		return false;
+	}
+	for (GLushort i = 0; i < GLES2_BATCH_QUADS; ++i) {
+		GLushort *quad = &indices[i * 6];
+		quad[0] = i * 4;
+		quad[1] = i * 4 + 1;
+		quad[2] = i * 4 + 2;
+		quad[3] = i * 4 + 2;
+		quad[4] = i * 4 + 1;
+		quad[5] = i * 4 + 3;
+	}
+
+	GL_CALL(glGenBuffers(1, &renderer->batch.vbo));
+	GL_CALL(glGenBuffers(1, &renderer->batch.ibo));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->batch.ibo));
+	GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		GLES2_BATCH_QUADS * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	free(indices);
+	return true;
+}
+
+/**
+ * Sets up the vertex buffers and forgets about the program, texture and
+ * blending state set by someone else, they are set again by the next flush.
+ */
+static bool setup_state(struct wlr_gles2_renderer *renderer) {
+	if (renderer->bound.valid) {
+		return true;
+	}
+	if (!init_buffers(renderer)) {
+		return false;
+	}
+
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, renderer->batch.vbo));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->batch.ibo));
+	GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+		sizeof(struct gles2_vertex),
+		(void *)offsetof(struct gles2_vertex, x)));
+	GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+		sizeof(struct gles2_vertex),
+		(void *)offsetof(struct gles2_vertex, s)));
+	GL_CALL(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE,
+		sizeof(struct gles2_vertex),
+		(void *)offsetof(struct gles2_vertex, r)));
+	GL_CALL(glEnableVertexAttribArray(0));
+	GL_CALL(glEnableVertexAttribArray(1));
+	GL_CALL(glEnableVertexAttribArray(2));
+	GL_CALL(glActiveTexture(GL_TEXTURE0));
+	GL_CALL(glEnable(GL_BLEND));
+	GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+
+	renderer->bound.program = 0;
+	renderer->bound.target = GL_TEXTURE_2D;
+	renderer->bound.tex_id = 0;
+	renderer->bound.blend = true;
+	renderer->bound.valid = true;
+	return true;
+}
+
+static void reset_state(struct wlr_gles2_renderer *renderer) {
+	if (!renderer->bound.valid) {
+		return;
+	}
+	GL_CALL(glDisableVertexAttribArray(0));
+	GL_CALL(glDisableVertexAttribArray(1));
+	GL_CALL(glDisableVertexAttribArray(2));
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	if (!renderer->bound.blend) {
+		GL_CALL(glEnable(GL_BLEND));
+	}
+	renderer->bound.valid = false;
+}
+
+/**
+ * Draws the queued quads with a single call. Only the state differing from
+ * the previous flush is changed.
+ */
+static void flush_batch(struct wlr_gles2_renderer *renderer) {
+	size_t len = renderer->batch.len;
+	if (len == 0) {
+		return;
+	}
+	renderer->batch.len = 0;
+	if (!setup_state(renderer)) {
+		return;
+	}
+
+	if (renderer->bound.program != renderer->batch.program) {
+		GL_CALL(glUseProgram(renderer->batch.program));
+		renderer->bound.program = renderer->batch.program;
+	}
+	if (renderer->batch.tex_id != 0 &&
+			(renderer->bound.tex_id != renderer->batch.tex_id ||
+			renderer->bound.target != renderer->batch.target)) {
+		GLenum target = renderer->batch.target;
+		GL_CALL(glBindTexture(target, renderer->batch.tex_id));
+		GL_CALL(glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+		GL_CALL(glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+		renderer->bound.target = target;
+		renderer->bound.tex_id = renderer->batch.tex_id;
+	}
+	if (renderer->bound.blend != renderer->batch.blend) {
+		// Opaque quads don't need to read back the framebuffer
+		if (renderer->batch.blend) {
+			GL_CALL(glEnable(GL_BLEND));
+		} else {
+			GL_CALL(glDisable(GL_BLEND));
+		}
+		renderer->bound.blend = renderer->batch.blend;
+	}
+
+	// Respecify the storage so that the driver doesn't wait for the previous
+	// draw to finish before overwriting it. Only the queued quads are
+	// uploaded, most flushes hold a handful of them.
+	GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+		len * 4 * sizeof(struct gles2_vertex), renderer->batch.vertices,
+		GL_STREAM_DRAW));
+	GL_CALL(glDrawElements(GL_TRIANGLES, len * 6, GL_UNSIGNED_SHORT, 0));
+}
+
+static void push_quad(struct wlr_gles2_renderer *renderer, GLuint program,
+		GLenum target, GLuint tex_id, bool blend, const float (*matrix)[16],
+		const float (*color)[4]) {
+	if (renderer->batch.len > 0 && (renderer->batch.program != program ||
+			renderer->batch.tex_id != tex_id ||
+			renderer->batch.target != target ||
+			renderer->batch.blend != blend)) {
+		flush_batch(renderer);
+	}
+	if (renderer->batch.len == GLES2_BATCH_QUADS) {
+		flush_batch(renderer);
+	}
+	renderer->batch.program = program;
+	renderer->batch.target = target;
+	renderer->batch.tex_id = tex_id;
+	renderer->batch.blend = blend;
+
+	// Corners of the unit square, in triangle strip order
+	static const GLfloat corners[4][2] = {
+		{ 1, 0 }, // top right
+		{ 0, 0 }, // top left
+		{ 1, 1 }, // bottom right
+		{ 0, 1 }, // bottom left
+	};
+	const float *m = *matrix;
+	struct gles2_vertex *v = &renderer->batch.vertices[renderer->batch.len * 4];
+	for (int i = 0; i < 4; ++i) {
+		GLfloat x = corners[i][0], y = corners[i][1];
+		GLfloat w = m[12] * x + m[13] * y + m[15];
+		v[i].x = (m[0] * x + m[1] * y + m[3]) / w;
+		v[i].y = (m[4] * x + m[5] * y + m[7]) / w;
+		v[i].s = x;
+		v[i].t = y;
+		v[i].r = (*color)[0];
+		v[i].g = (*color)[1];
+		v[i].b = (*color)[2];
+		v[i].a = (*color)[3];
+	}
+	renderer->batch.len++;
+
+	if (!renderer->in_frame) {
+		// Not between begin and end, e.g. the software cursor: draw now and
+		// leave the GL state as it was
+		flush_batch(renderer);
+		reset_state(renderer);
+	}
+}
+
 static void wlr_gles2_begin(struct wlr_renderer *_renderer,
 		struct wlr_output *output) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	GL_CALL(glDisable(GL_SCISSOR_TEST));
 	// TODO: let users customize the clear color?
 	GL_CALL(glClearColor(0.25f, 0.25f, 0.25f, 1));
 	GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
@@ -114,80 +302,126 @@ static void wlr_gles2_begin(struct wlr_renderer *_renderer,
 	int32_t height = output->height;
 	GL_CALL(glViewport(0, 0, width, height));
 
-	// enable transparency
-	GL_CALL(glEnable(GL_BLEND));
-	GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	// Other users of the context may have changed the bindings, blending is
+	// enabled by the first flush that needs it
+	renderer->bound.valid = false;
+	renderer->in_frame = true;
 
 	// Note: maybe we should save output projection and remove some of the need
 	// for users to sling matricies themselves
 }
 
-static void wlr_gles2_end(struct wlr_renderer *renderer) {
-	// no-op
+static void scissor_output_box(struct wlr_output *output,
+		pixman_box32_t *rect) {
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+	wlr_output_project_box(output, &box, &box);
+	GL_CALL(glScissor(box.x, box.y, box.width, box.height));
 }
 
-static struct wlr_texture *wlr_gles2_texture_create(
-		struct wlr_renderer *_renderer) {
+static void wlr_gles2_begin_with_damage(struct wlr_renderer *_renderer,
+		struct wlr_output *output, pixman_region32_t *damage) {
 	struct wlr_gles2_renderer *renderer =
 		(struct wlr_gles2_renderer *)_renderer;
-	return gles2_texture_create(renderer->egl);
-}
+	GL_CALL(glViewport(0, 0, output->width, output->height));
 
-static void draw_quad() {
-	GLfloat verts[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
-	};
-	GLfloat texcoord[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
-	};
+	// Only clear the damaged rectangles, the rest of the back buffer is still
+	// valid
+	GL_CALL(glEnable(GL_SCISSOR_TEST));
+	GL_CALL(glClearColor(0.25f, 0.25f, 0.25f, 1));
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output_box(output, &rects[i]);
+		GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+	}
 
-	GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts));
-	GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord));
+	// Anything drawn afterwards is restricted to the damage extents, users
+	// can scissor each rectangle to further restrict it
+	scissor_output_box(output, pixman_region32_extents(damage));
 
-	GL_CALL(glEnableVertexAttribArray(0));
-	GL_CALL(glEnableVertexAttribArray(1));
+	renderer->bound.valid = false;
+	renderer->in_frame = true;
+}
 
-	GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+static void wlr_gles2_end(struct wlr_renderer *_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	flush_batch(renderer);
+	reset_state(renderer);
+	renderer->in_frame = false;
+}
 
-	GL_CALL(glDisableVertexAttribArray(0));
-	GL_CALL(glDisableVertexAttribArray(1));
+static void wlr_gles2_scissor(struct wlr_renderer *_renderer,
+		struct wlr_box *box) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	// Queued quads were meant for the previous scissor box
+	flush_batch(renderer);
+	if (box != NULL) {
+		GL_CALL(glScissor(box->x, box->y, box->width, box->height));
+		GL_CALL(glEnable(GL_SCISSOR_TEST));
+	} else {
+		GL_CALL(glDisable(GL_SCISSOR_TEST));
+	}
 }
 
-static bool wlr_gles2_render_texture(struct wlr_renderer *_renderer,
-		struct wlr_texture *texture, const float (*matrix)[16]) {
-	if (!texture || !texture->valid) {
+static struct wlr_texture *wlr_gles2_texture_create(
+		struct wlr_renderer *_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	return gles2_texture_create(renderer->egl);
+}
+
+static bool render_texture(struct wlr_gles2_renderer *renderer,
+		struct wlr_texture *_texture, const float (*matrix)[16], bool blend) {
+	struct wlr_gles2_texture *texture = (struct wlr_gles2_texture *)_texture;
+	if (!_texture || !_texture->valid) {
 		wlr_log(L_ERROR, "attempt to render invalid texture");
 		return false;
 	}
 
-	wlr_texture_bind(texture);
-	GL_CALL(glUniformMatrix4fv(0, 1, GL_FALSE, *matrix));
 	// TODO: source alpha from somewhere else I guess
-	GL_CALL(glUniform1f(2, 1.0f));
-	draw_quad();
+	static const float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	push_quad(renderer, *texture->pixel_format->shader, texture->target,
+		texture->tex_id, blend, matrix, &color);
 	return true;
 }
 
-static void wlr_gles2_render_quad(struct wlr_renderer *renderer,
+static bool wlr_gles2_render_texture(struct wlr_renderer *_renderer,
+		struct wlr_texture *texture, const float (*matrix)[16]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	return render_texture(renderer, texture, matrix,
+		texture && texture->has_alpha);
+}
+
+static bool wlr_gles2_render_texture_opaque(struct wlr_renderer *_renderer,
+		struct wlr_texture *texture, const float (*matrix)[16]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	return render_texture(renderer, texture, matrix, false);
+}
+
+static void wlr_gles2_render_quad(struct wlr_renderer *_renderer,
 		const float (*color)[4], const float (*matrix)[16]) {
-	GL_CALL(glUseProgram(shaders.quad));
-	GL_CALL(glUniformMatrix4fv(0, 1, GL_TRUE, *matrix));
-	GL_CALL(glUniform4f(1, (*color)[0], (*color)[1], (*color)[2], (*color)[3]));
-	draw_quad();
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	push_quad(renderer, shaders.quad, GL_TEXTURE_2D, 0, (*color)[3] < 1.0f,
+		matrix, color);
 }
 
-static void wlr_gles2_render_ellipse(struct wlr_renderer *renderer,
+static void wlr_gles2_render_ellipse(struct wlr_renderer *_renderer,
 		const float (*color)[4], const float (*matrix)[16]) {
-	GL_CALL(glUseProgram(shaders.ellipse));
-	GL_CALL(glUniformMatrix4fv(0, 1, GL_TRUE, *matrix));
-	GL_CALL(glUniform4f(1, (*color)[0], (*color)[1], (*color)[2], (*color)[3]));
-	draw_quad();
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	// Pixels outside of the ellipse are discarded, not blended
+	push_quad(renderer, shaders.ellipse, GL_TEXTURE_2D, 0, (*color)[3] < 1.0f,
+		matrix, color);
 }
 
 static const enum wl_shm_format *wlr_gles2_formats(
@@ -223,20 +457,72 @@ static void rgba_to_argb(uint32_t *data, size_t height, size_t stride) {
 
 static void wlr_gles2_read_pixels(struct wlr_renderer *renderer, int x, int y,
 		int width, int height, void *out_data) {
+	flush_batch((struct wlr_gles2_renderer *)renderer);
 	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, out_data);
 	rgba_to_argb(out_data, height, width*4);
 }
 
+/**
+ * Deletes the batch buffers, which belong to the EGL context. The context is
+ * shared with other users, e.g. the renderers of the outputs, so whatever is
+ * current is restored afterwards.
+ */
+static void delete_batch_buffers(struct wlr_gles2_renderer *renderer) {
+	struct wlr_egl *egl = renderer->egl;
+	EGLContext prev_context = eglGetCurrentContext();
+	if (prev_context == egl->context) {
+		GL_CALL(glDeleteBuffers(1, &renderer->batch.vbo));
+		GL_CALL(glDeleteBuffers(1, &renderer->batch.ibo));
+		return;
+	}
+
+	if (!egl->has_surfaceless_context) {
+		// They are freed along with the context
+		wlr_log(L_DEBUG, "No current context to delete the GL buffers with");
+		return;
+	}
+
+	EGLDisplay prev_display = eglGetCurrentDisplay();
+	EGLSurface prev_draw = eglGetCurrentSurface(EGL_DRAW);
+	EGLSurface prev_read = eglGetCurrentSurface(EGL_READ);
+	if (!wlr_egl_make_current(egl, EGL_NO_SURFACE, NULL)) {
+		return;
+	}
+
+	GL_CALL(glDeleteBuffers(1, &renderer->batch.vbo));
+	GL_CALL(glDeleteBuffers(1, &renderer->batch.ibo));
+
+	if (prev_display == EGL_NO_DISPLAY) {
+		eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+	} else {
+		eglMakeCurrent(prev_display, prev_draw, prev_read, prev_context);
+	}
+}
+
+static void wlr_gles2_destroy(struct wlr_renderer *_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)_renderer;
+	if (renderer->batch.vbo) {
+		delete_batch_buffers(renderer);
+	}
+	free(renderer);
+}
+
 static struct wlr_renderer_impl wlr_renderer_impl = {
 	.begin = wlr_gles2_begin,
+	.begin_with_damage = wlr_gles2_begin_with_damage,
 	.end = wlr_gles2_end,
+	.scissor = wlr_gles2_scissor,
 	.texture_create = wlr_gles2_texture_create,
 	.render_with_matrix = wlr_gles2_render_texture,
+	.render_with_matrix_opaque = wlr_gles2_render_texture_opaque,
 	.render_quad = wlr_gles2_render_quad,
 	.render_ellipse = wlr_gles2_render_ellipse,
 	.formats = wlr_gles2_formats,
 	.buffer_is_drm = wlr_gles2_buffer_is_drm,
 	.read_pixels = wlr_gles2_read_pixels,
+	.destroy = wlr_gles2_destroy,
 };
 
 struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_backend *backend) {
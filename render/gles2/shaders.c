@@ -1,33 +1,21 @@
 #include "render/gles2.h"
 #include <GLES2/gl2.h>
 
-// Colored quads
-const GLchar quad_vertex_src[] =
-"uniform mat4 proj;"
-"uniform vec4 color;"
+// All quads share the vertex shader, positions are transformed on the CPU so
+// that quads with different matrices can be drawn with a single call
+const GLchar vertex_src[] =
 "attribute vec2 pos;"
 "attribute vec2 texcoord;"
-"varying vec4 v_color;"
+"attribute vec4 color;"
 "varying vec2 v_texcoord;"
-"mat4 transpose(in mat4 inMatrix) {"
-"    vec4 i0 = inMatrix[0];"
-"    vec4 i1 = inMatrix[1];"
-"    vec4 i2 = inMatrix[2];"
-"    vec4 i3 = inMatrix[3];"
-"    mat4 outMatrix = mat4("
-"                 vec4(i0.x, i1.x, i2.x, i3.x),"
-"                 vec4(i0.y, i1.y, i2.y, i3.y),"
-"                 vec4(i0.z, i1.z, i2.z, i3.z),"
-"                 vec4(i0.w, i1.w, i2.w, i3.w)"
-"                 );"
-"    return outMatrix;"
-"}"
+"varying vec4 v_color;"
 "void main() {"
-"  gl_Position = transpose(proj) * vec4(pos, 0.0, 1.0);"
-"  v_color = color;"
-"  v_texcoord = texcoord;"
+"	gl_Position = vec4(pos, 0.0, 1.0);"
+"	v_texcoord = texcoord;"
+"	v_color = color;"
 "}";
 
+// Colored quads
 const GLchar quad_fragment_src[] =
 "precision mediump float;"
 "varying vec4 v_color;"
@@ -47,48 +35,24 @@ const GLchar ellipse_fragment_src[] =
 "  gl_FragColor = v_color;"
 "}";
 
-// Textured quads
-const GLchar vertex_src[] =
-"uniform mat4 proj;"
-"attribute vec2 pos;"
-"attribute vec2 texcoord;"
-"varying vec2 v_texcoord;"
-"mat4 transpose(in mat4 inMatrix) {"
-"    vec4 i0 = inMatrix[0];"
-"    vec4 i1 = inMatrix[1];"
-"    vec4 i2 = inMatrix[2];"
-"    vec4 i3 = inMatrix[3];"
-"    mat4 outMatrix = mat4("
-"                 vec4(i0.x, i1.x, i2.x, i3.x),"
-"                 vec4(i0.y, i1.y, i2.y, i3.y),"
-"                 vec4(i0.z, i1.z, i2.z, i3.z),"
-"                 vec4(i0.w, i1.w, i2.w, i3.w)"
-"                 );"
-""
-"    return outMatrix;"
-"}"
-"void main() {"
-"	gl_Position = transpose(proj) * vec4(pos, 0.0, 1.0);"
-"	v_texcoord = texcoord;"
-"}";
-
+// Textured quads, the alpha is the one of the vertex color
 const GLchar fragment_src_rgba[] =
 "precision mediump float;"
 "varying vec2 v_texcoord;"
+"varying vec4 v_color;"
 "uniform sampler2D tex;"
-"uniform float alpha;"
 "void main() {"
-"	gl_FragColor = alpha * texture2D(tex, v_texcoord);"
+"	gl_FragColor = v_color.a * texture2D(tex, v_texcoord);"
 "}";
 
 const GLchar fragment_src_rgbx[] =
 "precision mediump float;"
 "varying vec2 v_texcoord;"
+"varying vec4 v_color;"
 "uniform sampler2D tex;"
-"uniform float alpha;"
 "void main() {"
-"   gl_FragColor.rgb = alpha * texture2D(tex, v_texcoord).rgb;"
-"   gl_FragColor.a = alpha;"
+"   gl_FragColor.rgb = v_color.a * texture2D(tex, v_texcoord).rgb;"
+"   gl_FragColor.a = v_color.a;"
 "}";
 
 const GLchar fragment_src_external[] =
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <wayland-util.h>
@@ -9,6 +10,7 @@
 #include <wlr/render/egl.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/matrix.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
 #include <wlr/util/log.h>
 #include "render/gles2.h"
 
@@ -18,6 +20,7 @@ static struct pixel_format external_pixel_format = {
 	.bpp = 0,
 	.gl_format = 0,
 	.gl_type = 0,
+	.has_alpha = true,
 	.shader = &shaders.external
 };
 
@@ -44,7 +47,10 @@ static bool gles2_texture_upload_pixels(struct wlr_texture *_texture,
 	texture->wlr_texture.width = width;
 	texture->wlr_texture.height = height;
 	texture->wlr_texture.format = format;
+	texture->wlr_texture.has_alpha = fmt->has_alpha;
+	texture->wlr_texture.inverted_y = false;
 	texture->pixel_format = fmt;
+	texture->target = GL_TEXTURE_2D;
 
 	gles2_texture_ensure_texture(texture);
 	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture->tex_id));
@@ -96,7 +102,10 @@ static bool gles2_texture_upload_shm(struct wlr_texture *_texture,
 	texture->wlr_texture.width = width;
 	texture->wlr_texture.height = height;
 	texture->wlr_texture.format = format;
+	texture->wlr_texture.has_alpha = fmt->has_alpha;
+	texture->wlr_texture.inverted_y = false;
 	texture->pixel_format = fmt;
+	texture->target = GL_TEXTURE_2D;
 
 	gles2_texture_ensure_texture(texture);
 	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture->tex_id));
@@ -107,12 +116,32 @@ static bool gles2_texture_upload_shm(struct wlr_texture *_texture,
 				fmt->gl_format, fmt->gl_type, pixels));
 
 	texture->wlr_texture.valid = true;
+	texture->wlr_texture.upload_bytes = (size_t)height * width * fmt->bpp / 8;
 	wl_shm_buffer_end_access(buffer);
 	return true;
 }
 
+// Each glTexSubImage2D call costs about as much as uploading this many more
+// pixels, so merging rectangles is worth it as long as it wastes fewer
+static const int64_t upload_call_cost = 4096;
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void upload_box(struct wlr_gles2_texture *texture,
+		const pixman_box32_t *box, uint8_t *pixels, int stride) {
+	const struct pixel_format *fmt = texture->pixel_format;
+	uint8_t *data = pixels + box->y1 * stride + box->x1 * (fmt->bpp / 8);
+	GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, box->x1, box->y1,
+		box->x2 - box->x1, box->y2 - box->y1,
+		fmt->gl_format, fmt->gl_type, data));
+	texture->wlr_texture.upload_bytes +=
+		box_area(box) * (fmt->bpp / 8);
+}
+
 static bool gles2_texture_update_shm(struct wlr_texture *_texture,
-		uint32_t format, int x, int y, int width, int height,
+		uint32_t format, pixman_region32_t *damage,
 		struct wl_shm_buffer *buffer) {
 	struct wlr_gles2_texture *texture = (struct wlr_gles2_texture *)_texture;
 	// TODO: Test if the unpack subimage extension is supported and adjust the
@@ -126,17 +155,48 @@ static bool gles2_texture_update_shm(struct wlr_texture *_texture,
 	const struct pixel_format *fmt = texture->pixel_format;
 	wl_shm_buffer_begin_access(buffer);
 	uint8_t *pixels = wl_shm_buffer_get_data(buffer);
-	int pitch = wl_shm_buffer_get_stride(buffer) / (fmt->bpp / 8);
+	int stride = wl_shm_buffer_get_stride(buffer);
+
+	texture->wlr_texture.upload_bytes = 0;
+
+	pixman_region32_t clipped;
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, damage, 0, 0,
+		texture->wlr_texture.width, texture->wlr_texture.height);
 
+	int n;
+	pixman_box32_t *rects = pixman_region32_rectangles(&clipped, &n);
+	if (n == 0) {
+		goto out;
+	}
+
+	// The unpack state is set once for all the rectangles, each upload only
+	// points at the start of its rectangle
 	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture->tex_id));
-	GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, pitch));
-	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, x));
-	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, y));
-	GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
-			fmt->gl_format, fmt->gl_type, pixels));
-	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0));
-	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0));
+	GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (fmt->bpp / 8)));
+
+	// Rectangles are sorted by bands, so neighbours are merged greedily
+	pixman_box32_t box = rects[0];
+	for (int i = 1; i < n; ++i) {
+		pixman_box32_t merged = {
+			.x1 = box.x1 < rects[i].x1 ? box.x1 : rects[i].x1,
+			.y1 = box.y1 < rects[i].y1 ? box.y1 : rects[i].y1,
+			.x2 = box.x2 > rects[i].x2 ? box.x2 : rects[i].x2,
+			.y2 = box.y2 > rects[i].y2 ? box.y2 : rects[i].y2,
+		};
+		int64_t wasted = box_area(&merged) - box_area(&box) -
+			box_area(&rects[i]);
+		if (wasted < upload_call_cost) {
+			box = merged;
+		} else {
+			upload_box(texture, &box, pixels, stride);
+			box = rects[i];
+		}
+	}
+	upload_box(texture, &box, pixels, stride);
 
+out:
+	pixman_region32_fini(&clipped);
 	wl_shm_buffer_end_access(buffer);
 
 	return true;
@@ -201,6 +261,9 @@ static bool gles2_texture_upload_drm(struct wlr_texture *_tex,
 	GL_CALL(glEGLImageTargetTexture2DOES(target, tex->image));
 	tex->wlr_texture.valid = true;
 	tex->pixel_format = pf;
+	tex->target = target;
+	tex->wlr_texture.has_alpha = format != EGL_TEXTURE_RGB;
+	tex->wlr_texture.inverted_y = false;
 
 	return true;
 }
@@ -211,6 +274,9 @@ static bool gles2_texture_upload_eglimage(struct wlr_texture *wlr_tex,
 
 	tex->image = image;
 	tex->pixel_format = &external_pixel_format;
+	tex->target = GL_TEXTURE_EXTERNAL_OES;
+	tex->wlr_texture.has_alpha = true;
+	tex->wlr_texture.inverted_y = false;
 	tex->wlr_texture.valid = true;
 	tex->wlr_texture.width = width;
 	tex->wlr_texture.height = height;
@@ -224,6 +290,44 @@ static bool gles2_texture_upload_eglimage(struct wlr_texture *wlr_tex,
 	return true;
 }
 
+static bool gles2_texture_upload_dmabuf(struct wlr_texture *_tex,
+		struct wl_resource *dmabuf_resource) {
+	struct wlr_gles2_texture *tex = (struct wlr_gles2_texture *)_tex;
+	struct wlr_dmabuf_buffer *dmabuf =
+		wlr_dmabuf_buffer_from_buffer_resource(dmabuf_resource);
+
+	if (!tex->egl->has_dmabuf_import) {
+		return false;
+	}
+
+	EGLImageKHR image = wlr_egl_create_image_from_dmabuf(tex->egl,
+		&dmabuf->attributes);
+	if (image == EGL_NO_IMAGE_KHR) {
+		wlr_log(L_ERROR, "failed to create egl image from dmabuf: %s",
+			egl_error());
+		return false;
+	}
+
+	if (tex->image) {
+		wlr_egl_destroy_image(tex->egl, tex->image);
+	}
+
+	if (!gles2_texture_upload_eglimage(_tex, image,
+			dmabuf->attributes.width, dmabuf->attributes.height)) {
+		return false;
+	}
+	tex->wlr_texture.inverted_y = dmabuf->attributes.flags &
+		WLR_DMABUF_BUFFER_ATTRIBS_FLAGS_Y_INVERT;
+
+	switch (dmabuf->attributes.format) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_XBGR8888:
+		tex->wlr_texture.has_alpha = false;
+		break;
+	}
+	return true;
+}
+
 static void gles2_texture_get_matrix(struct wlr_texture *_texture,
 		float (*matrix)[16], const float (*projection)[16], int x, int y) {
 	struct wlr_gles2_texture *texture = (struct wlr_gles2_texture *)_texture;
@@ -234,6 +338,12 @@ static void gles2_texture_get_matrix(struct wlr_texture *_texture,
 	wlr_matrix_scale(&world,
 			texture->wlr_texture.width, texture->wlr_texture.height, 1);
 	wlr_matrix_mul(matrix, &world, matrix);
+	if (texture->wlr_texture.inverted_y) {
+		wlr_matrix_translate(&world, 0, 1, 0);
+		wlr_matrix_mul(matrix, &world, matrix);
+		wlr_matrix_scale(&world, 1, -1, 1);
+		wlr_matrix_mul(matrix, &world, matrix);
+	}
 	wlr_matrix_mul(projection, matrix, matrix);
 }
 
@@ -241,6 +351,14 @@ static void gles2_texture_get_buffer_size(struct wlr_texture *texture, struct
 		wl_resource *resource, int *width, int *height) {
 	struct wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
 	if (!buffer) {
+		if (wlr_dmabuf_resource_is_buffer(resource)) {
+			struct wlr_dmabuf_buffer *dmabuf =
+				wlr_dmabuf_buffer_from_buffer_resource(resource);
+			*width = dmabuf->attributes.width;
+			*height = dmabuf->attributes.height;
+			return;
+		}
+
 		struct wlr_gles2_texture *tex = (struct wlr_gles2_texture *)texture;
 		if (!glEGLImageTargetTexture2DOES) {
 			return;
@@ -263,9 +381,9 @@ static void gles2_texture_get_buffer_size(struct wlr_texture *texture, struct
 
 static void gles2_texture_bind(struct wlr_texture *_texture) {
 	struct wlr_gles2_texture *texture = (struct wlr_gles2_texture *)_texture;
-	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture->tex_id));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CALL(glBindTexture(texture->target, texture->tex_id));
+	GL_CALL(glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	GL_CALL(glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
 	GL_CALL(glUseProgram(*texture->pixel_format->shader));
 }
 
@@ -290,6 +408,7 @@ static struct wlr_texture_impl wlr_texture_impl = {
 	.update_shm = gles2_texture_update_shm,
 	.upload_drm = gles2_texture_upload_drm,
 	.upload_eglimage = gles2_texture_upload_eglimage,
+	.upload_dmabuf = gles2_texture_upload_dmabuf,
 	.get_matrix = gles2_texture_get_matrix,
 	.get_buffer_size = gles2_texture_get_buffer_size,
 	.bind = gles2_texture_bind,
@@ -303,5 +422,6 @@ struct wlr_texture *gles2_texture_create(struct wlr_egl *egl) {
 	}
 	wlr_texture_init(&texture->wlr_texture, &wlr_texture_impl);
 	texture->egl = egl;
+	texture->target = GL_TEXTURE_2D;
 	return &texture->wlr_texture;
 }
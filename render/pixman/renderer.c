@@ -0,0 +1,410 @@
+#define _XOPEN_SOURCE 700
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+// Number of segments used to approximate ellipses
+#define ELLIPSE_SEGMENTS 64
+
+static struct wlr_renderer_impl wlr_renderer_impl;
+
+// Target of all pixman renderers, like the current EGL surface for GLES2
+static pixman_image_t *current_image = NULL;
+
+void wlr_pixman_make_current(pixman_image_t *image) {
+	if (image != NULL) {
+		pixman_image_ref(image);
+	}
+	if (current_image != NULL) {
+		pixman_image_unref(current_image);
+	}
+	current_image = image;
+}
+
+pixman_image_t *wlr_pixman_get_current(void) {
+	return current_image;
+}
+
+/**
+ * Returns the current image if it can hold a frame for this output.
+ */
+static pixman_image_t *get_output_target(struct wlr_output *output) {
+	if (current_image == NULL) {
+		wlr_log(L_ERROR, "No pixman image is current");
+		return NULL;
+	}
+	if (pixman_image_get_width(current_image) != output->width ||
+			pixman_image_get_height(current_image) != output->height) {
+		wlr_log(L_ERROR, "Current pixman image doesn't match the output size");
+		return NULL;
+	}
+	return current_image;
+}
+
+/**
+ * Converts a box in framebuffer coordinates, which have their origin at the
+ * bottom left like in GL, to image coordinates.
+ */
+static void framebuffer_box_to_image(pixman_image_t *image,
+		const struct wlr_box *box, pixman_box32_t *dest) {
+	int height = pixman_image_get_height(image);
+	dest->x1 = box->x;
+	dest->y1 = height - box->y - box->height;
+	dest->x2 = box->x + box->width;
+	dest->y2 = height - box->y;
+}
+
+/**
+ * Maps a point of the unit square through `matrix`, to image coordinates.
+ */
+static void project_point(pixman_image_t *image, const float (*matrix)[16],
+		double u, double v, double *x, double *y) {
+	const float *m = *matrix;
+	double nx = m[0] * u + m[1] * v + m[3];
+	double ny = m[4] * u + m[5] * v + m[7];
+	*x = (nx + 1) / 2 * pixman_image_get_width(image);
+	*y = (1 - ny) / 2 * pixman_image_get_height(image);
+}
+
+static void clear_region(pixman_image_t *image, pixman_region32_t *region) {
+	// TODO: let users customize the clear color?
+	static const pixman_color_t clear_color = {
+		.red = 0x4000,
+		.green = 0x4000,
+		.blue = 0x4000,
+		.alpha = 0xffff,
+	};
+	int n;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &n);
+	pixman_image_fill_boxes(PIXMAN_OP_SRC, image, &clear_color, n, rects);
+}
+
+static void pixman_begin(struct wlr_renderer *_renderer,
+		struct wlr_output *output) {
+	struct wlr_pixman_renderer *renderer =
+		(struct wlr_pixman_renderer *)_renderer;
+	pixman_image_t *image = get_output_target(output);
+	if (image == NULL) {
+		return;
+	}
+
+	pixman_region32_fini(&renderer->damage);
+	pixman_region32_init_rect(&renderer->damage, 0, 0,
+		pixman_image_get_width(image), pixman_image_get_height(image));
+	pixman_image_set_clip_region32(image, NULL);
+	clear_region(image, &renderer->damage);
+}
+
+static void pixman_begin_with_damage(struct wlr_renderer *_renderer,
+		struct wlr_output *output, pixman_region32_t *damage) {
+	struct wlr_pixman_renderer *renderer =
+		(struct wlr_pixman_renderer *)_renderer;
+	pixman_image_t *image = get_output_target(output);
+	if (image == NULL) {
+		return;
+	}
+
+	pixman_region32_clear(&renderer->damage);
+	int n;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &n);
+	for (int i = 0; i < n; ++i) {
+		struct wlr_box box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		wlr_output_project_box(output, &box, &box);
+		pixman_box32_t image_box;
+		framebuffer_box_to_image(image, &box, &image_box);
+		pixman_region32_union_rect(&renderer->damage, &renderer->damage,
+			image_box.x1, image_box.y1, image_box.x2 - image_box.x1,
+			image_box.y2 - image_box.y1);
+	}
+
+	// Only the damage is cleared and drawn to, the rest of the image still
+	// holds the previous frame
+	pixman_image_set_clip_region32(image, &renderer->damage);
+	clear_region(image, &renderer->damage);
+}
+
+static void pixman_end(struct wlr_renderer *renderer) {
+	// The image stays current for wlr_renderer_read_pixels and for the
+	// software cursor, which is drawn after the frame
+	if (current_image != NULL) {
+		pixman_image_set_clip_region32(current_image, NULL);
+	}
+}
+
+static void pixman_scissor(struct wlr_renderer *_renderer,
+		struct wlr_box *box) {
+	struct wlr_pixman_renderer *renderer =
+		(struct wlr_pixman_renderer *)_renderer;
+	pixman_image_t *image = current_image;
+	if (image == NULL) {
+		return;
+	}
+
+	if (box == NULL) {
+		pixman_image_set_clip_region32(image, &renderer->damage);
+		return;
+	}
+
+	pixman_box32_t image_box;
+	framebuffer_box_to_image(image, box, &image_box);
+	pixman_region32_t clip;
+	pixman_region32_init_rect(&clip, image_box.x1, image_box.y1,
+		image_box.x2 - image_box.x1, image_box.y2 - image_box.y1);
+	pixman_region32_intersect(&clip, &clip, &renderer->damage);
+	pixman_image_set_clip_region32(image, &clip);
+	pixman_region32_fini(&clip);
+}
+
+static struct wlr_texture *pixman_texture_create_impl(
+		struct wlr_renderer *renderer) {
+	return pixman_texture_create();
+}
+
+static bool is_integer(double x) {
+	return fabs(x - round(x)) < 1e-6;
+}
+
+static bool render_texture(struct wlr_texture *_texture,
+		const float (*matrix)[16], bool opaque) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	if (!_texture || !_texture->valid) {
+		wlr_log(L_ERROR, "attempt to render invalid texture");
+		return false;
+	}
+	pixman_image_t *dst = current_image;
+	if (dst == NULL) {
+		return false;
+	}
+
+	// Texture pixels to image pixels
+	double x0, y0, x1, y1, x2, y2;
+	project_point(dst, matrix, 0, 0, &x0, &y0);
+	project_point(dst, matrix, 1, 0, &x1, &y1);
+	project_point(dst, matrix, 0, 1, &x2, &y2);
+	struct pixman_f_transform ftransform = {{
+		{ (x1 - x0) / _texture->width, (x2 - x0) / _texture->height, x0 },
+		{ (y1 - y0) / _texture->width, (y2 - y0) / _texture->height, y0 },
+		{ 0, 0, 1 },
+	}};
+
+	// pixman maps destination pixels to source pixels
+	struct pixman_f_transform finverse;
+	if (!pixman_f_transform_invert(&finverse, &ftransform)) {
+		return true;
+	}
+	pixman_transform_t transform;
+	pixman_transform_from_pixman_f_transform(&transform, &finverse);
+
+	// Untransformed or rotated by a multiple of 90 degrees and on the pixel
+	// grid, no filtering needed
+	bool exact = true;
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			exact = exact && is_integer(ftransform.m[i][j]);
+		}
+	}
+
+	double x3 = x1 + x2 - x0, y3 = y1 + y2 - y0;
+	int bx1 = floor(fmin(fmin(x0, x1), fmin(x2, x3)));
+	int by1 = floor(fmin(fmin(y0, y1), fmin(y2, y3)));
+	int bx2 = ceil(fmax(fmax(x0, x1), fmax(x2, x3)));
+	int by2 = ceil(fmax(fmax(y0, y1), fmax(y2, y3)));
+
+	pixman_image_t *src = pixman_texture_begin_access(texture);
+	if (src == NULL) {
+		return false;
+	}
+	pixman_image_set_transform(src, &transform);
+	pixman_image_set_filter(src,
+		exact ? PIXMAN_FILTER_NEAREST : PIXMAN_FILTER_BILINEAR, NULL, 0);
+	pixman_image_set_repeat(src, PIXMAN_REPEAT_NONE);
+	// Filtered edges are blended with the transparent outside of the texture
+	pixman_op_t op = exact && (opaque || !_texture->has_alpha) ?
+		PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+	pixman_image_composite32(op, src, NULL, dst,
+		bx1, by1, 0, 0, bx1, by1, bx2 - bx1, by2 - by1);
+	pixman_image_set_transform(src, NULL);
+	pixman_texture_end_access(texture);
+	return true;
+}
+
+static bool pixman_render_texture(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const float (*matrix)[16]) {
+	return render_texture(texture, matrix, false);
+}
+
+static bool pixman_render_texture_opaque(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const float (*matrix)[16]) {
+	return render_texture(texture, matrix, true);
+}
+
+static void set_point(pixman_point_fixed_t *p, double x, double y) {
+	p->x = pixman_double_to_fixed(x);
+	p->y = pixman_double_to_fixed(y);
+}
+
+static void fill_triangles(pixman_image_t *dst, const float (*color)[4],
+		const pixman_triangle_t *tris, int n) {
+	// pixman colors are premultiplied
+	float a = (*color)[3];
+	pixman_color_t pcolor = {
+		.red = (*color)[0] * a * 0xffff,
+		.green = (*color)[1] * a * 0xffff,
+		.blue = (*color)[2] * a * 0xffff,
+		.alpha = a * 0xffff,
+	};
+	pixman_image_t *src = pixman_image_create_solid_fill(&pcolor);
+	if (src == NULL) {
+		return;
+	}
+	pixman_composite_triangles(PIXMAN_OP_OVER, src, dst,
+		PIXMAN_a8, 0, 0, 0, 0, n, tris);
+	pixman_image_unref(src);
+}
+
+static void pixman_render_quad(struct wlr_renderer *renderer,
+		const float (*color)[4], const float (*matrix)[16]) {
+	pixman_image_t *dst = current_image;
+	if (dst == NULL) {
+		return;
+	}
+
+	double x[4], y[4];
+	project_point(dst, matrix, 0, 0, &x[0], &y[0]);
+	project_point(dst, matrix, 1, 0, &x[1], &y[1]);
+	project_point(dst, matrix, 1, 1, &x[2], &y[2]);
+	project_point(dst, matrix, 0, 1, &x[3], &y[3]);
+
+	pixman_triangle_t tris[2];
+	set_point(&tris[0].p1, x[0], y[0]);
+	set_point(&tris[0].p2, x[1], y[1]);
+	set_point(&tris[0].p3, x[2], y[2]);
+	set_point(&tris[1].p1, x[0], y[0]);
+	set_point(&tris[1].p2, x[2], y[2]);
+	set_point(&tris[1].p3, x[3], y[3]);
+	fill_triangles(dst, color, tris, 2);
+}
+
+static void pixman_render_ellipse(struct wlr_renderer *renderer,
+		const float (*color)[4], const float (*matrix)[16]) {
+	pixman_image_t *dst = current_image;
+	if (dst == NULL) {
+		return;
+	}
+
+	// Triangle fan around the center of the unit square
+	double cx, cy;
+	project_point(dst, matrix, 0.5, 0.5, &cx, &cy);
+	pixman_triangle_t tris[ELLIPSE_SEGMENTS];
+	double px, py;
+	project_point(dst, matrix, 1, 0.5, &px, &py);
+	for (int i = 0; i < ELLIPSE_SEGMENTS; ++i) {
+		double angle = 2 * M_PI * (i + 1) / ELLIPSE_SEGMENTS;
+		double x, y;
+		project_point(dst, matrix, 0.5 + cos(angle) / 2,
+			0.5 + sin(angle) / 2, &x, &y);
+		set_point(&tris[i].p1, cx, cy);
+		set_point(&tris[i].p2, px, py);
+		set_point(&tris[i].p3, x, y);
+		px = x;
+		py = y;
+	}
+	fill_triangles(dst, color, tris, ELLIPSE_SEGMENTS);
+}
+
+static const enum wl_shm_format *pixman_formats(
+		struct wlr_renderer *renderer, size_t *len) {
+	static enum wl_shm_format formats[] = {
+		WL_SHM_FORMAT_ARGB8888,
+		WL_SHM_FORMAT_XRGB8888,
+		WL_SHM_FORMAT_ABGR8888,
+		WL_SHM_FORMAT_XBGR8888,
+	};
+	*len = sizeof(formats) / sizeof(formats[0]);
+	return formats;
+}
+
+static bool pixman_buffer_is_drm(struct wlr_renderer *renderer,
+		struct wl_resource *buffer) {
+	return false;
+}
+
+static void pixman_read_pixels(struct wlr_renderer *renderer, int x, int y,
+		int width, int height, void *out_data) {
+	pixman_image_t *image = current_image;
+	if (image == NULL) {
+		return;
+	}
+
+	// Like glReadPixels, (x, y) is the bottom left corner and rows are
+	// stored bottom to top
+	uint32_t *out = out_data;
+	pixman_image_t *dst = pixman_image_create_bits(PIXMAN_a8r8g8b8,
+		width, height, out, width * 4);
+	if (dst == NULL) {
+		return;
+	}
+	struct pixman_transform flip;
+	pixman_transform_init_identity(&flip);
+	pixman_transform_scale(&flip, NULL, pixman_int_to_fixed(1),
+		pixman_int_to_fixed(-1));
+	pixman_transform_translate(&flip, NULL, 0,
+		pixman_int_to_fixed(pixman_image_get_height(image) - y));
+	pixman_image_set_transform(image, &flip);
+	pixman_image_composite32(PIXMAN_OP_SRC, image, NULL, dst,
+		x, 0, 0, 0, 0, 0, width, height);
+	pixman_image_set_transform(image, NULL);
+	pixman_image_unref(dst);
+}
+
+static void pixman_destroy(struct wlr_renderer *_renderer) {
+	struct wlr_pixman_renderer *renderer =
+		(struct wlr_pixman_renderer *)_renderer;
+	pixman_region32_fini(&renderer->damage);
+	free(renderer);
+}
+
+static struct wlr_renderer_impl wlr_renderer_impl = {
+	.begin = pixman_begin,
+	.begin_with_damage = pixman_begin_with_damage,
+	.end = pixman_end,
+	.scissor = pixman_scissor,
+	.texture_create = pixman_texture_create_impl,
+	.render_with_matrix = pixman_render_texture,
+	.render_with_matrix_opaque = pixman_render_texture_opaque,
+	.render_quad = pixman_render_quad,
+	.render_ellipse = pixman_render_ellipse,
+	.formats = pixman_formats,
+	.buffer_is_drm = pixman_buffer_is_drm,
+	.read_pixels = pixman_read_pixels,
+	.destroy = pixman_destroy,
+};
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *renderer) {
+	return renderer->impl == &wlr_renderer_impl;
+}
+
+struct wlr_renderer *wlr_pixman_renderer_create(void) {
+	struct wlr_pixman_renderer *renderer;
+	if (!(renderer = calloc(1, sizeof(struct wlr_pixman_renderer)))) {
+		return NULL;
+	}
+	wlr_renderer_init(&renderer->wlr_renderer, &wlr_renderer_impl);
+	pixman_region32_init(&renderer->damage);
+	return &renderer->wlr_renderer;
+}
@@ -0,0 +1,326 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/matrix.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+static const struct {
+	enum wl_shm_format wl_format;
+	pixman_format_code_t pixman_format;
+	bool has_alpha;
+} formats[] = {
+	{ WL_SHM_FORMAT_ARGB8888, PIXMAN_a8r8g8b8, true },
+	{ WL_SHM_FORMAT_XRGB8888, PIXMAN_x8r8g8b8, false },
+	{ WL_SHM_FORMAT_ABGR8888, PIXMAN_a8b8g8r8, true },
+	{ WL_SHM_FORMAT_XBGR8888, PIXMAN_x8b8g8r8, false },
+};
+
+pixman_format_code_t pixman_format_for_wl_format(enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		if (formats[i].wl_format == fmt) {
+			return formats[i].pixman_format;
+		}
+	}
+	return 0;
+}
+
+static bool format_has_alpha(enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		if (formats[i].wl_format == fmt) {
+			return formats[i].has_alpha;
+		}
+	}
+	return true;
+}
+
+static void pixman_texture_release(struct wlr_pixman_texture *texture) {
+	if (texture->buffer) {
+		wl_list_remove(&texture->buffer_destroy.link);
+		texture->buffer = NULL;
+	} else if (texture->image) {
+		pixman_image_unref(texture->image);
+	}
+	texture->image = NULL;
+	texture->wlr_texture.valid = false;
+}
+
+static bool pixman_texture_upload_pixels(struct wlr_texture *_texture,
+		enum wl_shm_format format, int stride, int width, int height,
+		const unsigned char *pixels) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	pixman_format_code_t fmt = pixman_format_for_wl_format(format);
+	if (!fmt) {
+		wlr_log(L_ERROR, "No supported pixel format for this texture");
+		return false;
+	}
+	pixman_texture_release(texture);
+
+	texture->image = pixman_image_create_bits_no_clear(fmt, width, height,
+		NULL, 0);
+	if (!texture->image) {
+		wlr_log(L_ERROR, "Failed to allocate texture image");
+		return false;
+	}
+
+	// stride is given in pixels
+	int bytes_pp = PIXMAN_FORMAT_BPP(fmt) / 8;
+	uint8_t *dst = (uint8_t *)pixman_image_get_data(texture->image);
+	int dst_stride = pixman_image_get_stride(texture->image);
+	for (int y = 0; y < height; ++y) {
+		memcpy(dst + y * dst_stride, pixels + y * stride * bytes_pp,
+			width * bytes_pp);
+	}
+
+	texture->wlr_texture.width = width;
+	texture->wlr_texture.height = height;
+	texture->wlr_texture.format = format;
+	texture->wlr_texture.has_alpha = format_has_alpha(format);
+	texture->wlr_texture.valid = true;
+	return true;
+}
+
+static void copy_box(struct wlr_pixman_texture *texture,
+		const unsigned char *pixels, int stride, int x, int y,
+		int width, int height) {
+	int bytes_pp = PIXMAN_FORMAT_BPP(pixman_image_get_format(texture->image))
+		/ 8;
+	uint8_t *dst = (uint8_t *)pixman_image_get_data(texture->image);
+	int dst_stride = pixman_image_get_stride(texture->image);
+	for (int i = y; i < y + height; ++i) {
+		memcpy(dst + i * dst_stride + x * bytes_pp,
+			pixels + i * stride + x * bytes_pp, width * bytes_pp);
+	}
+}
+
+static bool pixman_texture_update_pixels(struct wlr_texture *_texture,
+		enum wl_shm_format format, int stride, int x, int y,
+		int width, int height, const unsigned char *pixels) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	if (!texture->wlr_texture.valid || texture->buffer ||
+			texture->wlr_texture.format != format) {
+		return pixman_texture_upload_pixels(&texture->wlr_texture,
+			format, stride, width, height, pixels);
+	}
+	int bytes_pp = PIXMAN_FORMAT_BPP(pixman_image_get_format(texture->image))
+		/ 8;
+	copy_box(texture, pixels, stride * bytes_pp, x, y, width, height);
+	return true;
+}
+
+static bool pixman_texture_upload_shm(struct wlr_texture *_texture,
+		uint32_t format, struct wl_shm_buffer *buffer) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	pixman_format_code_t fmt = pixman_format_for_wl_format(format);
+	if (!fmt) {
+		wlr_log(L_ERROR, "No supported pixel format for this texture");
+		return false;
+	}
+
+	wl_shm_buffer_begin_access(buffer);
+	const unsigned char *pixels = wl_shm_buffer_get_data(buffer);
+	int width = wl_shm_buffer_get_width(buffer);
+	int height = wl_shm_buffer_get_height(buffer);
+	int pitch = wl_shm_buffer_get_stride(buffer) / (PIXMAN_FORMAT_BPP(fmt) / 8);
+	bool ok = pixman_texture_upload_pixels(&texture->wlr_texture, format,
+		pitch, width, height, pixels);
+	wl_shm_buffer_end_access(buffer);
+
+	if (ok) {
+		texture->wlr_texture.upload_bytes =
+			(size_t)height * width * PIXMAN_FORMAT_BPP(fmt) / 8;
+	}
+	return ok;
+}
+
+static bool pixman_texture_update_shm(struct wlr_texture *_texture,
+		uint32_t format, pixman_region32_t *damage,
+		struct wl_shm_buffer *buffer) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	int width = wl_shm_buffer_get_width(buffer);
+	int height = wl_shm_buffer_get_height(buffer);
+	if (!texture->wlr_texture.valid || texture->buffer ||
+			texture->wlr_texture.format != format ||
+			texture->wlr_texture.width != width ||
+			texture->wlr_texture.height != height) {
+		return pixman_texture_upload_shm(_texture, format, buffer);
+	}
+
+	pixman_region32_t clipped;
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, damage, 0, 0, width, height);
+
+	wl_shm_buffer_begin_access(buffer);
+	const unsigned char *pixels = wl_shm_buffer_get_data(buffer);
+	int stride = wl_shm_buffer_get_stride(buffer);
+	int bytes_pp = PIXMAN_FORMAT_BPP(pixman_image_get_format(texture->image))
+		/ 8;
+
+	size_t upload_bytes = 0;
+	int n;
+	pixman_box32_t *rects = pixman_region32_rectangles(&clipped, &n);
+	for (int i = 0; i < n; ++i) {
+		pixman_box32_t *r = &rects[i];
+		copy_box(texture, pixels, stride, r->x1, r->y1,
+			r->x2 - r->x1, r->y2 - r->y1);
+		upload_bytes += (size_t)(r->x2 - r->x1) * (r->y2 - r->y1) * bytes_pp;
+	}
+
+	wl_shm_buffer_end_access(buffer);
+	pixman_region32_fini(&clipped);
+
+	texture->wlr_texture.upload_bytes = upload_bytes;
+	return true;
+}
+
+static void texture_handle_buffer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_pixman_texture *texture =
+		wl_container_of(listener, texture, buffer_destroy);
+	// The client destroyed the buffer before it was released, the surface
+	// contents are undefined
+	pixman_texture_release(texture);
+}
+
+static bool pixman_texture_import_shm(struct wlr_texture *_texture,
+		struct wl_resource *resource) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	if (resource == NULL) {
+		// The buffer is about to be released to the client
+		if (texture->buffer) {
+			pixman_texture_release(texture);
+		}
+		return false;
+	}
+
+	struct wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
+	if (!buffer) {
+		return false;
+	}
+	enum wl_shm_format format = wl_shm_buffer_get_format(buffer);
+	if (!pixman_format_for_wl_format(format)) {
+		return false;
+	}
+
+	if (texture->buffer != resource) {
+		pixman_texture_release(texture);
+		texture->buffer = resource;
+		wl_resource_add_destroy_listener(resource, &texture->buffer_destroy);
+		texture->buffer_destroy.notify = texture_handle_buffer_destroy;
+	}
+
+	texture->wlr_texture.width = wl_shm_buffer_get_width(buffer);
+	texture->wlr_texture.height = wl_shm_buffer_get_height(buffer);
+	texture->wlr_texture.format = format;
+	texture->wlr_texture.has_alpha = format_has_alpha(format);
+	texture->wlr_texture.valid = true;
+	texture->wlr_texture.upload_bytes = 0;
+	return true;
+}
+
+pixman_image_t *pixman_texture_begin_access(
+		struct wlr_pixman_texture *texture) {
+	if (!texture->wlr_texture.valid) {
+		return NULL;
+	}
+	if (!texture->buffer) {
+		return texture->image;
+	}
+
+	// The pool may have been resized and remapped since the buffer was
+	// imported, so the image is created anew for each access
+	struct wl_shm_buffer *buffer = wl_shm_buffer_get(texture->buffer);
+	wl_shm_buffer_begin_access(buffer);
+	texture->image = pixman_image_create_bits_no_clear(
+		pixman_format_for_wl_format(wl_shm_buffer_get_format(buffer)),
+		wl_shm_buffer_get_width(buffer), wl_shm_buffer_get_height(buffer),
+		wl_shm_buffer_get_data(buffer), wl_shm_buffer_get_stride(buffer));
+	if (!texture->image) {
+		wl_shm_buffer_end_access(buffer);
+	}
+	return texture->image;
+}
+
+void pixman_texture_end_access(struct wlr_pixman_texture *texture) {
+	if (!texture->buffer) {
+		return;
+	}
+	pixman_image_unref(texture->image);
+	texture->image = NULL;
+	wl_shm_buffer_end_access(wl_shm_buffer_get(texture->buffer));
+}
+
+static bool pixman_texture_upload_drm(struct wlr_texture *texture,
+		struct wl_resource *drm_buf) {
+	wlr_log(L_ERROR, "pixman textures can't import wl_drm buffers");
+	return false;
+}
+
+static bool pixman_texture_upload_eglimage(struct wlr_texture *texture,
+		EGLImageKHR image, uint32_t width, uint32_t height) {
+	wlr_log(L_ERROR, "pixman textures can't import EGL images");
+	return false;
+}
+
+static void pixman_texture_get_matrix(struct wlr_texture *texture,
+		float (*matrix)[16], const float (*projection)[16], int x, int y) {
+	float world[16];
+	wlr_matrix_identity(matrix);
+	wlr_matrix_translate(&world, x, y, 0);
+	wlr_matrix_mul(matrix, &world, matrix);
+	wlr_matrix_scale(&world, texture->width, texture->height, 1);
+	wlr_matrix_mul(matrix, &world, matrix);
+	wlr_matrix_mul(projection, matrix, matrix);
+}
+
+static void pixman_texture_get_buffer_size(struct wlr_texture *texture,
+		struct wl_resource *resource, int *width, int *height) {
+	struct wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
+	if (!buffer) {
+		wlr_log(L_ERROR, "could not get size of the buffer "
+			"(not a shm buffer)");
+		return;
+	}
+
+	*width = wl_shm_buffer_get_width(buffer);
+	*height = wl_shm_buffer_get_height(buffer);
+}
+
+static void pixman_texture_bind(struct wlr_texture *texture) {
+	// no-op
+}
+
+static void pixman_texture_destroy(struct wlr_texture *_texture) {
+	struct wlr_pixman_texture *texture = (struct wlr_pixman_texture *)_texture;
+	wl_signal_emit(&texture->wlr_texture.destroy_signal, &texture->wlr_texture);
+	pixman_texture_release(texture);
+	free(texture);
+}
+
+static struct wlr_texture_impl wlr_texture_impl = {
+	.upload_pixels = pixman_texture_upload_pixels,
+	.update_pixels = pixman_texture_update_pixels,
+	.upload_shm = pixman_texture_upload_shm,
+	.update_shm = pixman_texture_update_shm,
+	.import_shm = pixman_texture_import_shm,
+	.upload_drm = pixman_texture_upload_drm,
+	.upload_eglimage = pixman_texture_upload_eglimage,
+	.get_matrix = pixman_texture_get_matrix,
+	.get_buffer_size = pixman_texture_get_buffer_size,
+	.bind = pixman_texture_bind,
+	.destroy = pixman_texture_destroy,
+};
+
+struct wlr_texture *pixman_texture_create(void) {
+	struct wlr_pixman_texture *texture;
+	if (!(texture = calloc(1, sizeof(struct wlr_pixman_texture)))) {
+		return NULL;
+	}
+	wlr_texture_init(&texture->wlr_texture, &wlr_texture_impl);
+	return &texture->wlr_texture;
+}
@@ -19,10 +19,25 @@ void wlr_renderer_begin(struct wlr_renderer *r, struct wlr_output *o) {
 	r->impl->begin(r, o);
 }
 
+void wlr_renderer_begin_with_damage(struct wlr_renderer *r,
+		struct wlr_output *o, pixman_region32_t *damage) {
+	if (damage == NULL || !r->impl->begin_with_damage) {
+		r->impl->begin(r, o);
+		return;
+	}
+	r->impl->begin_with_damage(r, o, damage);
+}
+
 void wlr_renderer_end(struct wlr_renderer *r) {
 	r->impl->end(r);
 }
 
+void wlr_renderer_scissor(struct wlr_renderer *r, struct wlr_box *box) {
+	if (r->impl->scissor) {
+		r->impl->scissor(r, box);
+	}
+}
+
 struct wlr_texture *wlr_render_texture_create(struct wlr_renderer *r) {
 	return r->impl->texture_create(r);
 }
@@ -32,6 +47,14 @@ bool wlr_render_with_matrix(struct wlr_renderer *r,
 	return r->impl->render_with_matrix(r, texture, matrix);
 }
 
+bool wlr_render_with_matrix_opaque(struct wlr_renderer *r,
+		struct wlr_texture *texture, const float (*matrix)[16]) {
+	if (!r->impl->render_with_matrix_opaque) {
+		return r->impl->render_with_matrix(r, texture, matrix);
+	}
+	return r->impl->render_with_matrix_opaque(r, texture, matrix);
+}
+
 void wlr_render_colored_quad(struct wlr_renderer *r,
 		const float (*color)[4], const float (*matrix)[16]) {
 	r->impl->render_quad(r, color, matrix);
@@ -5,6 +5,7 @@
 void wlr_texture_init(struct wlr_texture *texture,
 		struct wlr_texture_impl *impl) {
 	texture->impl = impl;
+	texture->has_alpha = true;
 	wl_signal_init(&texture->destroy_signal);
 }
 
@@ -39,8 +40,16 @@ bool wlr_texture_upload_shm(struct wlr_texture *texture, uint32_t format,
 }
 
 bool wlr_texture_update_shm(struct wlr_texture *texture, uint32_t format,
-		int x, int y, int width, int height, struct wl_shm_buffer *shm) {
-	return texture->impl->update_shm(texture, format, x, y, width, height, shm);
+		pixman_region32_t *damage, struct wl_shm_buffer *shm) {
+	return texture->impl->update_shm(texture, format, damage, shm);
+}
+
+bool wlr_texture_import_shm(struct wlr_texture *texture,
+		struct wl_resource *shm_buffer) {
+	if (!texture->impl->import_shm) {
+		return false;
+	}
+	return texture->impl->import_shm(texture, shm_buffer);
 }
 
 bool wlr_texture_upload_drm(struct wlr_texture *texture,
@@ -53,6 +62,14 @@ bool wlr_texture_upload_eglimage(struct wlr_texture *texture,
 	return texture->impl->upload_eglimage(texture, image, width, height);
 }
 
+bool wlr_texture_upload_dmabuf(struct wlr_texture *texture,
+		struct wl_resource *dmabuf_resource) {
+	if (!texture->impl->upload_dmabuf) {
+		return false;
+	}
+	return texture->impl->upload_dmabuf(texture, dmabuf_resource);
+}
+
 void wlr_texture_get_matrix(struct wlr_texture *texture,
 		float (*matrix)[16], const float (*projection)[16], int x, int y) {
 	texture->impl->get_matrix(texture, matrix, projection, x, y);
@@ -198,9 +198,23 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 					config->xwayland = true;
 			   } else if (strcasecmp(value, "false") == 0) {
 					config->xwayland = false;
+			   } else if (strcasecmp(value, "lazy") == 0) {
+					config->xwayland = true;
+					config->xwayland_lazy = true;
 			   } else {
 					wlr_log(L_ERROR, "got unknown xwayland value: %s", value);
 			   }
+		   } else if (strcmp(name, "xwayland-idle-timeout") == 0) {
+			   char *end;
+			   long timeout = strtol(value, &end, 10);
+			   // The timeout is passed on in milliseconds
+			   if (*value == '\0' || *end || timeout < 0 ||
+					   timeout > INT_MAX / 1000) {
+					wlr_log(L_ERROR, "got invalid xwayland-idle-timeout "
+						"value: %s", value);
+			   } else {
+					config->xwayland_idle_timeout = timeout;
+			   }
 		   } else {
 			   wlr_log(L_ERROR, "got unknown core config: %s", name);
 		   }
@@ -260,6 +274,17 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 			wlr_log(L_DEBUG, "Configured output %s with mode %dx%d@%f",
 					oc->name, oc->mode.width, oc->mode.height,
 					oc->mode.refresh_rate);
+		} else if (strcmp(name, "frame-margin") == 0) {
+			char *end;
+			long margin = strtol(value, &end, 10);
+			if (strcmp(value, "adaptive") == 0) {
+				oc->frame_margin = WLR_OUTPUT_FRAME_MARGIN_ADAPTIVE;
+			} else if (*value == '\0' || *end || margin < 0 ||
+					margin > INT_MAX) {
+				wlr_log(L_ERROR, "got invalid frame-margin value: %s", value);
+			} else {
+				oc->frame_margin = margin;
+			}
 		}
 	} else if (strcmp(section, "cursor") == 0) {
 		if (strcmp(name, "map-to-output") == 0) {
@@ -268,6 +293,15 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 		} else if (strcmp(name, "geometry") == 0) {
 			free(config->cursor.mapped_box);
 			config->cursor.mapped_box = parse_geometry(value);
+		} else if (strcmp(name, "coalesce-motion") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				config->cursor.coalesce_motion = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				config->cursor.coalesce_motion = false;
+			} else {
+				wlr_log(L_ERROR, "got unknown coalesce-motion value: %s",
+					value);
+			}
 		} else {
 			wlr_log(L_ERROR, "got unknown cursor config: %s", name);
 		}
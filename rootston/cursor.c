@@ -102,11 +102,39 @@ void view_begin_rotate(struct roots_input *input, struct wlr_cursor *cursor,
 	}
 }
 
+static void drag_icon_damage_whole(struct roots_input *input,
+		struct roots_drag_icon *icon) {
+	struct roots_output *output;
+	wl_list_for_each(output, &input->server->desktop->outputs, link) {
+		output_damage_whole_drag_icon(output, icon);
+	}
+}
+
+static void drag_icon_update_position(struct roots_input *input,
+		struct roots_drag_icon *icon) {
+	double x = input->cursor->x + icon->sx;
+	double y = input->cursor->y + icon->sy;
+	if (x == icon->x && y == icon->y) {
+		return;
+	}
+
+	drag_icon_damage_whole(input, icon);
+	icon->x = x;
+	icon->y = y;
+	drag_icon_damage_whole(input, icon);
+}
+
 void cursor_update_position(struct roots_input *input, uint32_t time) {
 	struct roots_desktop *desktop = input->server->desktop;
 	struct roots_view *view;
 	struct wlr_surface *surface;
 	double sx, sy;
+
+	struct roots_drag_icon *drag_icon;
+	wl_list_for_each(drag_icon, &input->drag_icons, link) {
+		drag_icon_update_position(input, drag_icon);
+	}
+
 	switch (input->mode) {
 	case ROOTS_CURSOR_PASSTHROUGH:
 		view = view_at(desktop, input->cursor->x, input->cursor->y,
@@ -187,7 +215,9 @@ void cursor_update_position(struct roots_input *input, uint32_t time) {
 			float angle = atan2(vx*uy - vy*ux, vx*ux + vy*uy);
 			int steps = 12;
 			angle = round(angle/M_PI*steps) / (steps/M_PI);
+			view_damage_whole(view);
 			view->rotation = input->view_rotation + angle;
+			view_damage_whole(view);
 		}
 		break;
 	}
@@ -222,6 +252,7 @@ void set_view_focus(struct roots_input *input, struct roots_desktop *desktop,
 	// TODO: list_swap
 	wlr_list_del(desktop->views, index);
 	wlr_list_add(desktop->views, view);
+	view_damage_whole(view);
 	wlr_seat_keyboard_notify_enter(input->wl_seat, view->wlr_surface);
 }
 
@@ -413,6 +444,7 @@ static void handle_tool_tip(struct wl_listener *listener, void *data) {
 static void handle_drag_icon_destroy(struct wl_listener *listener, void *data) {
 	struct roots_drag_icon *drag_icon =
 		wl_container_of(listener, drag_icon, surface_destroy);
+	drag_icon_damage_whole(drag_icon->input, drag_icon);
 	wl_list_remove(&drag_icon->link);
 	wl_list_remove(&drag_icon->surface_destroy.link);
 	wl_list_remove(&drag_icon->surface_commit.link);
@@ -427,6 +459,7 @@ static void handle_drag_icon_commit(struct wl_listener *listener, void *data) {
 	// toolkits to see how we should interpret the surface state here.
 	drag_icon->sx += drag_icon->surface->current->sx;
 	drag_icon->sy += drag_icon->surface->current->sy;
+	drag_icon_update_position(drag_icon->input, drag_icon);
 }
 
 static void handle_pointer_grab_begin(struct wl_listener *listener,
@@ -448,7 +481,10 @@ static void handle_pointer_grab_begin(struct wl_listener *listener,
 
 			struct roots_drag_icon *drag_icon =
 				calloc(1, sizeof(struct roots_drag_icon));
+			drag_icon->input = input;
 			drag_icon->surface = drag->icon;
+			drag_icon->x = input->cursor->x;
+			drag_icon->y = input->cursor->y;
 			wl_list_insert(&input->drag_icons, &drag_icon->link);
 
 			wl_signal_add(&drag->icon->events.destroy,
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_compositor.h>
@@ -16,9 +17,15 @@
 #include "rootston/server.h"
 #include "rootston/server.h"
 
+#define ROOTS_VIEW_INDEX_CELL_SIZE 256
+// Maximum number of columns and rows of the view index
+#define ROOTS_VIEW_INDEX_MAX_CELLS 64
+
 void view_destroy(struct roots_view *view) {
 	struct roots_desktop *desktop = view->desktop;
 
+	view_damage_whole(view);
+
 	struct roots_input *input = desktop->server->input;
 	if (input->active_view == view) {
 		input->active_view = NULL;
@@ -46,13 +53,31 @@ void view_get_size(struct roots_view *view, struct wlr_box *box) {
 }
 
 void view_set_position(struct roots_view *view, double x, double y) {
+	view_damage_whole(view);
 	if (view->set_position) {
 		view->set_position(view, x, y);
-		return;
+	} else {
+		view->x = x;
+		view->y = y;
+	}
+	view_damage_whole(view);
+}
+
+void view_damage_whole(struct roots_view *view) {
+	// Views are damaged whenever they move or their stacking order changes
+	desktop_invalidate_view_index(view->desktop);
+
+	struct roots_output *output;
+	wl_list_for_each(output, &view->desktop->outputs, link) {
+		output_damage_whole_view(output, view);
 	}
+}
 
-	view->x = x;
-	view->y = y;
+void desktop_damage_whole(struct roots_desktop *desktop) {
+	struct roots_output *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		output_damage_whole(output);
+	}
 }
 
 void view_activate(struct roots_view *view, bool activate) {
@@ -125,91 +150,450 @@ void view_teardown(struct roots_view *view) {
 	wlr_seat_keyboard_notify_enter(input->wl_seat, prev_view->wlr_surface);
 }
 
-struct roots_view *view_at(struct roots_desktop *desktop, double lx, double ly,
+/**
+ * Whether view_at should skip this view. Popup views of wl_shell are found via
+ * their parent.
+ */
+static bool view_is_hidden(struct roots_view *view) {
+	return view->wlr_surface == NULL || (view->type == ROOTS_WL_SHELL_VIEW &&
+		view->wl_shell_surface->state == WLR_WL_SHELL_SURFACE_STATE_POPUP);
+}
+
+static bool view_surface_at(struct roots_view *view, double lx, double ly,
 		struct wlr_surface **surface, double *sx, double *sy) {
-	for (int i = desktop->views->length - 1; i >= 0; --i) {
-		struct roots_view *view = desktop->views->items[i];
+	double view_sx = lx - view->x;
+	double view_sy = ly - view->y;
+
+	struct wlr_box box = {
+		.x = 0,
+		.y = 0,
+		.width = view->wlr_surface->current->buffer_width,
+		.height = view->wlr_surface->current->buffer_height,
+	};
+	if (view->rotation != 0.0) {
+		// Coordinates relative to the center of the view
+		double ox = view_sx - (double)box.width/2,
+			oy = view_sy - (double)box.height/2;
+		// Rotated coordinates
+		double rx = cos(view->rotation)*ox - sin(view->rotation)*oy,
+			ry = cos(view->rotation)*oy + sin(view->rotation)*ox;
+		view_sx = rx + (double)box.width/2;
+		view_sy = ry + (double)box.height/2;
+	}
 
-		if (view->type == ROOTS_WL_SHELL_VIEW &&
-				view->wl_shell_surface->state ==
-				WLR_WL_SHELL_SURFACE_STATE_POPUP) {
-			continue;
+	if (view->type == ROOTS_XDG_SHELL_V6_VIEW) {
+		// TODO: test if this works with rotated views
+		double popup_sx, popup_sy;
+		struct wlr_xdg_surface_v6 *popup =
+			wlr_xdg_surface_v6_popup_at(view->xdg_surface_v6,
+				view_sx, view_sy, &popup_sx, &popup_sy);
+
+		if (popup) {
+			*sx = view_sx - popup_sx;
+			*sy = view_sy - popup_sy;
+			*surface = popup->surface;
+			return true;
 		}
+	}
 
-		double view_sx = lx - view->x;
-		double view_sy = ly - view->y;
-
-		struct wlr_box box = {
-			.x = 0,
-			.y = 0,
-			.width = view->wlr_surface->current->buffer_width,
-			.height = view->wlr_surface->current->buffer_height,
-		};
-		if (view->rotation != 0.0) {
-			// Coordinates relative to the center of the view
-			double ox = view_sx - (double)box.width/2,
-				oy = view_sy - (double)box.height/2;
-			// Rotated coordinates
-			double rx = cos(view->rotation)*ox - sin(view->rotation)*oy,
-				ry = cos(view->rotation)*oy + sin(view->rotation)*ox;
-			view_sx = rx + (double)box.width/2;
-			view_sy = ry + (double)box.height/2;
+	if (view->type == ROOTS_WL_SHELL_VIEW) {
+		// TODO: test if this works with rotated views
+		double popup_sx, popup_sy;
+		struct wlr_wl_shell_surface *popup =
+			wlr_wl_shell_surface_popup_at(view->wl_shell_surface,
+				view_sx, view_sy, &popup_sx, &popup_sy);
+
+		if (popup) {
+			*sx = view_sx - popup_sx;
+			*sy = view_sy - popup_sy;
+			*surface = popup->surface;
+			return true;
 		}
+	}
 
-		if (view->type == ROOTS_XDG_SHELL_V6_VIEW) {
-			// TODO: test if this works with rotated views
-			double popup_sx, popup_sy;
-			struct wlr_xdg_surface_v6 *popup =
-				wlr_xdg_surface_v6_popup_at(view->xdg_surface_v6,
-					view_sx, view_sy, &popup_sx, &popup_sy);
-
-			if (popup) {
-				*sx = view_sx - popup_sx;
-				*sy = view_sy - popup_sy;
-				*surface = popup->surface;
-				return view;
+	double sub_x, sub_y;
+	struct wlr_subsurface *subsurface =
+		wlr_surface_subsurface_at(view->wlr_surface,
+			view_sx, view_sy, &sub_x, &sub_y);
+	if (subsurface) {
+		*sx = view_sx - sub_x;
+		*sy = view_sy - sub_y;
+		*surface = subsurface->surface;
+		return true;
+	}
+
+	if (wlr_box_contains_point(&box, view_sx, view_sy) &&
+			pixman_region32_contains_point(
+				&view->wlr_surface->current->input,
+				view_sx, view_sy, NULL)) {
+		*sx = view_sx;
+		*sy = view_sy;
+		*surface = view->wlr_surface;
+		return true;
+	}
+	return false;
+}
+
+static bool view_has_popups(struct roots_view *view) {
+	switch (view->type) {
+	case ROOTS_XDG_SHELL_V6_VIEW:
+		return !wl_list_empty(&view->xdg_surface_v6->popups);
+	case ROOTS_WL_SHELL_VIEW:
+		return !wl_list_empty(&view->wl_shell_surface->popups);
+	case ROOTS_XWAYLAND_VIEW:
+		break;
+	}
+	return false;
+}
+
+/**
+ * Computes a box containing every point of the view view_at can hit, in
+ * layout coordinates. Returns false if the view has popups, they aren't
+ * bounded.
+ */
+static bool view_get_bounds(struct roots_view *view, struct wlr_box *box) {
+	if (view_has_popups(view)) {
+		return false;
+	}
+
+	// The main surface is hit-tested with its buffer size
+	int width = view->wlr_surface->current->buffer_width;
+	int height = view->wlr_surface->current->buffer_height;
+	int x1 = 0, y1 = 0, x2 = width, y2 = height;
+	size_t len;
+	const struct wlr_surface_tree_entry *entries =
+		wlr_surface_get_tree(view->wlr_surface, &len);
+	for (size_t i = 0; i < len; ++i) {
+		const struct wlr_box *b = &entries[i].box;
+		x1 = b->x < x1 ? b->x : x1;
+		y1 = b->y < y1 ? b->y : y1;
+		x2 = b->x + b->width > x2 ? b->x + b->width : x2;
+		y2 = b->y + b->height > y2 ? b->y + b->height : y2;
+	}
+
+	double bx1 = x1, by1 = y1, bx2 = x2, by2 = y2;
+	if (view->rotation != 0.0) {
+		// Rotated around the center of the main surface, the farthest corner
+		// gives a bounding circle
+		double cx = (double)width/2, cy = (double)height/2;
+		double dx = fmax(cx - x1, x2 - cx), dy = fmax(cy - y1, y2 - cy);
+		double r = sqrt(dx*dx + dy*dy);
+		bx1 = cx - r;
+		by1 = cy - r;
+		bx2 = cx + r;
+		by2 = cy + r;
+	}
+
+	box->x = floor(view->x + bx1);
+	box->y = floor(view->y + by1);
+	box->width = ceil(view->x + bx2) - box->x + 1;
+	box->height = ceil(view->y + by2) - box->y + 1;
+	return true;
+}
+
+void desktop_invalidate_view_index(struct roots_desktop *desktop) {
+	desktop->view_index.valid = false;
+	desktop->view_index.last_view = NULL;
+}
+
+void desktop_finish_view_index(struct roots_desktop *desktop) {
+	struct roots_view_index *index = &desktop->view_index;
+	free(index->cells);
+	free(index->views);
+	memset(index, 0, sizeof(struct roots_view_index));
+}
+
+static size_t view_index_cell_at(struct roots_view_index *index, double lx,
+		double ly) {
+	size_t outside = (size_t)index->columns * index->rows;
+	double x = lx - index->extents.x, y = ly - index->extents.y;
+	if (x < 0 || y < 0 || x >= index->extents.width ||
+			y >= index->extents.height) {
+		return outside;
+	}
+	int column = x / index->cell_width, row = y / index->cell_height;
+	if (column >= index->columns || row >= index->rows) {
+		return outside;
+	}
+	return (size_t)row * index->columns + column;
+}
+
+/**
+ * Adds the view to the cells overlapped by the box, or to every cell if the box
+ * is NULL. `next` is the next free slot of each cell, if it is NULL the views
+ * are only counted.
+ */
+static void view_index_add(struct roots_view_index *index,
+		struct roots_view *view, struct wlr_box *box, size_t *next) {
+	size_t outside = (size_t)index->columns * index->rows;
+	int c1 = 0, c2 = index->columns - 1;
+	int r1 = 0, r2 = index->rows - 1;
+	if (box != NULL) {
+		c1 = (box->x - index->extents.x) / index->cell_width;
+		c2 = (box->x + box->width - 1 - index->extents.x) / index->cell_width;
+		r1 = (box->y - index->extents.y) / index->cell_height;
+		r2 = (box->y + box->height - 1 - index->extents.y) /
+			index->cell_height;
+	}
+	for (int row = r1; row <= r2; ++row) {
+		for (int column = c1; column <= c2; ++column) {
+			size_t cell = (size_t)row * index->columns + column;
+			if (next != NULL) {
+				index->views[next[cell]++] = view;
+			} else {
+				++index->cells[cell];
 			}
 		}
+	}
+	if (box == NULL) {
+		if (next != NULL) {
+			index->views[next[outside]++] = view;
+		} else {
+			++index->cells[outside];
+		}
+	}
+}
+
+static bool view_index_rebuild(struct roots_desktop *desktop) {
+	struct roots_view_index *index = &desktop->view_index;
+	struct wlr_list *views = desktop->views;
+
+	struct wlr_box *boxes = calloc(views->length + 1, sizeof(struct wlr_box));
+	bool *bounded = calloc(views->length + 1, sizeof(bool));
+	size_t *next = NULL;
+	if (boxes == NULL || bounded == NULL) {
+		goto error;
+	}
+	int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	bool empty = true;
+	for (size_t i = 0; i < views->length; ++i) {
+		struct roots_view *view = views->items[i];
+		if (view_is_hidden(view) || !view_get_bounds(view, &boxes[i])) {
+			continue;
+		}
+		bounded[i] = true;
+		struct wlr_box *b = &boxes[i];
+		if (empty || b->x < x1) {
+			x1 = b->x;
+		}
+		if (empty || b->y < y1) {
+			y1 = b->y;
+		}
+		if (empty || b->x + b->width > x2) {
+			x2 = b->x + b->width;
+		}
+		if (empty || b->y + b->height > y2) {
+			y2 = b->y + b->height;
+		}
+		empty = false;
+	}
+
+	index->extents.x = x1;
+	index->extents.y = y1;
+	index->extents.width = x2 - x1;
+	index->extents.height = y2 - y1;
+	// Keep the number of cells bounded for views far away from each other
+	index->cell_width = ROOTS_VIEW_INDEX_CELL_SIZE;
+	if (index->extents.width > ROOTS_VIEW_INDEX_MAX_CELLS * index->cell_width) {
+		index->cell_width =
+			index->extents.width / ROOTS_VIEW_INDEX_MAX_CELLS + 1;
+	}
+	index->cell_height = ROOTS_VIEW_INDEX_CELL_SIZE;
+	if (index->extents.height >
+			ROOTS_VIEW_INDEX_MAX_CELLS * index->cell_height) {
+		index->cell_height =
+			index->extents.height / ROOTS_VIEW_INDEX_MAX_CELLS + 1;
+	}
+	index->columns = (index->extents.width + index->cell_width - 1) /
+		index->cell_width;
+	index->rows = (index->extents.height + index->cell_height - 1) /
+		index->cell_height;
+
+	// One more cell for the points outside of the extents
+	size_t ncells = (size_t)index->columns * index->rows + 1;
+	if (ncells + 1 > index->cells_cap) {
+		size_t *cells = realloc(index->cells, (ncells + 1) * sizeof(size_t));
+		if (cells == NULL) {
+			goto error;
+		}
+		index->cells = cells;
+		index->cells_cap = ncells + 1;
+	}
+	memset(index->cells, 0, (ncells + 1) * sizeof(size_t));
+
+	// Count the views of each cell, then turn the counts into offsets
+	for (size_t i = 0; i < views->length; ++i) {
+		struct roots_view *view = views->items[i];
+		if (!view_is_hidden(view)) {
+			view_index_add(index, view, bounded[i] ? &boxes[i] : NULL, NULL);
+		}
+	}
+	size_t total = 0;
+	for (size_t i = 0; i < ncells; ++i) {
+		size_t count = index->cells[i];
+		index->cells[i] = total;
+		total += count;
+	}
+	index->cells[ncells] = total;
 
-		if (view->type == ROOTS_WL_SHELL_VIEW) {
-			// TODO: test if this works with rotated views
-			double popup_sx, popup_sy;
-			struct wlr_wl_shell_surface *popup =
-				wlr_wl_shell_surface_popup_at(view->wl_shell_surface,
-					view_sx, view_sy, &popup_sx, &popup_sy);
-
-			if (popup) {
-				*sx = view_sx - popup_sx;
-				*sy = view_sy - popup_sy;
-				*surface = popup->surface;
+	if (total > index->views_cap) {
+		struct roots_view **all = realloc(index->views,
+			total * sizeof(struct roots_view *));
+		if (all == NULL) {
+			goto error;
+		}
+		index->views = all;
+		index->views_cap = total;
+	}
+
+	// Fill the cells from the top view to the bottom one
+	next = malloc(ncells * sizeof(size_t));
+	if (next == NULL) {
+		goto error;
+	}
+	memcpy(next, index->cells, ncells * sizeof(size_t));
+	for (size_t i = views->length; i-- > 0;) {
+		struct roots_view *view = views->items[i];
+		if (!view_is_hidden(view)) {
+			view_index_add(index, view, bounded[i] ? &boxes[i] : NULL, next);
+		}
+	}
+
+	free(next);
+	free(boxes);
+	free(bounded);
+	index->last_view = NULL;
+	index->valid = true;
+	return true;
+
+error:
+	wlr_log(L_ERROR, "Failed to build the view index");
+	free(next);
+	free(boxes);
+	free(bounded);
+	return false;
+}
+
+/**
+ * Checks whether the point still hits the main surface of the last view found
+ * by view_at, without any view above.
+ */
+static bool view_index_last_hit(struct roots_view_index *index, size_t cell,
+		double lx, double ly, struct wlr_surface **surface,
+		double *sx, double *sy) {
+	struct roots_view *view = index->last_view;
+	if (view == NULL || index->cells[cell] == index->cells[cell + 1] ||
+			index->views[index->cells[cell]] != view) {
+		return false;
+	}
+	struct wlr_box box = {
+		.x = 0,
+		.y = 0,
+		.width = view->wlr_surface->current->buffer_width,
+		.height = view->wlr_surface->current->buffer_height,
+	};
+	double view_sx = lx - view->x, view_sy = ly - view->y;
+	if (!wlr_box_contains_point(&box, view_sx, view_sy) ||
+			!pixman_region32_contains_point(&view->wlr_surface->current->input,
+				view_sx, view_sy, NULL)) {
+		return false;
+	}
+	*sx = view_sx;
+	*sy = view_sy;
+	*surface = view->wlr_surface;
+	return true;
+}
+
+struct roots_view *view_at(struct roots_desktop *desktop, double lx, double ly,
+		struct wlr_surface **surface, double *sx, double *sy) {
+	struct roots_view_index *index = &desktop->view_index;
+	if (!index->valid && !view_index_rebuild(desktop)) {
+		// Fall back to testing every view
+		for (int i = desktop->views->length - 1; i >= 0; --i) {
+			struct roots_view *view = desktop->views->items[i];
+			if (!view_is_hidden(view) &&
+					view_surface_at(view, lx, ly, surface, sx, sy)) {
 				return view;
 			}
 		}
+		return NULL;
+	}
+
+	size_t cell = view_index_cell_at(index, lx, ly);
+	if (view_index_last_hit(index, cell, lx, ly, surface, sx, sy)) {
+		return index->last_view;
+	}
 
-		double sub_x, sub_y;
-		struct wlr_subsurface *subsurface =
-			wlr_surface_subsurface_at(view->wlr_surface,
-				view_sx, view_sy, &sub_x, &sub_y);
-		if (subsurface) {
-			*sx = view_sx - sub_x;
-			*sy = view_sy - sub_y;
-			*surface = subsurface->surface;
-			return view;
+	for (size_t i = index->cells[cell]; i < index->cells[cell + 1]; ++i) {
+		struct roots_view *view = index->views[i];
+		if (!view_surface_at(view, lx, ly, surface, sx, sy)) {
+			continue;
 		}
 
-		if (wlr_box_contains_point(&box, view_sx, view_sy) &&
-				pixman_region32_contains_point(
-					&view->wlr_surface->current->input,
-					view_sx, view_sy, NULL)) {
-			*sx = view_sx;
-			*sy = view_sy;
-			*surface = view->wlr_surface;
-			return view;
+		// Only views with a single surface can be checked quickly
+		size_t len;
+		wlr_surface_get_tree(view->wlr_surface, &len);
+		index->last_view = NULL;
+		if (len == 1 && !view_has_popups(view) && view->rotation == 0.0 &&
+				*surface == view->wlr_surface) {
+			index->last_view = view;
 		}
+		return view;
 	}
 	return NULL;
 }
 
+struct roots_surface {
+	struct roots_desktop *desktop;
+	struct wlr_surface *wlr_surface;
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	struct roots_surface *surface =
+		wl_container_of(listener, surface, commit);
+	desktop_invalidate_view_index(surface->desktop);
+	struct roots_output *output;
+	wl_list_for_each(output, &surface->desktop->outputs, link) {
+		output_damage_from_surface(output, surface->wlr_surface);
+	}
+}
+
+static void handle_surface_destroy(struct wl_listener *listener, void *data) {
+	struct roots_surface *surface =
+		wl_container_of(listener, surface, destroy);
+	// We don't know where the surface was displayed anymore
+	desktop_damage_whole(surface->desktop);
+	desktop_invalidate_view_index(surface->desktop);
+	wl_list_remove(&surface->commit.link);
+	wl_list_remove(&surface->destroy.link);
+	free(surface);
+}
+
+static void handle_create_surface(struct wl_listener *listener, void *data) {
+	struct roots_desktop *desktop =
+		wl_container_of(listener, desktop, create_surface);
+	struct wlr_surface *wlr_surface = data;
+
+	struct roots_surface *surface = calloc(1, sizeof(struct roots_surface));
+	if (surface == NULL) {
+		return;
+	}
+	surface->desktop = desktop;
+	surface->wlr_surface = wlr_surface;
+	surface->commit.notify = handle_surface_commit;
+	wl_signal_add(&wlr_surface->events.commit, &surface->commit);
+	surface->destroy.notify = handle_surface_destroy;
+	wl_signal_add(&wlr_surface->events.destroy, &surface->destroy);
+}
+
+static void handle_layout_change(struct wl_listener *listener, void *data) {
+	struct roots_desktop *desktop =
+		wl_container_of(listener, desktop, layout_change);
+	desktop_damage_whole(desktop);
+}
+
 struct roots_desktop *desktop_create(struct roots_server *server,
 		struct roots_config *config) {
 	wlr_log(L_DEBUG, "Initializing roots desktop");
@@ -235,8 +619,14 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 	desktop->server = server;
 	desktop->config = config;
 	desktop->layout = wlr_output_layout_create();
+	desktop->layout_change.notify = handle_layout_change;
+	wl_signal_add(&desktop->layout->events.change, &desktop->layout_change);
+
 	desktop->compositor = wlr_compositor_create(server->wl_display,
 		server->renderer);
+	desktop->create_surface.notify = handle_create_surface;
+	wl_signal_add(&desktop->compositor->events.create_surface,
+		&desktop->create_surface);
 
 	desktop->xdg_shell_v6 = wlr_xdg_shell_v6_create(server->wl_display);
 	wl_signal_add(&desktop->xdg_shell_v6->events.new_surface,
@@ -251,7 +641,11 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 #ifdef HAS_XWAYLAND
 	if (config->xwayland) {
 		desktop->xwayland = wlr_xwayland_create(server->wl_display,
-			desktop->compositor);
+			desktop->compositor, config->xwayland_lazy);
+		if (config->xwayland_lazy && config->xwayland_idle_timeout > 0) {
+			wlr_xwayland_set_idle_timeout(desktop->xwayland,
+				config->xwayland_idle_timeout * 1000);
+		}
 		wl_signal_add(&desktop->xwayland->events.new_surface,
 			&desktop->xwayland_surface);
 		desktop->xwayland_surface.notify = handle_xwayland_surface;
@@ -267,10 +661,13 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 	wlr_server_decoration_manager_set_default_mode(
 		desktop->server_decoration_manager,
 		ORG_KDE_KWIN_SERVER_DECORATION_MANAGER_MODE_CLIENT);
+	desktop->linux_dmabuf = wlr_linux_dmabuf_create(server->wl_display,
+		wlr_backend_get_egl(server->backend));
 
 	return desktop;
 }
 
 void desktop_destroy(struct roots_desktop *desktop) {
+	desktop_finish_view_index(desktop);
 	// TODO
 }
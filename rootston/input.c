@@ -122,6 +122,8 @@ struct roots_input *input_create(struct roots_server *server,
 
 	wlr_cursor_attach_output_layout(input->cursor, server->desktop->layout);
 	wlr_cursor_map_to_region(input->cursor, config->cursor.mapped_box);
+	wlr_cursor_set_coalesce_motion(input->cursor,
+		config->cursor.coalesce_motion);
 	cursor_load_config(config, input->cursor,
 		input, server->desktop);
 
@@ -6,6 +6,7 @@
 #include <wlr/backend.h>
 #include <wlr/render.h>
 #include <wlr/render/gles2.h>
+#include <wlr/render/pixman.h>
 #include <wlr/util/log.h>
 #include "rootston/config.h"
 #include "rootston/server.h"
@@ -19,7 +20,13 @@ int main(int argc, char **argv) {
 
 	assert(server.backend = wlr_backend_autocreate(server.wl_display));
 
-	assert(server.renderer = wlr_gles2_renderer_create(server.backend));
+	if (wlr_backend_get_egl(server.backend) != NULL) {
+		server.renderer = wlr_gles2_renderer_create(server.backend);
+	} else {
+		// e.g. the headless backend with WLR_HEADLESS_PIXMAN set
+		server.renderer = wlr_pixman_renderer_create();
+	}
+	assert(server.renderer);
 	server.data_device_manager =
 		wlr_data_device_manager_create(server.wl_display);
 	wl_display_init_shm(server.wl_display);
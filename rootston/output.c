@@ -2,11 +2,14 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/render/matrix.h>
+#include <wlr/render.h>
 #include <wlr/util/log.h>
 #include "rootston/server.h"
 #include "rootston/desktop.h"
@@ -16,70 +19,52 @@ static inline int64_t timespec_to_msec(const struct timespec *a) {
 	return (int64_t)a->tv_sec * 1000 + a->tv_nsec / 1000000;
 }
 
-static void render_surface(struct wlr_surface *surface,
-		struct roots_desktop *desktop, struct wlr_output *wlr_output,
-		struct timespec *when, double lx, double ly, float rotation) {
-	if (surface->texture->valid) {
-		int width = surface->current->buffer_width;
-		int height = surface->current->buffer_height;
-		double ox = lx, oy = ly;
-		wlr_output_layout_output_coords(desktop->layout, wlr_output, &ox, &oy);
-
-		if (wlr_output_layout_intersects(desktop->layout, wlr_output,
-				lx, ly, lx + width, ly + height)) {
-			float matrix[16];
-
-			float translate_origin[16];
-			wlr_matrix_translate(&translate_origin,
-				(int)ox + width / 2, (int)oy + height / 2, 0);
-			float rotate[16];
-			wlr_matrix_rotate(&rotate, rotation);
-			float translate_center[16];
-			wlr_matrix_translate(&translate_center, -width / 2, -height / 2, 0);
-			float transform[16];
-			wlr_matrix_mul(&translate_origin, &rotate, &transform);
-			wlr_matrix_mul(&transform, &translate_center, &transform);
-			wlr_surface_get_matrix(surface, &matrix,
-					&wlr_output->transform_matrix, &transform);
-			wlr_render_with_matrix(desktop->server->renderer,
-					surface->texture, &matrix);
-
-			struct wlr_frame_callback *cb, *cnext;
-			wl_list_for_each_safe(cb, cnext,
-				&surface->current->frame_callback_list, link) {
-				wl_callback_send_done(cb->resource, timespec_to_msec(when));
-				wl_resource_destroy(cb->resource);
-			}
-		}
+typedef void (*surface_iterator_func_t)(struct wlr_surface *surface,
+	double lx, double ly, float rotation, void *data);
 
-		struct wlr_subsurface *subsurface;
-		wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
-			double sx = subsurface->surface->current->subsurface_position.x,
-				sy = subsurface->surface->current->subsurface_position.y;
-			double sw = subsurface->surface->current->buffer_width,
-				sh = subsurface->surface->current->buffer_height;
-			if (rotation != 0.0) {
-				// Coordinates relative to the center of the subsurface
-				double ox = sx - (double)width/2 + sw/2,
-					oy = sy - (double)height/2 + sh/2;
-				// Rotated coordinates
-				double rx = cos(-rotation)*ox - sin(-rotation)*oy,
-					ry = cos(-rotation)*oy + sin(-rotation)*ox;
-				sx = rx + (double)width/2 - sw/2;
-				sy = ry + (double)height/2 - sh/2;
-			}
+/**
+ * Calls `iterator` for `surface` and each of its mapped subsurfaces, in
+ * rendering order. `lx` and `ly` are the layout coordinates of each surface.
+ */
+static void surface_for_each_surface(struct wlr_surface *surface, double lx,
+		double ly, float rotation, surface_iterator_func_t iterator,
+		void *user_data) {
+	size_t len;
+	const struct wlr_surface_tree_entry *entries =
+		wlr_surface_get_tree(surface, &len);
+	if (len == 0) {
+		return;
+	}
+
+	// Surfaces are rendered and hit-tested in a box of their buffer size,
+	// rotations pivot around its center
+	int width = surface->current->buffer_width;
+	int height = surface->current->buffer_height;
+	double c = cos(-rotation), s = sin(-rotation);
 
-			render_surface(subsurface->surface, desktop, wlr_output, when,
-				lx + sx,
-				ly + sy,
-				rotation);
+	for (size_t i = 0; i < len; ++i) {
+		const struct wlr_surface_tree_entry *entry = &entries[i];
+		double sx = entry->box.x, sy = entry->box.y;
+		if (rotation != 0.0) {
+			// Subsurfaces are rotated around the center of the root surface
+			double sw = entry->surface->current->buffer_width,
+				sh = entry->surface->current->buffer_height;
+			// Coordinates relative to the center of the subsurface
+			double ox = sx - (double)width/2 + sw/2,
+				oy = sy - (double)height/2 + sh/2;
+			// Rotated coordinates
+			double rx = c*ox - s*oy, ry = c*oy + s*ox;
+			sx = rx + (double)width/2 - sw/2;
+			sy = ry + (double)height/2 - sh/2;
 		}
+
+		iterator(entry->surface, lx + sx, ly + sy, rotation, user_data);
 	}
 }
 
-static void render_xdg_v6_popups(struct wlr_xdg_surface_v6 *surface,
-		struct roots_desktop *desktop, struct wlr_output *wlr_output,
-		struct timespec *when, double base_x, double base_y, float rotation) {
+static void xdg_surface_v6_for_each_surface(
+		struct wlr_xdg_surface_v6 *surface, double base_x, double base_y,
+		float rotation, surface_iterator_func_t iterator, void *user_data) {
 	// TODO: make sure this works with view rotation
 	struct wlr_xdg_surface_v6 *popup;
 	wl_list_for_each(popup, &surface->popups, popup_link) {
@@ -91,46 +76,452 @@ static void render_xdg_v6_popups(struct wlr_xdg_surface_v6 *surface,
 			popup->popup_state->geometry.x - popup->geometry->x;
 		double popup_y = base_y + surface->geometry->y +
 			popup->popup_state->geometry.y - popup->geometry->y;
-		render_surface(popup->surface, desktop, wlr_output, when, popup_x,
-			popup_y, rotation);
-		render_xdg_v6_popups(popup, desktop, wlr_output, when, popup_x, popup_y, rotation);
+		surface_for_each_surface(popup->surface, popup_x, popup_y, rotation,
+			iterator, user_data);
+		xdg_surface_v6_for_each_surface(popup, popup_x, popup_y, rotation,
+			iterator, user_data);
 	}
 }
 
-static void render_wl_shell_surface(struct wlr_wl_shell_surface *surface, struct roots_desktop *desktop,
-		struct wlr_output *wlr_output, struct timespec *when, double lx,
-		double ly, float rotation, bool is_child) {
+static void wl_shell_surface_for_each_surface(
+		struct wlr_wl_shell_surface *surface, double lx, double ly,
+		float rotation, bool is_child, surface_iterator_func_t iterator,
+		void *user_data) {
 	if (is_child || surface->state != WLR_WL_SHELL_SURFACE_STATE_POPUP) {
-		render_surface(surface->surface, desktop, wlr_output, when,
-			lx, ly, rotation);
+		surface_for_each_surface(surface->surface, lx, ly, rotation,
+			iterator, user_data);
 		struct wlr_wl_shell_surface *popup;
 		wl_list_for_each(popup, &surface->popups, popup_link) {
-			render_wl_shell_surface(popup, desktop, wlr_output, when,
+			wl_shell_surface_for_each_surface(popup,
 				lx + popup->transient_state->x,
 				ly + popup->transient_state->y,
-				rotation, true);
+				rotation, true, iterator, user_data);
+		}
+	}
+}
+
+static void view_for_each_surface(struct roots_view *view,
+		surface_iterator_func_t iterator, void *user_data) {
+	if (view->wlr_surface == NULL) {
+		return;
+	}
+
+	switch (view->type) {
+	case ROOTS_XDG_SHELL_V6_VIEW:
+		surface_for_each_surface(view->wlr_surface, view->x, view->y,
+			view->rotation, iterator, user_data);
+		xdg_surface_v6_for_each_surface(view->xdg_surface_v6, view->x,
+			view->y, view->rotation, iterator, user_data);
+		break;
+	case ROOTS_WL_SHELL_VIEW:
+		wl_shell_surface_for_each_surface(view->wl_shell_surface, view->x,
+			view->y, view->rotation, false, iterator, user_data);
+		break;
+	case ROOTS_XWAYLAND_VIEW:
+		surface_for_each_surface(view->wlr_surface, view->x, view->y,
+			view->rotation, iterator, user_data);
+		break;
+	}
+}
+
+static void drag_icon_for_each_surface(struct roots_drag_icon *drag_icon,
+		surface_iterator_func_t iterator, void *user_data) {
+	surface_for_each_surface(drag_icon->surface, drag_icon->x, drag_icon->y,
+		0, iterator, user_data);
+}
+
+static void desktop_for_each_surface(struct roots_desktop *desktop,
+		surface_iterator_func_t iterator, void *user_data) {
+	for (size_t i = 0; i < desktop->views->length; ++i) {
+		struct roots_view *view = desktop->views->items[i];
+		view_for_each_surface(view, iterator, user_data);
+	}
+
+	struct roots_drag_icon *drag_icon;
+	wl_list_for_each(drag_icon, &desktop->server->input->drag_icons, link) {
+		drag_icon_for_each_surface(drag_icon, iterator, user_data);
+	}
+}
+
+/**
+ * Computes the output-local bounding box of a surface at the given layout
+ * coordinates, taking the rotation into account.
+ */
+static void get_surface_box(struct roots_output *output,
+		struct wlr_surface *surface, double lx, double ly, float rotation,
+		struct wlr_box *box) {
+	double ox = lx, oy = ly;
+	wlr_output_layout_output_coords(output->desktop->layout,
+		output->wlr_output, &ox, &oy);
+
+	int width = surface->current->buffer_width;
+	int height = surface->current->buffer_height;
+	box->x = ox;
+	box->y = oy;
+	box->width = width;
+	box->height = height;
+
+	if (rotation != 0.0) {
+		double c = fabs(cos(rotation)), s = fabs(sin(rotation));
+		int rwidth = ceil(width * c + height * s);
+		int rheight = ceil(width * s + height * c);
+		box->x = floor(ox + (double)width/2 - (double)rwidth/2);
+		box->y = floor(oy + (double)height/2 - (double)rheight/2);
+		box->width = rwidth + 1;
+		box->height = rheight + 1;
+	}
+}
+
+static bool surface_intersects_output(struct roots_output *output,
+		struct wlr_surface *surface, double lx, double ly, float rotation) {
+	struct wlr_box box;
+	get_surface_box(output, surface, lx, ly, rotation, &box);
+
+	int width, height;
+	wlr_output_effective_resolution(output->wlr_output, &width, &height);
+	return box.x < width && box.y < height && box.x + box.width > 0 &&
+		box.y + box.height > 0;
+}
+
+/**
+ * Restricts rendering to an output-local rectangle.
+ */
+static void scissor_output(struct roots_output *output, pixman_box32_t *rect) {
+	struct wlr_renderer *renderer = output->desktop->server->renderer;
+
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+	wlr_output_project_box(output->wlr_output, &box, &box);
+	wlr_renderer_scissor(renderer, &box);
+}
+
+static void render_surface(struct roots_output *output,
+		struct wlr_surface *surface, double lx, double ly, float rotation,
+		bool opaque) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct roots_desktop *desktop = output->desktop;
+
+	int width = surface->current->buffer_width;
+	int height = surface->current->buffer_height;
+	double ox = lx, oy = ly;
+	wlr_output_layout_output_coords(desktop->layout, wlr_output, &ox, &oy);
+
+	float matrix[16];
+
+	float translate_origin[16];
+	wlr_matrix_translate(&translate_origin,
+		(int)ox + width / 2, (int)oy + height / 2, 0);
+	float rotate[16];
+	wlr_matrix_rotate(&rotate, rotation);
+	float translate_center[16];
+	wlr_matrix_translate(&translate_center, -width / 2, -height / 2, 0);
+	float transform[16];
+	wlr_matrix_mul(&translate_origin, &rotate, &transform);
+	wlr_matrix_mul(&transform, &translate_center, &transform);
+	wlr_surface_get_matrix(surface, &matrix,
+		&wlr_output->transform_matrix, &transform);
+	if (opaque) {
+		wlr_render_with_matrix_opaque(desktop->server->renderer,
+			surface->texture, &matrix);
+	} else {
+		wlr_render_with_matrix(desktop->server->renderer,
+			surface->texture, &matrix);
+	}
+}
+
+struct render_item {
+	struct wlr_surface *surface;
+	double lx, ly;
+	float rotation;
+	struct wlr_box box; // output-local
+	// Damaged and not hidden by opaque surfaces, split into the parts the
+	// surface is opaque and translucent in
+	pixman_region32_t opaque, translucent;
+};
+
+struct render_list_data {
+	struct roots_output *output;
+	pixman_box32_t *extents; // of the damage
+};
+
+static void add_render_item(struct wlr_surface *surface, double lx, double ly,
+		float rotation, void *_data) {
+	struct render_list_data *data = _data;
+	struct roots_output *output = data->output;
+
+	if (!surface->texture->valid) {
+		return;
+	}
+
+	struct wlr_box box;
+	get_surface_box(output, surface, lx, ly, rotation, &box);
+	if (box.x >= data->extents->x2 || box.y >= data->extents->y2 ||
+			box.x + box.width <= data->extents->x1 ||
+			box.y + box.height <= data->extents->y1) {
+		return;
+	}
+
+	if (output->render_items_len == output->render_items_cap) {
+		size_t cap = output->render_items_cap ?
+			2 * output->render_items_cap : 16;
+		struct render_item *items = realloc(output->render_items,
+			cap * sizeof(struct render_item));
+		if (items == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return;
+		}
+		output->render_items = items;
+		output->render_items_cap = cap;
+	}
+	output->render_items[output->render_items_len++] = (struct render_item){
+		.surface = surface,
+		.lx = lx,
+		.ly = ly,
+		.rotation = rotation,
+		.box = box,
+	};
+}
+
+/**
+ * Whether the opaque region of the surface, in surface coordinates, lines up
+ * with its render box. The box is sized and drawn in buffer coordinates, so
+ * this only holds for surfaces without buffer scale or transform.
+ */
+static bool surface_opaque_region_matches_box(struct wlr_surface *surface) {
+	return surface->current->scale == 1 &&
+		surface->current->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		!surface->texture->inverted_y;
+}
+
+/**
+ * Renders the damaged parts of the desktop. Surfaces are walked from top to
+ * bottom first to find out which parts of them are hidden by opaque surfaces
+ * above, so that nothing is drawn only to be overwritten afterwards. The
+ * opaque parts of the surfaces are drawn without blending.
+ */
+static void render_desktop(struct roots_output *output,
+		pixman_region32_t *damage) {
+	struct render_list_data data = {
+		.output = output,
+		.extents = pixman_region32_extents(damage),
+	};
+	output->render_items_len = 0;
+	desktop_for_each_surface(output->desktop, add_render_item, &data);
+
+	pixman_region32_t occluded;
+	pixman_region32_init(&occluded);
+	for (size_t i = output->render_items_len; i-- > 0;) {
+		struct render_item *item = &output->render_items[i];
+		pixman_region32_init(&item->opaque);
+		pixman_region32_init(&item->translucent);
+		pixman_region32_intersect_rect(&item->translucent, damage,
+			item->box.x, item->box.y, item->box.width, item->box.height);
+		pixman_region32_subtract(&item->translucent, &item->translucent,
+			&occluded);
+
+		// The opaque region isn't tracked for rotated surfaces, their box
+		// is only an approximation of the area they cover
+		if (item->rotation == 0.0 &&
+				surface_opaque_region_matches_box(item->surface) &&
+				pixman_region32_not_empty(&item->surface->opaque_region)) {
+			pixman_region32_copy(&item->opaque,
+				&item->surface->opaque_region);
+			pixman_region32_translate(&item->opaque, item->box.x,
+				item->box.y);
+			pixman_region32_union(&occluded, &occluded, &item->opaque);
+			pixman_region32_intersect(&item->opaque, &item->opaque,
+				&item->translucent);
+			pixman_region32_subtract(&item->translucent, &item->translucent,
+				&item->opaque);
+		}
+	}
+	pixman_region32_fini(&occluded);
+
+	// Each scissor change flushes the renderer's batch, so the surfaces are
+	// drawn one damaged rectangle at a time rather than the other way around
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	for (int j = 0; j < nrects; ++j) {
+		scissor_output(output, &rects[j]);
+		for (size_t i = 0; i < output->render_items_len; ++i) {
+			struct render_item *item = &output->render_items[i];
+			// Blending is only needed if some of the surface is translucent
+			// in this rectangle
+			if (pixman_region32_contains_rectangle(&item->translucent,
+					&rects[j]) != PIXMAN_REGION_OUT) {
+				render_surface(output, item->surface, item->lx, item->ly,
+					item->rotation, false);
+			} else if (pixman_region32_contains_rectangle(&item->opaque,
+					&rects[j]) != PIXMAN_REGION_OUT) {
+				render_surface(output, item->surface, item->lx, item->ly,
+					item->rotation, true);
+			}
 		}
 	}
+
+	for (size_t i = 0; i < output->render_items_len; ++i) {
+		struct render_item *item = &output->render_items[i];
+		pixman_region32_fini(&item->opaque);
+		pixman_region32_fini(&item->translucent);
+	}
+}
+
+struct frame_done_data {
+	struct roots_output *output;
+	struct timespec *when;
+};
+
+static void surface_send_frame_done(struct wlr_surface *surface, double lx,
+		double ly, float rotation, void *_data) {
+	struct frame_done_data *data = _data;
+
+	if (!surface->texture->valid ||
+			!surface_intersects_output(data->output, surface, lx, ly,
+				rotation)) {
+		return;
+	}
+
+	struct wlr_frame_callback *cb, *cnext;
+	wl_list_for_each_safe(cb, cnext,
+			&surface->current->frame_callback_list, link) {
+		wl_callback_send_done(cb->resource, timespec_to_msec(data->when));
+		wl_resource_destroy(cb->resource);
+	}
 }
 
-static void render_view(struct roots_view *view, struct roots_desktop *desktop,
-		struct wlr_output *wlr_output, struct timespec *when) {
+/**
+ * Returns the surface of the topmost view if it covers the whole output and
+ * nothing else is displayed above it, so that its buffer can be scanned out
+ * directly.
+ */
+static struct wlr_surface *get_scanout_surface(struct roots_output *output) {
+	struct roots_desktop *desktop = output->desktop;
+	if (desktop->views->length == 0) {
+		return NULL;
+	}
+
+	struct roots_view *view = desktop->views->items[desktop->views->length - 1];
+	struct wlr_surface *surface = view->wlr_surface;
+	if (surface == NULL || view->rotation != 0.0) {
+		return NULL;
+	}
+
 	switch (view->type) {
 	case ROOTS_XDG_SHELL_V6_VIEW:
-		render_surface(view->wlr_surface, desktop, wlr_output, when,
-			view->x, view->y, view->rotation);
-		render_xdg_v6_popups(view->xdg_surface_v6, desktop, wlr_output,
-			when, view->x, view->y, view->rotation);
+		if (!wl_list_empty(&view->xdg_surface_v6->popups)) {
+			return NULL;
+		}
 		break;
 	case ROOTS_WL_SHELL_VIEW:
-		render_wl_shell_surface(view->wl_shell_surface, desktop, wlr_output,
-			when, view->x, view->y, view->rotation, false);
+		if (!wl_list_empty(&view->wl_shell_surface->popups)) {
+			return NULL;
+		}
 		break;
 	case ROOTS_XWAYLAND_VIEW:
-		render_surface(view->wlr_surface, desktop, wlr_output, when,
-			view->x, view->y, view->rotation);
 		break;
 	}
+
+	struct roots_drag_icon *drag_icon;
+	wl_list_for_each(drag_icon, &desktop->server->input->drag_icons, link) {
+		if (drag_icon->surface->texture->valid &&
+				surface_intersects_output(output, drag_icon->surface,
+					drag_icon->x, drag_icon->y, 0)) {
+			return NULL;
+		}
+	}
+
+	double ox = view->x, oy = view->y;
+	wlr_output_layout_output_coords(desktop->layout, output->wlr_output,
+		&ox, &oy);
+	int width, height;
+	wlr_output_effective_resolution(output->wlr_output, &width, &height);
+	if (ox != 0 || oy != 0 || surface->current->width != width ||
+			surface->current->height != height) {
+		return NULL;
+	}
+
+	return surface;
+}
+
+#define MAX_OVERLAY_CANDIDATES 4
+
+struct overlay_candidate {
+	struct wlr_surface *surface;
+	struct wlr_box box;
+};
+
+struct overlay_data {
+	struct roots_output *output;
+	// Surfaces nothing is drawn above yet, from bottom to top
+	struct overlay_candidate candidates[MAX_OVERLAY_CANDIDATES];
+	size_t candidates_len;
+};
+
+static void find_overlay_candidates(struct wlr_surface *surface, double lx,
+		double ly, float rotation, void *_data) {
+	struct overlay_data *data = _data;
+	struct roots_output *output = data->output;
+
+	if (!surface->texture->valid) {
+		return;
+	}
+
+	struct wlr_box box;
+	get_surface_box(output, surface, lx, ly, rotation, &box);
+
+	// Candidates below this surface can't be displayed above it anymore
+	size_t len = 0;
+	for (size_t i = 0; i < data->candidates_len; ++i) {
+		struct wlr_box intersection, *intersection_ptr = &intersection;
+		if (!wlr_box_intersection(&data->candidates[i].box, &box,
+				&intersection_ptr)) {
+			data->candidates[len++] = data->candidates[i];
+		}
+	}
+	data->candidates_len = len;
+
+	// Only client buffers which can be imported may end up on a plane
+	struct wl_resource *buffer = surface->current->buffer;
+	if (rotation != 0.0 || buffer == NULL || wl_shm_buffer_get(buffer) ||
+			!surface_intersects_output(output, surface, lx, ly, rotation)) {
+		return;
+	}
+
+	if (data->candidates_len == MAX_OVERLAY_CANDIDATES) {
+		// Prefer the topmost surfaces
+		memmove(&data->candidates[0], &data->candidates[1],
+			(MAX_OVERLAY_CANDIDATES - 1) * sizeof(struct overlay_candidate));
+		--data->candidates_len;
+	}
+	data->candidates[data->candidates_len++] = (struct overlay_candidate){
+		.surface = surface,
+		.box = box,
+	};
+}
+
+/**
+ * Puts the surfaces nothing is drawn above on overlay planes, so that they
+ * don't need to be composited. `overlay` is set to the area they cover.
+ */
+static void assign_overlays(struct roots_output *output,
+		pixman_region32_t *overlay) {
+	struct overlay_data data = {
+		.output = output,
+	};
+	desktop_for_each_surface(output->desktop, find_overlay_candidates, &data);
+
+	for (size_t i = data.candidates_len; i-- > 0;) {
+		struct overlay_candidate *candidate = &data.candidates[i];
+		if (wlr_output_attach_overlay(output->wlr_output, candidate->surface,
+				candidate->box.x, candidate->box.y)) {
+			pixman_region32_union_rect(overlay, overlay, candidate->box.x,
+				candidate->box.y, candidate->box.width, candidate->box.height);
+		}
+	}
 }
 
 static void output_frame_notify(struct wl_listener *listener, void *data) {
@@ -142,29 +533,279 @@ static void output_frame_notify(struct wl_listener *listener, void *data) {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	wlr_output_make_current(wlr_output);
-	wlr_renderer_begin(server->renderer, wlr_output);
+	// Apply the pointer motion coalesced since the last frame, it may damage
+	// the output
+	wlr_cursor_flush_motion(server->input->cursor);
 
-	for (size_t i = 0; i < desktop->views->length; ++i) {
-		struct roots_view *view = desktop->views->items[i];
-		render_view(view, desktop, wlr_output, &now);
+	// needs_swap is set by backends which only apply cursor changes with the
+	// next page flip, skipping the frame would leave the cursor frozen
+	if (!pixman_region32_not_empty(&output->damage) &&
+			!wlr_output->needs_swap) {
+		// Nothing changed, skip this frame
+		goto frame_done;
 	}
 
-	struct roots_drag_icon *drag_icon = NULL;
-	wl_list_for_each(drag_icon, &server->input->drag_icons, link) {
-		struct wlr_surface *icon = drag_icon->surface;
-		struct wlr_cursor *cursor = server->input->cursor;
-		double icon_x = cursor->x + drag_icon->sx;
-		double icon_y = cursor->y + drag_icon->sy;
-		render_surface(icon, desktop, wlr_output, &now, icon_x, icon_y, 0);
+	struct wlr_surface *scanout_surface = get_scanout_surface(output);
+	if (scanout_surface != NULL &&
+			wlr_output_scanout_surface(wlr_output, scanout_surface)) {
+		output->scanned_out = true;
+		pixman_region32_clear(&output->damage);
+		pixman_region32_clear(&output->overlay);
+		goto frame_done;
 	}
 
+	int buffer_age = -1;
+	if (!wlr_output_make_current(wlr_output, &buffer_age)) {
+		goto frame_done;
+	}
+
+	int width, height;
+	wlr_output_effective_resolution(wlr_output, &width, &height);
+
+	if (output->scanned_out) {
+		// The back buffers are older than what is on screen
+		pixman_region32_union_rect(&output->damage, &output->damage, 0, 0,
+			width, height);
+		output->scanned_out = false;
+	}
+	// The backend or the software cursor changed what is on screen
+	pixman_region32_union(&output->damage, &output->damage,
+		&wlr_output->damage);
+
+	pixman_region32_t overlay;
+	pixman_region32_init(&overlay);
+	assign_overlays(output, &overlay);
+
+	// What was hidden by overlay planes in the last frame is visible again
+	pixman_region32_t uncovered;
+	pixman_region32_init(&uncovered);
+	pixman_region32_subtract(&uncovered, &output->overlay, &overlay);
+	pixman_region32_union(&output->damage, &output->damage, &uncovered);
+	pixman_region32_fini(&uncovered);
+	pixman_region32_copy(&output->overlay, &overlay);
+
+	// The back buffer still contains the frame rendered buffer_age frames ago,
+	// so only the regions damaged since then need to be repainted
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (buffer_age <= 0 || buffer_age - 1 > ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN) {
+		pixman_region32_union_rect(&damage, &damage, 0, 0, width, height);
+	} else {
+		pixman_region32_copy(&damage, &output->damage);
+		size_t idx = output->previous_damage_idx;
+		for (int i = 0; i < buffer_age - 1; ++i) {
+			pixman_region32_union(&damage, &damage,
+				&output->previous_damage[idx]);
+			idx = (idx + ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN - 1) %
+				ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN;
+		}
+	}
+
+	// Surfaces on overlay planes and whatever is below them are hidden
+	pixman_region32_subtract(&damage, &damage, &overlay);
+	pixman_region32_fini(&overlay);
+
+	wlr_renderer_begin_with_damage(server->renderer, wlr_output, &damage);
+
+	render_desktop(output, &damage);
+	pixman_region32_fini(&damage);
+
+	wlr_renderer_scissor(server->renderer, NULL);
 	wlr_renderer_end(server->renderer);
 	wlr_output_swap_buffers(wlr_output);
 
+	// Remember what changed in this frame for the next buffers
+	output->previous_damage_idx = (output->previous_damage_idx + 1) %
+		ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN;
+	pixman_region32_copy(&output->previous_damage[output->previous_damage_idx],
+		&output->damage);
+	pixman_region32_clear(&output->damage);
+
+frame_done:;
+	struct frame_done_data frame_done_data = {
+		.output = output,
+		.when = &now,
+	};
+	desktop_for_each_surface(desktop, surface_send_frame_done,
+		&frame_done_data);
+
 	output->last_frame = desktop->last_frame = now;
 }
 
+static void output_add_damage(struct roots_output *output,
+		pixman_region32_t *damage) {
+	int width, height;
+	wlr_output_effective_resolution(output->wlr_output, &width, &height);
+	pixman_region32_intersect_rect(damage, damage, 0, 0, width, height);
+	if (!pixman_region32_not_empty(damage)) {
+		return;
+	}
+
+	pixman_region32_union(&output->damage, &output->damage, damage);
+	wlr_output_schedule_frame(output->wlr_output);
+}
+
+static void output_add_damage_box(struct roots_output *output,
+		struct wlr_box *box) {
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, box->x, box->y, box->width,
+		box->height);
+	output_add_damage(output, &damage);
+	pixman_region32_fini(&damage);
+}
+
+void output_damage_whole(struct roots_output *output) {
+	int width, height;
+	wlr_output_effective_resolution(output->wlr_output, &width, &height);
+
+	pixman_region32_union_rect(&output->damage, &output->damage, 0, 0,
+		width, height);
+	wlr_output_schedule_frame(output->wlr_output);
+}
+
+static void damage_whole_surface(struct wlr_surface *surface,
+		double lx, double ly, float rotation, void *data) {
+	struct roots_output *output = data;
+
+	if (!surface->texture->valid) {
+		return;
+	}
+
+	struct wlr_box box;
+	get_surface_box(output, surface, lx, ly, rotation, &box);
+	output_add_damage_box(output, &box);
+}
+
+void output_damage_whole_view(struct roots_output *output,
+		struct roots_view *view) {
+	view_for_each_surface(view, damage_whole_surface, output);
+}
+
+void output_damage_whole_drag_icon(struct roots_output *output,
+		struct roots_drag_icon *icon) {
+	drag_icon_for_each_surface(icon, damage_whole_surface, output);
+}
+
+/**
+ * Rotates each rectangle of a surface-local region around the center of the
+ * surface and stores the bounding boxes of the results in `dst`, still
+ * relative to the surface position.
+ */
+static void rotate_surface_region(pixman_region32_t *dst,
+		pixman_region32_t *src, struct wlr_surface *surface, float rotation) {
+	double cx = (double)surface->current->buffer_width/2,
+		cy = (double)surface->current->buffer_height/2;
+	double c = cos(-rotation), s = sin(-rotation);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(src, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		double corners[4][2] = {
+			{ rects[i].x1, rects[i].y1 },
+			{ rects[i].x2, rects[i].y1 },
+			{ rects[i].x1, rects[i].y2 },
+			{ rects[i].x2, rects[i].y2 },
+		};
+		double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+		for (size_t j = 0; j < 4; ++j) {
+			double ox = corners[j][0] - cx, oy = corners[j][1] - cy;
+			double rx = c*ox - s*oy + cx, ry = c*oy + s*ox + cy;
+			x1 = fmin(x1, rx);
+			y1 = fmin(y1, ry);
+			x2 = fmax(x2, rx);
+			y2 = fmax(y2, ry);
+		}
+		// Rasterization can touch one more pixel on each side
+		int x = floor(x1) - 1, y = floor(y1) - 1;
+		pixman_region32_union_rect(dst, dst, x, y, ceil(x2) + 1 - x,
+			ceil(y2) + 1 - y);
+	}
+}
+
+static void damage_from_surface(struct wlr_surface *surface,
+		double lx, double ly, float rotation, void *data) {
+	struct roots_output *output = data;
+
+	double ox = lx, oy = ly;
+	wlr_output_layout_output_coords(output->desktop->layout,
+		output->wlr_output, &ox, &oy);
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (rotation != 0.0) {
+		rotate_surface_region(&damage, &surface->current->surface_damage,
+			surface, rotation);
+	} else {
+		pixman_region32_copy(&damage, &surface->current->surface_damage);
+	}
+	pixman_region32_translate(&damage, (int)ox, (int)oy);
+	output_add_damage(output, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static void damage_whole_subsurfaces(struct roots_output *output,
+		struct wlr_surface *surface, double lx, double ly) {
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
+		struct wlr_surface_state *state = subsurface->surface->current;
+		double sx = lx + state->subsurface_position.x;
+		double sy = ly + state->subsurface_position.y;
+
+		struct wlr_box box;
+		get_surface_box(output, subsurface->surface, sx, sy, 0, &box);
+		output_add_damage_box(output, &box);
+
+		damage_whole_subsurfaces(output, subsurface->surface, sx, sy);
+	}
+}
+
+struct damage_from_surface_data {
+	struct roots_output *output;
+	struct wlr_surface *surface;
+};
+
+static void find_damaged_surface(struct wlr_surface *surface,
+		double lx, double ly, float rotation, void *_data) {
+	struct damage_from_surface_data *data = _data;
+	struct roots_output *output = data->output;
+
+	if (surface != data->surface) {
+		return;
+	}
+
+	// Subsurfaces are not visited when their parent has no buffer, so damage
+	// them explicitly when the parent has just been unmapped
+	if (!surface->texture->valid) {
+		damage_whole_subsurfaces(output, surface, lx, ly);
+	}
+
+	// The surface damage of the subsurfaces is only set if they have been
+	// reordered
+	surface_for_each_surface(surface, lx, ly, rotation, damage_from_surface,
+		output);
+
+	// Make sure frame callbacks are sent even if nothing was damaged
+	if (surface_intersects_output(output, surface, lx, ly, rotation)) {
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+}
+
+void output_damage_from_surface(struct roots_output *output,
+		struct wlr_surface *surface) {
+	struct damage_from_surface_data data = {
+		.output = output,
+		.surface = surface,
+	};
+	desktop_for_each_surface(output->desktop, find_damaged_surface, &data);
+}
+
+static void output_resolution_notify(struct wl_listener *listener,
+		void *data) {
+	struct roots_output *output =
+		wl_container_of(listener, output, resolution);
+	output_damage_whole(output);
+}
+
 static void set_mode(struct wlr_output *output, struct output_config *oc) {
 	struct wlr_output_mode *mode, *best = NULL;
 	int mhz = (int)(oc->mode.refresh_rate * 1000);
@@ -205,8 +846,15 @@ void output_add_notify(struct wl_listener *listener, void *data) {
 	clock_gettime(CLOCK_MONOTONIC, &output->last_frame);
 	output->desktop = desktop;
 	output->wlr_output = wlr_output;
+	pixman_region32_init(&output->damage);
+	pixman_region32_init(&output->overlay);
+	for (size_t i = 0; i < ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN; ++i) {
+		pixman_region32_init(&output->previous_damage[i]);
+	}
 	output->frame.notify = output_frame_notify;
 	wl_signal_add(&wlr_output->events.frame, &output->frame);
+	output->resolution.notify = output_resolution_notify;
+	wl_signal_add(&wlr_output->events.resolution, &output->resolution);
 	wl_list_insert(&desktop->outputs, &output->link);
 
 	struct output_config *output_config = config_get_output(config, wlr_output);
@@ -215,12 +863,25 @@ void output_add_notify(struct wl_listener *listener, void *data) {
 			set_mode(wlr_output, output_config);
 		}
 		wlr_output_transform(wlr_output, output_config->transform);
+		int margin = output_config->frame_margin;
+		struct wlr_output_mode *mode = wlr_output->current_mode;
+		// The refresh rate is in mHz
+		if (margin > 0 && mode != NULL && mode->refresh > 0 &&
+				margin >= 1000000 / mode->refresh) {
+			wlr_log(L_ERROR, "frame-margin of %d ms for output %s is not "
+				"shorter than its refresh period, ignoring it", margin,
+				wlr_output->name);
+		} else {
+			wlr_output_set_frame_margin(wlr_output, margin);
+		}
 		wlr_output_layout_add(desktop->layout,
 				wlr_output, output_config->x, output_config->y);
 	} else {
 		wlr_output_layout_add_auto(desktop->layout, wlr_output);
 	}
 
+	output_damage_whole(output);
+
 	cursor_load_config(config, input->cursor, input, desktop);
 
 	struct wlr_xcursor *xcursor = get_default_xcursor(input->xcursor_theme);
@@ -256,5 +917,12 @@ void output_remove_notify(struct wl_listener *listener, void *data) {
 	//	sample->compositor);
 	wl_list_remove(&output->link);
 	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->resolution.link);
+	pixman_region32_fini(&output->damage);
+	pixman_region32_fini(&output->overlay);
+	for (size_t i = 0; i < ROOTS_OUTPUT_PREVIOUS_DAMAGE_LEN; ++i) {
+		pixman_region32_fini(&output->previous_damage[i]);
+	}
+	free(output->render_items);
 	free(output);
 }
@@ -72,8 +72,10 @@ static void handle_request_configure(struct wl_listener *listener, void *data) {
 		roots_surface->view->xwayland_surface;
 	struct wlr_xwayland_surface_configure_event *event = data;
 
+	view_damage_whole(roots_surface->view);
 	roots_surface->view->x = (double)event->x;
 	roots_surface->view->y = (double)event->y;
+	view_damage_whole(roots_surface->view);
 
 	wlr_xwayland_surface_configure(roots_surface->view->desktop->xwayland,
 		xwayland_surface, event->x, event->y, event->width, event->height);
@@ -142,12 +144,14 @@ static void handle_map_notify(struct wl_listener *listener, void *data) {
 	view->y = (double)xsurface->y;
 
 	wlr_list_push(desktop->views, roots_surface->view);
+	view_damage_whole(view);
 }
 
 static void handle_unmap_notify(struct wl_listener *listener, void *data) {
 	struct roots_xwayland_surface *roots_surface =
 		wl_container_of(listener, roots_surface, unmap_notify);
 	struct roots_desktop *desktop = roots_surface->view->desktop;
+	view_damage_whole(roots_surface->view);
 	roots_surface->view->wlr_surface = NULL;
 
 	for (size_t i = 0; i < desktop->views->length; i++) {
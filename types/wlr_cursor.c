@@ -41,6 +41,10 @@ struct wlr_cursor_state {
 	struct wlr_output *mapped_output;
 	struct wlr_box *mapped_box;
 
+	bool coalesce_motion;
+	bool motion_pending;
+	struct wlr_event_pointer_motion pending_motion; // sum of the deltas
+
 	struct wl_listener layout_change;
 	struct wl_listener layout_destroy;
 };
@@ -66,6 +70,7 @@ struct wlr_cursor *wlr_cursor_create() {
 
 	// pointer signals
 	wl_signal_init(&cur->events.motion);
+	wl_signal_init(&cur->events.motion_sample);
 	wl_signal_init(&cur->events.motion_absolute);
 	wl_signal_init(&cur->events.button);
 	wl_signal_init(&cur->events.axis);
@@ -93,6 +98,9 @@ static void wlr_cursor_detach_output_layout(struct wlr_cursor *cur) {
 		return;
 	}
 
+	// No frame will flush the pending motion anymore
+	wlr_cursor_flush_motion(cur);
+
 	wl_list_remove(&cur->state->layout_destroy.link);
 	wl_list_remove(&cur->state->layout_change.link);
 
@@ -254,11 +262,78 @@ void wlr_cursor_move(struct wlr_cursor *cur, struct wlr_input_device *dev,
 	wlr_cursor_warp_unchecked(cur, x, y);
 }
 
+void wlr_cursor_flush_motion(struct wlr_cursor *cur) {
+	if (!cur->state->motion_pending) {
+		return;
+	}
+	// Listeners may flush again
+	struct wlr_event_pointer_motion event = cur->state->pending_motion;
+	cur->state->motion_pending = false;
+	wl_signal_emit(&cur->events.motion, &event);
+}
+
+void wlr_cursor_set_coalesce_motion(struct wlr_cursor *cur, bool coalesce) {
+	if (!coalesce) {
+		wlr_cursor_flush_motion(cur);
+	}
+	cur->state->coalesce_motion = coalesce;
+}
+
+/**
+ * Schedules a frame on the outputs of the layout, so that pending motion gets
+ * flushed. Returns false if none of them can send frame events.
+ */
+static bool cursor_schedule_frame(struct wlr_cursor_state *state) {
+	if (!state->layout) {
+		return false;
+	}
+
+	bool scheduled = false;
+	struct wlr_output_layout_output *l_output;
+	wl_list_for_each(l_output, &state->layout->outputs, link) {
+		// Outputs which aren't advertised don't send frame events
+		if (l_output->output->wl_global != NULL) {
+			wlr_output_schedule_frame(l_output->output);
+			scheduled = true;
+		}
+	}
+	return scheduled;
+}
+
 static void handle_pointer_motion(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_motion *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion);
-	wl_signal_emit(&device->cursor->events.motion, event);
+	struct wlr_cursor *cur = device->cursor;
+	struct wlr_cursor_state *state = cur->state;
+	wl_signal_emit(&cur->events.motion_sample, event);
+
+	if (state->motion_pending &&
+			state->pending_motion.device != event->device) {
+		wlr_cursor_flush_motion(cur);
+	}
+
+	// Without an output there is no frame to wait for
+	if (!state->coalesce_motion ||
+			(!state->motion_pending && !cursor_schedule_frame(state))) {
+		wlr_cursor_flush_motion(cur);
+		wl_signal_emit(&cur->events.motion, event);
+		return;
+	}
+
+	if (!state->motion_pending) {
+		state->pending_motion = *event;
+		state->motion_pending = true;
+		return;
+	}
+
+	struct wlr_event_pointer_motion *pending = &state->pending_motion;
+	pending->time_sec = event->time_sec;
+	pending->time_usec = event->time_usec;
+	pending->delta_x += event->delta_x;
+	pending->delta_y += event->delta_y;
+	pending->unaccel_dx += event->unaccel_dx;
+	pending->unaccel_dy += event->unaccel_dy;
 }
 
 static void handle_pointer_motion_absolute(struct wl_listener *listener,
@@ -266,6 +341,7 @@ static void handle_pointer_motion_absolute(struct wl_listener *listener,
 	struct wlr_event_pointer_motion_absolute *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion_absolute);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.motion_absolute, event);
 }
 
@@ -273,12 +349,15 @@ static void handle_pointer_button(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_button *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, button);
+	// The button applies where the pointer is at the time of the event
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.button, event);
 }
 
 static void handle_pointer_axis(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_axis *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, axis);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.axis, event);
 }
 
@@ -286,6 +365,7 @@ static void handle_touch_up(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_up *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_up);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.touch_up, event);
 }
 
@@ -293,6 +373,7 @@ static void handle_touch_down(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_down *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_down);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.touch_down, event);
 }
 
@@ -300,6 +381,7 @@ static void handle_touch_motion(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_motion *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_motion);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.touch_motion, event);
 }
 
@@ -307,6 +389,7 @@ static void handle_touch_cancel(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_cancel *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_cancel);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.touch_cancel, event);
 }
 
@@ -314,6 +397,7 @@ static void handle_tablet_tool_tip(struct wl_listener *listener, void *data) {
 	struct wlr_event_tablet_tool_tip *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_tip);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.tablet_tool_tip, event);
 }
 
@@ -321,6 +405,7 @@ static void handle_tablet_tool_axis(struct wl_listener *listener, void *data) {
 	struct wlr_event_tablet_tool_axis *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_axis);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.tablet_tool_axis, event);
 }
 
@@ -329,6 +414,7 @@ static void handle_tablet_tool_button(struct wl_listener *listener,
 	struct wlr_event_tablet_tool_button *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_button);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.tablet_tool_button, event);
 }
 
@@ -337,6 +423,7 @@ static void handle_tablet_tool_proximity(struct wl_listener *listener,
 	struct wlr_event_tablet_tool_proximity *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_proximity);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit(&device->cursor->events.tablet_tool_proximity, event);
 }
 
@@ -433,6 +520,11 @@ void wlr_cursor_attach_input_device(struct wlr_cursor *cur,
 
 static void wlr_cursor_device_destroy(struct wlr_cursor_device *c_device) {
 	struct wlr_input_device *dev = c_device->device;
+	struct wlr_cursor_state *state = c_device->cursor->state;
+	if (state->motion_pending && state->pending_motion.device == dev) {
+		// The device may be about to be destroyed
+		state->motion_pending = false;
+	}
 	if (dev->type == WLR_INPUT_DEVICE_POINTER) {
 		wl_list_remove(&c_device->motion.link);
 		wl_list_remove(&c_device->motion_absolute.link);
@@ -468,7 +560,7 @@ void wlr_cursor_detach_input_device(struct wlr_cursor *cur,
 
 static void handle_layout_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_state *state =
-		wl_container_of(listener, state, layout_change);
+		wl_container_of(listener, state, layout_destroy);
 	wlr_cursor_detach_output_layout(state->cursor);
 }
 
@@ -476,6 +568,12 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_state *state =
 		wl_container_of(listener, state, layout_change);
 	struct wlr_output_layout *layout = data;
+
+	// The outputs which were expected to flush the pending motion may be gone
+	if (state->motion_pending && !cursor_schedule_frame(state)) {
+		wlr_cursor_flush_motion(state->cursor);
+	}
+
 	if (!wlr_output_layout_contains_point(layout, NULL, state->cursor->x,
 			state->cursor->y)) {
 		// the output we were on has gone away so go to the closest boundary
@@ -5,14 +5,17 @@
 #include <tgmath.h>
 #include <time.h>
 #include <wayland-server.h>
+#include <wlr/backend.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/types/wlr_list.h>
 #include <wlr/util/log.h>
 #include <GLES2/gl2.h>
 #include <wlr/render/matrix.h>
 #include <wlr/render/gles2.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render.h>
 
 static void wl_output_send_to_resource(struct wl_resource *resource) {
@@ -112,6 +115,7 @@ struct wl_global *wlr_output_create_global(struct wlr_output *wlr_output,
 	struct wl_global *wl_global = wl_global_create(display,
 		&wl_output_interface, 3, wlr_output, wl_output_bind);
 	wlr_output->wl_global = wl_global;
+	wlr_output->display = display;
 	wl_list_init(&wlr_output->wl_resources);
 	return wl_global;
 }
@@ -127,6 +131,15 @@ void wlr_output_destroy_global(struct wlr_output *wlr_output) {
 	}
 	wl_global_destroy(wlr_output->wl_global);
 	wlr_output->wl_global = NULL;
+
+	if (wlr_output->idle_frame != NULL) {
+		wl_event_source_remove(wlr_output->idle_frame);
+		wlr_output->idle_frame = NULL;
+	}
+	if (wlr_output->frame_schedule.timer != NULL) {
+		wl_event_source_remove(wlr_output->frame_schedule.timer);
+		wlr_output->frame_schedule.timer = NULL;
+	}
 }
 
 static void wlr_output_update_matrix(struct wlr_output *output) {
@@ -188,6 +201,47 @@ void wlr_output_set_position(struct wlr_output *output, int32_t lx,
 	}
 }
 
+void wlr_output_damage_whole(struct wlr_output *output) {
+	int width, height;
+	wlr_output_effective_resolution(output, &width, &height);
+	pixman_region32_union_rect(&output->damage, &output->damage, 0, 0,
+		width, height);
+	output->needs_swap = true;
+	wlr_output_schedule_frame(output);
+}
+
+static struct wlr_texture *output_cursor_get_texture(
+		struct wlr_output *output) {
+	if (output->cursor.surface) {
+		return output->cursor.surface->texture;
+	}
+	return output->cursor.texture;
+}
+
+/**
+ * Damages where the software cursor was last drawn and where it will be drawn
+ * with the next frame. Must be called after any change to the cursor.
+ */
+static void output_cursor_damage(struct wlr_output *output) {
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, output->cursor.drawn_box.x,
+		output->cursor.drawn_box.y, output->cursor.drawn_box.width,
+		output->cursor.drawn_box.height);
+
+	struct wlr_texture *texture = output_cursor_get_texture(output);
+	if (output->cursor.is_sw && texture && texture->valid) {
+		pixman_region32_union_rect(&damage, &damage, output->cursor.x,
+			output->cursor.y, texture->width, texture->height);
+	}
+
+	if (pixman_region32_not_empty(&damage)) {
+		pixman_region32_union(&output->damage, &output->damage, &damage);
+		output->needs_swap = true;
+		wlr_output_schedule_frame(output);
+	}
+	pixman_region32_fini(&damage);
+}
+
 static bool set_cursor(struct wlr_output *output, const uint8_t *buf,
 		int32_t stride, uint32_t width, uint32_t height, int32_t hotspot_x,
 		int32_t hotspot_y) {
@@ -195,6 +249,7 @@ static bool set_cursor(struct wlr_output *output, const uint8_t *buf,
 			&& output->impl->set_cursor(output, buf, stride, width, height,
 				hotspot_x, hotspot_y, true)) {
 		output->cursor.is_sw = false;
+		output_cursor_damage(output);
 		return true;
 	}
 
@@ -205,7 +260,12 @@ static bool set_cursor(struct wlr_output *output, const uint8_t *buf,
 	output->cursor.height = height;
 
 	if (!output->cursor.renderer) {
-		output->cursor.renderer = wlr_gles2_renderer_create(output->backend);
+		if (wlr_backend_get_egl(output->backend) != NULL) {
+			output->cursor.renderer =
+				wlr_gles2_renderer_create(output->backend);
+		} else {
+			output->cursor.renderer = wlr_pixman_renderer_create();
+		}
 		if (!output->cursor.renderer) {
 			return false;
 		}
@@ -219,8 +279,10 @@ static bool set_cursor(struct wlr_output *output, const uint8_t *buf,
 		}
 	}
 
-	return wlr_texture_upload_pixels(output->cursor.texture,
+	bool ok = wlr_texture_upload_pixels(output->cursor.texture,
 		WL_SHM_FORMAT_ARGB8888, stride, width, height, buf);
+	output_cursor_damage(output);
+	return ok;
 }
 
 bool wlr_output_set_cursor(struct wlr_output *output,
@@ -277,6 +339,10 @@ static void handle_cursor_surface_commit(struct wl_listener *listener,
 
 	commit_cursor_surface(output, surface);
 
+	if (output->cursor.is_sw) {
+		output_cursor_damage(output);
+	}
+
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
@@ -296,6 +362,7 @@ static void handle_cursor_surface_destroy(struct wl_listener *listener,
 	wl_list_remove(&output->cursor.surface_commit.link);
 	wl_list_remove(&output->cursor.surface_destroy.link);
 	output->cursor.surface = NULL;
+	output_cursor_damage(output);
 }
 
 void wlr_output_set_cursor_surface(struct wlr_output *output,
@@ -338,24 +405,59 @@ void wlr_output_set_cursor_surface(struct wlr_output *output,
 		wl_signal_add(&surface->events.destroy,
 			&output->cursor.surface_destroy);
 		commit_cursor_surface(output, surface);
+		output_cursor_damage(output);
 	} else {
 		set_cursor(output, NULL, 0, 0, 0, hotspot_x, hotspot_y);
 	}
 }
 
 bool wlr_output_move_cursor(struct wlr_output *output, int x, int y) {
-	output->cursor.x = x;
-	output->cursor.y = y;
-
 	if (output->cursor.is_sw) {
+		if (output->cursor.x != x || output->cursor.y != y) {
+			output->cursor.x = x;
+			output->cursor.y = y;
+			output_cursor_damage(output);
+		}
 		return true;
 	}
 
+	output->cursor.x = x;
+	output->cursor.y = y;
+
 	if (!output->impl->move_cursor) {
 		return false;
 	}
 
-	return output->impl->move_cursor(output, x, y);
+	if (output->wl_global == NULL) {
+		// Frames can't be scheduled before the output is advertised
+		return output->impl->move_cursor(output, x, y);
+	}
+
+	// Only the last position before the frame matters, see
+	// wlr_output_send_frame
+	output->cursor.move_pending = true;
+	wlr_output_schedule_frame(output);
+	return true;
+}
+
+static void output_apply_cursor_move(struct wlr_output *output) {
+	if (!output->cursor.move_pending) {
+		return;
+	}
+	output->cursor.move_pending = false;
+	if (output->cursor.is_sw || !output->impl->move_cursor) {
+		return;
+	}
+
+	// The caller of wlr_output_move_cursor is long gone, only report the
+	// first failure of a series
+	bool ok = output->impl->move_cursor(output, output->cursor.x,
+		output->cursor.y);
+	if (!ok && !output->cursor.move_failed) {
+		wlr_log(L_ERROR, "%s: Failed to move hardware cursor to %d,%d",
+			output->name, output->cursor.x, output->cursor.y);
+	}
+	output->cursor.move_failed = !ok;
 }
 
 void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
@@ -369,6 +471,7 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	wl_signal_init(&output->events.swap_buffers);
 	wl_signal_init(&output->events.resolution);
 	wl_signal_init(&output->events.destroy);
+	pixman_region32_init(&output->damage);
 
 	wl_list_init(&output->cursor.surface_commit.link);
 	output->cursor.surface_commit.notify = handle_cursor_surface_commit;
@@ -383,8 +486,16 @@ void wlr_output_destroy(struct wlr_output *output) {
 
 	wl_signal_emit(&output->events.destroy, output);
 
+	if (output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+	}
+	if (output->frame_schedule.timer != NULL) {
+		wl_event_source_remove(output->frame_schedule.timer);
+	}
+
 	wlr_texture_destroy(output->cursor.texture);
 	wlr_renderer_destroy(output->cursor.renderer);
+	pixman_region32_fini(&output->damage);
 
 	struct wlr_output_mode *mode, *tmp_mode;
 	wl_list_for_each_safe(mode, tmp_mode, &output->modes, link) {
@@ -410,36 +521,235 @@ void wlr_output_effective_resolution(struct wlr_output *output,
 	}
 }
 
-void wlr_output_make_current(struct wlr_output *output) {
-	output->impl->make_current(output);
+void wlr_output_project_box(struct wlr_output *output, const struct wlr_box *box,
+		struct wlr_box *dest) {
+	const float *m = output->transform_matrix;
+	int x1 = box->x, y1 = box->y;
+	int x2 = box->x + box->width, y2 = box->y + box->height;
+
+	// From output-local coordinates to normalized device coordinates
+	double nx1 = m[0] * x1 + m[1] * y1 + m[3];
+	double ny1 = m[4] * x1 + m[5] * y1 + m[7];
+	double nx2 = m[0] * x2 + m[1] * y2 + m[3];
+	double ny2 = m[4] * x2 + m[5] * y2 + m[7];
+
+	// From normalized device coordinates to pixels
+	nx1 = (nx1 + 1) / 2 * output->width;
+	ny1 = (ny1 + 1) / 2 * output->height;
+	nx2 = (nx2 + 1) / 2 * output->width;
+	ny2 = (ny2 + 1) / 2 * output->height;
+
+	dest->x = round(fmin(nx1, nx2));
+	dest->y = round(fmin(ny1, ny2));
+	dest->width = round(fabs(nx2 - nx1));
+	dest->height = round(fabs(ny2 - ny1));
+}
+
+// Time added to the measured rendering time when the frame margin is adaptive
+#define FRAME_MARGIN_SLACK_US 2000
+
+static int64_t timespec_to_usec(const struct timespec *a) {
+	return (int64_t)a->tv_sec * 1000000 + a->tv_nsec / 1000;
+}
+
+static void update_render_time(struct wlr_output *output) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t elapsed = timespec_to_usec(&now) -
+		timespec_to_usec(&output->frame_schedule.frame_sent);
+	if (elapsed < 0 || elapsed > 1000000) {
+		return;
+	}
+
+	// Follow increases immediately but decrease slowly, a missed vblank is
+	// worse than a bit more latency
+	int *render_time = &output->frame_schedule.render_time;
+	if (elapsed > *render_time) {
+		*render_time = elapsed;
+	} else {
+		*render_time = (*render_time * 7 + elapsed) / 8;
+	}
+}
+
+bool wlr_output_make_current(struct wlr_output *output, int *buffer_age) {
+	return output->impl->make_current(output, buffer_age);
 }
 
 void wlr_output_swap_buffers(struct wlr_output *output) {
+	struct wlr_box *drawn_box = &output->cursor.drawn_box;
+	drawn_box->width = drawn_box->height = 0;
 	if (output->cursor.is_sw) {
-		glViewport(0, 0, output->width, output->height);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-		struct wlr_texture *texture = output->cursor.texture;
+		struct wlr_texture *texture = output_cursor_get_texture(output);
 		struct wlr_renderer *renderer = output->cursor.renderer;
 		if (output->cursor.surface) {
-			texture = output->cursor.surface->texture;
 			renderer = output->cursor.surface->renderer;
 		}
 
 		// We check texture->valid because some clients set a cursor surface
 		// with a NULL buffer to hide it
 		if (renderer && texture && texture->valid) {
+			// The renderer enables blending if the cursor has an alpha
+			// channel. Pixman renderers draw into the current image.
+			if (!wlr_renderer_is_pixman(renderer)) {
+				glViewport(0, 0, output->width, output->height);
+			}
+
 			float matrix[16];
 			wlr_texture_get_matrix(texture, &matrix, &output->transform_matrix,
 				output->cursor.x, output->cursor.y);
 			wlr_render_with_matrix(renderer, texture, &matrix);
+
+			drawn_box->x = output->cursor.x;
+			drawn_box->y = output->cursor.y;
+			drawn_box->width = texture->width;
+			drawn_box->height = texture->height;
 		}
 	}
 
 	wl_signal_emit(&output->events.swap_buffers, &output);
 
 	output->impl->swap_buffers(output);
+
+	if (!output->frame_pending && output->frame_schedule.margin != 0) {
+		update_render_time(output);
+	}
+
+	output->needs_swap = false;
+	pixman_region32_clear(&output->damage);
+	output->frame_pending = true;
+}
+
+bool wlr_output_scanout_surface(struct wlr_output *output,
+		struct wlr_surface *surface) {
+	if (!output->impl->scanout_surface || output->cursor.is_sw) {
+		return false;
+	}
+
+	struct wlr_surface_state *state = surface->current;
+	if (state->buffer == NULL || !surface->texture->valid ||
+			state->buffer_width != output->width ||
+			state->buffer_height != output->height ||
+			state->transform != output->transform) {
+		return false;
+	}
+
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
+		if (subsurface->surface->texture->valid) {
+			return false;
+		}
+	}
+
+	if (!output->impl->scanout_surface(output, surface)) {
+		return false;
+	}
+
+	output->needs_swap = false;
+	pixman_region32_clear(&output->damage);
+	output->frame_pending = true;
+	return true;
+}
+
+bool wlr_output_attach_overlay(struct wlr_output *output,
+		struct wlr_surface *surface, int x, int y) {
+	// The software cursor would be hidden below the plane
+	if (!output->impl->attach_overlay || output->cursor.is_sw) {
+		return false;
+	}
+
+	// Planes show the buffer as is, one buffer pixel per output pixel.
+	// Transformed or scaled surfaces and outputs are composited instead.
+	struct wlr_surface_state *state = surface->current;
+	if (state->buffer == NULL || !surface->texture->valid ||
+			state->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+			state->scale != 1 || output->scale != 1 ||
+			output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
+
+	return output->impl->attach_overlay(output, surface, x, y);
+}
+
+void wlr_output_send_frame(struct wlr_output *output) {
+	// The backend may need the frame to be swapped to apply the move, in which
+	// case it sets needs_swap. This frame event is already on its way, so it
+	// doesn't need to schedule another one.
+	output_apply_cursor_move(output);
+	output->frame_pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &output->frame_schedule.frame_sent);
+	wl_signal_emit(&output->events.frame, output);
+}
+
+static int frame_schedule_handle_timer(void *data) {
+	struct wlr_output *output = data;
+	wlr_output_send_frame(output);
+	return 0;
+}
+
+void wlr_output_handle_vblank(struct wlr_output *output,
+		const struct timespec *when) {
+	int margin = output->frame_schedule.margin;
+	if (margin == 0 || output->current_mode == NULL ||
+			output->current_mode->refresh <= 0 || output->wl_global == NULL) {
+		wlr_output_send_frame(output);
+		return;
+	}
+
+	int64_t refresh_us = 1000000000LL / output->current_mode->refresh;
+	int64_t margin_us;
+	if (margin == WLR_OUTPUT_FRAME_MARGIN_ADAPTIVE) {
+		margin_us = output->frame_schedule.render_time +
+			FRAME_MARGIN_SLACK_US;
+	} else {
+		margin_us = (int64_t)margin * 1000;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t next_frame_us = timespec_to_usec(when) + refresh_us - margin_us;
+	int64_t delay_ms = (next_frame_us - timespec_to_usec(&now)) / 1000;
+	if (delay_ms <= 0) {
+		wlr_output_send_frame(output);
+		return;
+	}
+
+	if (output->frame_schedule.timer == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->frame_schedule.timer =
+			wl_event_loop_add_timer(ev, frame_schedule_handle_timer, output);
+		if (output->frame_schedule.timer == NULL) {
+			wlr_output_send_frame(output);
+			return;
+		}
+	}
+	wl_event_source_timer_update(output->frame_schedule.timer, delay_ms);
+}
+
+void wlr_output_set_frame_margin(struct wlr_output *output, int margin_ms) {
+	output->frame_schedule.margin = margin_ms;
+}
+
+static void schedule_frame_handle_idle(void *data) {
+	struct wlr_output *output = data;
+	output->idle_frame = NULL;
+	if (!output->frame_pending) {
+		wlr_output_send_frame(output);
+	}
+}
+
+void wlr_output_schedule_frame(struct wlr_output *output) {
+	if (output->frame_pending || output->idle_frame != NULL ||
+			output->wl_global == NULL) {
+		return;
+	}
+
+	// Nothing is being displayed, so there is no vblank to wait for: the next
+	// swap is presented as soon as possible anyway. Sending the frame event
+	// from an idle source lets all changes made during this dispatch be
+	// rendered at once.
+	struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+	output->idle_frame =
+		wl_event_loop_add_idle(ev, schedule_frame_handle_idle, output);
 }
 
 void wlr_output_set_gamma(struct wlr_output *output,
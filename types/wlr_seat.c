@@ -161,6 +161,61 @@ static void wl_seat_get_touch(struct wl_client *client,
 		handle, &wl_touch_destroy);
 }
 
+/**
+ * Index of the seat handles of a client, attached to the wl_client through its
+ * destroy listener. Looking up a handle doesn't depend on the number of
+ * clients.
+ */
+struct seat_client_index {
+	struct wl_listener client_destroy;
+	struct wl_list handles; // wlr_seat_handle::client_link
+};
+
+static void seat_client_index_destroy(struct seat_client_index *index) {
+	struct wlr_seat_handle *handle, *tmp;
+	wl_list_for_each_safe(handle, tmp, &index->handles, client_link) {
+		wl_list_remove(&handle->client_link);
+		wl_list_init(&handle->client_link);
+	}
+	wl_list_remove(&index->client_destroy.link);
+	free(index);
+}
+
+static void seat_client_index_handle_client_destroy(
+		struct wl_listener *listener, void *data) {
+	struct seat_client_index *index =
+		wl_container_of(listener, index, client_destroy);
+	seat_client_index_destroy(index);
+}
+
+static struct seat_client_index *seat_client_index_get(
+		struct wl_client *client) {
+	struct wl_listener *listener = wl_client_get_destroy_listener(client,
+		seat_client_index_handle_client_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct seat_client_index *index;
+	return wl_container_of(listener, index, client_destroy);
+}
+
+static struct seat_client_index *seat_client_index_get_or_create(
+		struct wl_client *client) {
+	struct seat_client_index *index = seat_client_index_get(client);
+	if (index != NULL) {
+		return index;
+	}
+
+	index = calloc(1, sizeof(struct seat_client_index));
+	if (index == NULL) {
+		return NULL;
+	}
+	wl_list_init(&index->handles);
+	index->client_destroy.notify = seat_client_index_handle_client_destroy;
+	wl_client_add_destroy_listener(client, &index->client_destroy);
+	return index;
+}
+
 static void wlr_seat_handle_resource_destroy(struct wl_resource *resource) {
 	struct wlr_seat_handle *handle = wl_resource_get_user_data(resource);
 	wl_signal_emit(&handle->wlr_seat->events.client_unbound, handle);
@@ -185,6 +240,14 @@ static void wlr_seat_handle_resource_destroy(struct wl_resource *resource) {
 		wl_resource_destroy(handle->data_device);
 	}
 	wl_list_remove(&handle->link);
+
+	// The index is already gone if the client is being destroyed
+	wl_list_remove(&handle->client_link);
+	struct seat_client_index *index =
+		seat_client_index_get(wl_resource_get_client(resource));
+	if (index != NULL && wl_list_empty(&index->handles)) {
+		seat_client_index_destroy(index);
+	}
 	free(handle);
 }
 
@@ -200,6 +263,13 @@ static void wl_seat_bind(struct wl_client *wl_client, void *_wlr_seat,
 	struct wlr_seat *wlr_seat = _wlr_seat;
 	assert(wl_client && wlr_seat);
 
+	struct seat_client_index *index =
+		seat_client_index_get_or_create(wl_client);
+	if (index == NULL) {
+		wl_client_post_no_memory(wl_client);
+		return;
+	}
+
 	struct wlr_seat_handle *handle = calloc(1, sizeof(struct wlr_seat_handle));
 	handle->wl_resource = wl_resource_create(
 			wl_client, &wl_seat_interface, version, id);
@@ -207,6 +277,7 @@ static void wl_seat_bind(struct wl_client *wl_client, void *_wlr_seat,
 	wl_resource_set_implementation(handle->wl_resource, &wl_seat_impl,
 		handle, wlr_seat_handle_resource_destroy);
 	wl_list_insert(&wlr_seat->handles, &handle->link);
+	wl_list_insert(&index->handles, &handle->client_link);
 	if (version >= WL_SEAT_NAME_SINCE_VERSION) {
 		wl_seat_send_name(handle->wl_resource, wlr_seat->name);
 	}
@@ -360,9 +431,15 @@ void wlr_seat_destroy(struct wlr_seat *wlr_seat) {
 struct wlr_seat_handle *wlr_seat_handle_for_client(struct wlr_seat *wlr_seat,
 		struct wl_client *client) {
 	assert(wlr_seat);
+	struct seat_client_index *index = seat_client_index_get(client);
+	if (index == NULL) {
+		return NULL;
+	}
+
+	// A client binds each seat once in general, the newest binding wins
 	struct wlr_seat_handle *handle;
-	wl_list_for_each(handle, &wlr_seat->handles, link) {
-		if (wl_resource_get_client(handle->wl_resource) == client) {
+	wl_list_for_each(handle, &index->handles, client_link) {
+		if (handle->wlr_seat == wlr_seat) {
 			return handle;
 		}
 	}
@@ -4,6 +4,7 @@
 #include <wlr/util/log.h>
 #include <wlr/render/interface.h>
 #include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/matrix.h>
 
@@ -22,9 +23,71 @@ static void buffer_destroy(struct wl_listener *listener, void *data) {
 	state->buffer = NULL;
 }
 
+struct wlr_buffer_lock {
+	struct wl_resource *buffer; // NULL if destroyed
+	size_t locks;
+	bool release_pending;
+	struct wl_listener buffer_destroy;
+};
+
+static void buffer_lock_handle_buffer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_buffer_lock *lock =
+		wl_container_of(listener, lock, buffer_destroy);
+	wl_list_remove(&lock->buffer_destroy.link);
+	wl_list_init(&lock->buffer_destroy.link);
+	lock->buffer = NULL;
+}
+
+static struct wlr_buffer_lock *buffer_lock_get(struct wl_resource *buffer) {
+	struct wl_listener *listener = wl_resource_get_destroy_listener(buffer,
+		buffer_lock_handle_buffer_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_buffer_lock *lock;
+	return wl_container_of(listener, lock, buffer_destroy);
+}
+
+struct wlr_buffer_lock *wlr_buffer_lock(struct wl_resource *buffer) {
+	struct wlr_buffer_lock *lock = buffer_lock_get(buffer);
+	if (lock == NULL) {
+		lock = calloc(1, sizeof(struct wlr_buffer_lock));
+		if (lock == NULL) {
+			return NULL;
+		}
+		lock->buffer = buffer;
+		lock->buffer_destroy.notify = buffer_lock_handle_buffer_destroy;
+		wl_resource_add_destroy_listener(buffer, &lock->buffer_destroy);
+	}
+	lock->locks++;
+	return lock;
+}
+
+void wlr_buffer_unlock(struct wlr_buffer_lock *lock) {
+	if (lock == NULL) {
+		return;
+	}
+	assert(lock->locks > 0);
+	if (--lock->locks > 0) {
+		return;
+	}
+	if (lock->buffer && lock->release_pending) {
+		wl_resource_post_event(lock->buffer, WL_BUFFER_RELEASE);
+	}
+	wl_list_remove(&lock->buffer_destroy.link);
+	free(lock);
+}
+
 static void wlr_surface_state_release_buffer(struct wlr_surface_state *state) {
 	if (state->buffer) {
-		wl_resource_post_event(state->buffer, WL_BUFFER_RELEASE);
+		struct wlr_buffer_lock *lock = buffer_lock_get(state->buffer);
+		if (lock != NULL) {
+			// Released once the last lock is dropped
+			lock->release_pending = true;
+		} else {
+			wl_resource_post_event(state->buffer, WL_BUFFER_RELEASE);
+		}
 		wl_list_remove(&state->buffer_destroy_listener.link);
 		state->buffer = NULL;
 	}
@@ -267,6 +330,13 @@ static void wlr_surface_move_state(struct wlr_surface *surface, struct wlr_surfa
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_BUFFER)) {
 		wlr_surface_state_release_buffer(state);
+		if (next->buffer) {
+			struct wlr_buffer_lock *lock = buffer_lock_get(next->buffer);
+			if (lock != NULL) {
+				// Committed again, the client must not get it back yet
+				lock->release_pending = false;
+			}
+		}
 		wlr_surface_state_set_buffer(state, next->buffer);
 		wlr_surface_state_reset_buffer(next);
 		state->sx = next->sx;
@@ -310,8 +380,7 @@ static void wlr_surface_move_state(struct wlr_surface *surface, struct wlr_surfa
 			state->buffer_width, state->buffer_height);
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_OPAQUE_REGION)) {
-		// TODO: process buffer
-		pixman_region32_clear(&next->opaque);
+		pixman_region32_copy(&state->opaque, &next->opaque);
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_INPUT_REGION)) {
 		// TODO: process buffer
@@ -353,53 +422,103 @@ static void wlr_surface_damage_subsurfaces(struct wlr_subsurface *subsurface) {
 
 static void wlr_surface_flush_damage(struct wlr_surface *surface,
 		bool reupload_buffer) {
+	surface->upload_bytes = 0;
+	struct wl_shm_buffer *buffer = NULL;
+	if (surface->current->buffer) {
+		buffer = wl_shm_buffer_get(surface->current->buffer);
+	}
+	if (!buffer) {
+		// The previous buffer has been released, the texture must not sample
+		// it anymore
+		wlr_texture_import_shm(surface->texture, NULL);
+	}
+
 	if (!surface->current->buffer) {
 		return;
 	}
-	struct wl_shm_buffer *buffer = wl_shm_buffer_get(surface->current->buffer);
 	if (!buffer) {
 		if (wlr_renderer_buffer_is_drm(surface->renderer,
 					surface->current->buffer)) {
 			wlr_texture_upload_drm(surface->texture, surface->current->buffer);
-			goto release;
+			// Keep the buffer until the next one is committed, it is used
+			// directly for rendering and may be scanned out
+			return;
+		} else if (wlr_dmabuf_resource_is_buffer(surface->current->buffer)) {
+			// The dmabuf is sampled directly, it must not be released
+			// before the next buffer is committed
+			wlr_texture_upload_dmabuf(surface->texture,
+				surface->current->buffer);
+			return;
 		} else {
 			wlr_log(L_INFO, "Unknown buffer handle attached");
 			return;
 		}
 	}
 
+	if (wlr_texture_import_shm(surface->texture, surface->current->buffer)) {
+		// The texture samples the buffer directly, keep it until the next
+		// one is committed
+		return;
+	}
+
 	uint32_t format = wl_shm_buffer_get_format(buffer);
 	if (reupload_buffer) {
 		wlr_texture_upload_shm(surface->texture, format, buffer);
 	} else {
-		pixman_region32_t damage = surface->current->buffer_damage;
-		if (!pixman_region32_not_empty(&damage)) {
+		if (!pixman_region32_not_empty(&surface->current->buffer_damage)) {
 			goto release;
 		}
-		int n;
-		pixman_box32_t *rects = pixman_region32_rectangles(&damage, &n);
-		for (int i = 0; i < n; ++i) {
-			pixman_box32_t rect = rects[i];
-			if (!wlr_texture_update_shm(surface->texture, format,
-					rect.x1, rect.y1,
-					rect.x2 - rect.x1,
-					rect.y2 - rect.y1,
-					buffer)) {
-				break;
-			}
-		}
+		wlr_texture_update_shm(surface->texture, format,
+			&surface->current->buffer_damage, buffer);
 	}
+	surface->upload_bytes = surface->texture->upload_bytes;
 
 release:
+	wlr_surface_state_release_buffer(surface->current);
+}
+
+static void wlr_surface_clear_damage(struct wlr_surface *surface) {
 	pixman_region32_clear(&surface->current->surface_damage);
 	pixman_region32_clear(&surface->current->buffer_damage);
 
-	wlr_surface_state_release_buffer(surface->current);
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
+		wlr_surface_clear_damage(subsurface->surface);
+	}
+}
+
+static void wlr_surface_update_opaque_region(struct wlr_surface *surface) {
+	struct wlr_surface_state *state = surface->current;
+	if (!surface->texture->valid) {
+		pixman_region32_clear(&surface->opaque_region);
+		return;
+	}
+	if (!surface->texture->has_alpha) {
+		// Buffers without an alpha channel cover the whole surface
+		pixman_region32_fini(&surface->opaque_region);
+		pixman_region32_init_rect(&surface->opaque_region, 0, 0,
+			state->width, state->height);
+		return;
+	}
+	pixman_region32_intersect_rect(&surface->opaque_region, &state->opaque,
+		0, 0, state->width, state->height);
+}
+
+/**
+ * Marks the cached trees of the surface and of its ancestors as outdated.
+ */
+static void wlr_surface_invalidate_tree(struct wlr_surface *surface) {
+	while (surface) {
+		surface->tree.dirty = true;
+		surface = surface->subsurface ? surface->subsurface->parent : NULL;
+	}
 }
 
 static void wlr_surface_commit_pending(struct wlr_surface *surface) {
 	int32_t oldw = surface->current->buffer_width;
 	int32_t oldh = surface->current->buffer_height;
+	int old_width = surface->current->width;
+	int old_height = surface->current->height;
 
 	bool null_buffer_commit =
 		(surface->pending->invalid & WLR_SURFACE_INVALID_BUFFER &&
@@ -414,6 +533,18 @@ static void wlr_surface_commit_pending(struct wlr_surface *surface) {
 	bool reupload_buffer = oldw != surface->current->buffer_width ||
 		oldh != surface->current->buffer_height;
 	wlr_surface_flush_damage(surface, reupload_buffer);
+	wlr_surface_update_opaque_region(surface);
+
+	if (old_width != surface->current->width ||
+			old_height != surface->current->height) {
+		// The area previously covered by the surface needs to be repainted
+		pixman_region32_union_rect(&surface->current->surface_damage,
+			&surface->current->surface_damage, 0, 0,
+			old_width > surface->current->width ?
+				old_width : surface->current->width,
+			old_height > surface->current->height ?
+				old_height : surface->current->height);
+	}
 
 	// commit subsurface order
 	struct wlr_subsurface *subsurface;
@@ -428,8 +559,13 @@ static void wlr_surface_commit_pending(struct wlr_surface *surface) {
 		}
 	}
 
+	wlr_surface_invalidate_tree(surface);
+
 	// TODO: add the invalid bitfield to this callback
 	wl_signal_emit(&surface->events.commit, surface);
+
+	// This also clears the damage added to reordered subsurfaces
+	wlr_surface_clear_damage(surface);
 }
 
 static bool wlr_subsurface_is_synchronized(struct wlr_subsurface *subsurface) {
@@ -590,6 +726,7 @@ void wlr_subsurface_destroy(struct wlr_subsurface *subsurface) {
 	wlr_surface_state_destroy(subsurface->cached);
 
 	if (subsurface->parent) {
+		wlr_surface_invalidate_tree(subsurface->parent);
 		wl_list_remove(&subsurface->parent_link);
 		wl_list_remove(&subsurface->parent_pending_link);
 		wl_list_remove(&subsurface->parent_destroy_listener.link);
@@ -613,6 +750,8 @@ static void destroy_surface(struct wl_resource *resource) {
 	wlr_texture_destroy(surface->texture);
 	wlr_surface_state_destroy(surface->pending);
 	wlr_surface_state_destroy(surface->current);
+	pixman_region32_fini(&surface->opaque_region);
+	free(surface->tree.entries);
 
 	free(surface);
 }
@@ -631,11 +770,13 @@ struct wlr_surface *wlr_surface_create(struct wl_resource *res,
 
 	surface->current = wlr_surface_state_create();
 	surface->pending = wlr_surface_state_create();
+	pixman_region32_init(&surface->opaque_region);
 
 	wl_signal_init(&surface->events.commit);
 	wl_signal_init(&surface->events.destroy);
 	wl_list_init(&surface->subsurface_list);
 	wl_list_init(&surface->subsurface_pending_list);
+	surface->tree.dirty = true;
 	wl_resource_set_implementation(res, &surface_interface,
 		surface, destroy_surface);
 	return surface;
@@ -654,6 +795,13 @@ void wlr_surface_get_matrix(struct wlr_surface *surface,
 	}
 	wlr_matrix_scale(&scale, width, height, 1);
 	wlr_matrix_mul(matrix, &scale, matrix);
+	if (surface->texture->inverted_y) {
+		// Sample the rows bottom to top
+		wlr_matrix_translate(&scale, 0, 1, 0);
+		wlr_matrix_mul(matrix, &scale, matrix);
+		wlr_matrix_scale(&scale, 1, -1, 1);
+		wlr_matrix_mul(matrix, &scale, matrix);
+	}
 	wlr_matrix_mul(projection, matrix, matrix);
 }
 
@@ -835,6 +983,7 @@ void wlr_surface_make_subsurface(struct wlr_surface *surface,
 	wl_list_insert(&parent->subsurface_list, &subsurface->parent_link);
 	wl_list_insert(&parent->subsurface_pending_list,
 		&subsurface->parent_pending_link);
+	wlr_surface_invalidate_tree(parent);
 
 	struct wl_client *client = wl_resource_get_client(surface->resource);
 
@@ -861,32 +1010,76 @@ struct wlr_surface *wlr_surface_get_main_surface(struct wlr_surface *surface) {
 
 struct wlr_subsurface *wlr_surface_subsurface_at(struct wlr_surface *surface,
 		double sx, double sy, double *sub_x, double *sub_y) {
-	struct wlr_subsurface *subsurface;
-	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
-		double _sub_x = subsurface->surface->current->subsurface_position.x;
-		double _sub_y = subsurface->surface->current->subsurface_position.y;
-		struct wlr_subsurface *sub =
-			wlr_surface_subsurface_at(subsurface->surface, _sub_x + sx,
-				_sub_y + sy, sub_x, sub_y);
-		if (sub) {
-			// TODO: This won't work for nested subsurfaces. Convert sub_x and
-			// sub_y to the parent coordinate system
-			return sub;
-		}
-
-		int sub_width = subsurface->surface->current->buffer_width;
-		int sub_height = subsurface->surface->current->buffer_height;
-		if ((sx > _sub_x && sx < _sub_x + sub_width) &&
-				(sy > _sub_y && sy < _sub_y + sub_height)) {
+	size_t len;
+	const struct wlr_surface_tree_entry *entries =
+		wlr_surface_get_tree(surface, &len);
+
+	// From top to bottom, the first entry is the surface itself
+	for (size_t i = len; i-- > 1;) {
+		const struct wlr_surface_tree_entry *entry = &entries[i];
+		const struct wlr_box *box = &entry->box;
+		if ((sx > box->x && sx < box->x + box->width) &&
+				(sy > box->y && sy < box->y + box->height)) {
 			if (pixman_region32_contains_point(
-						&subsurface->surface->current->input,
-						sx - _sub_x, sy - _sub_y, NULL)) {
-				*sub_x = _sub_x;
-				*sub_y = _sub_y;
-				return subsurface;
+						&entry->surface->current->input,
+						sx - box->x, sy - box->y, NULL)) {
+				*sub_x = box->x;
+				*sub_y = box->y;
+				return entry->surface->subsurface;
 			}
 		}
 	}
 
 	return NULL;
 }
+
+static bool wlr_surface_tree_add(struct wlr_surface *root,
+		struct wlr_surface *surface, int x, int y) {
+	if (root->tree.len == root->tree.cap) {
+		size_t cap = root->tree.cap ? 2 * root->tree.cap : 8;
+		struct wlr_surface_tree_entry *entries = realloc(root->tree.entries,
+			cap * sizeof(struct wlr_surface_tree_entry));
+		if (entries == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return false;
+		}
+		root->tree.entries = entries;
+		root->tree.cap = cap;
+	}
+	root->tree.entries[root->tree.len++] = (struct wlr_surface_tree_entry){
+		.surface = surface,
+		.box = {
+			.x = x,
+			.y = y,
+			.width = surface->current->width,
+			.height = surface->current->height,
+		},
+	};
+
+	if (!surface->texture->valid) {
+		return true;
+	}
+
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
+		struct wlr_surface_state *state = subsurface->surface->current;
+		if (!wlr_surface_tree_add(root, subsurface->surface,
+				x + state->subsurface_position.x,
+				y + state->subsurface_position.y)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const struct wlr_surface_tree_entry *wlr_surface_get_tree(
+		struct wlr_surface *surface, size_t *len) {
+	if (surface->tree.dirty) {
+		surface->tree.len = 0;
+		// Only keep the entries which could be added on failure, and try
+		// again next time
+		surface->tree.dirty = !wlr_surface_tree_add(surface, surface, 0, 0);
+	}
+	*len = surface->tree.len;
+	return surface->tree.entries;
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -117,8 +118,109 @@ static void exec_xwayland(struct wlr_xwayland *wlr_xwayland) {
 }
 
 static bool wlr_xwayland_init(struct wlr_xwayland *wlr_xwayland,
-	struct wl_display *wl_display, struct wlr_compositor *compositor);
+	struct wl_display *wl_display, struct wlr_compositor *compositor,
+	bool lazy);
 static void wlr_xwayland_finish(struct wlr_xwayland *wlr_xwayland);
+static bool xwayland_start_server(struct wlr_xwayland *wlr_xwayland);
+static bool xwayland_listen(struct wlr_xwayland *wlr_xwayland);
+
+static void set_display_env(struct wlr_xwayland *wlr_xwayland) {
+	char display_name[16];
+	snprintf(display_name, sizeof(display_name), ":%d", wlr_xwayland->display);
+	setenv("DISPLAY", display_name, true);
+}
+
+static int xwayland_handle_connection(int fd, uint32_t mask, void *data) {
+	struct wlr_xwayland *wlr_xwayland = data;
+	wlr_log(L_INFO, "X11 client connecting, starting Xwayland");
+
+	for (size_t i = 0; i < 2; i++) {
+		wl_event_source_remove(wlr_xwayland->x_fd_source[i]);
+		wlr_xwayland->x_fd_source[i] = NULL;
+	}
+
+	// The connection is accepted by Xwayland, from the listening socket
+	if (!xwayland_start_server(wlr_xwayland)) {
+		wlr_log(L_ERROR, "Failed to start Xwayland, dropping X11 client");
+		// The pending connection would wake us up again right away
+		safe_close(accept(fd, NULL, NULL));
+		xwayland_listen(wlr_xwayland);
+	}
+	return 0;
+}
+
+/**
+ * Rejects the X11 clients waiting in the backlog of the display sockets.
+ */
+static void xwayland_drop_pending_connections(
+		struct wlr_xwayland *wlr_xwayland) {
+	for (size_t i = 0; i < 2; i++) {
+		// The sockets are blocking, only accept what is already there
+		struct pollfd pfd = { .fd = wlr_xwayland->x_fd[i], .events = POLLIN };
+		while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+			int fd = accept(wlr_xwayland->x_fd[i], NULL, NULL);
+			if (fd < 0) {
+				break;
+			}
+			close(fd);
+		}
+	}
+}
+
+/**
+ * Waits for an X11 client to connect to the display sockets before starting
+ * Xwayland.
+ */
+static bool xwayland_listen(struct wlr_xwayland *wlr_xwayland) {
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(wlr_xwayland->wl_display);
+	for (size_t i = 0; i < 2; i++) {
+		wlr_xwayland->x_fd_source[i] = wl_event_loop_add_fd(loop,
+			wlr_xwayland->x_fd[i], WL_EVENT_READABLE,
+			xwayland_handle_connection, wlr_xwayland);
+		if (!wlr_xwayland->x_fd_source[i]) {
+			wlr_log(L_ERROR, "failed to listen on X11 display sockets");
+			wlr_xwayland_finish(wlr_xwayland);
+			return false;
+		}
+	}
+
+	// Clients can connect right away, the connection waits for Xwayland
+	set_display_env(wlr_xwayland);
+	return true;
+}
+
+/**
+ * Stops Xwayland, but keeps the display sockets open.
+ */
+static void xwayland_finish_server(struct wlr_xwayland *wlr_xwayland) {
+	if (wlr_xwayland->client) {
+		wl_list_remove(&wlr_xwayland->destroy_listener.link);
+		wl_client_destroy(wlr_xwayland->client);
+		wlr_xwayland->client = NULL;
+	}
+	if (wlr_xwayland->sigusr1_source) {
+		wl_event_source_remove(wlr_xwayland->sigusr1_source);
+		wlr_xwayland->sigusr1_source = NULL;
+	}
+	if (wlr_xwayland->idle_source) {
+		wl_event_source_timer_update(wlr_xwayland->idle_source, 0);
+	}
+
+	xwm_destroy(wlr_xwayland->xwm);
+	wlr_xwayland->xwm = NULL;
+
+	safe_close(wlr_xwayland->wl_fd[0]);
+	safe_close(wlr_xwayland->wl_fd[1]);
+	safe_close(wlr_xwayland->wm_fd[0]);
+	safe_close(wlr_xwayland->wm_fd[1]);
+	wlr_xwayland->wl_fd[0] = wlr_xwayland->wl_fd[1] = -1;
+	wlr_xwayland->wm_fd[0] = wlr_xwayland->wm_fd[1] = -1;
+	/* We do not kill the Xwayland process, it dies to broken pipe
+	 * after we close our side of the wm/wl fds. This is more reliable
+	 * than trying to kill something that might no longer be Xwayland.
+	 */
+}
 
 static void xwayland_destroy_event(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland *wlr_xwayland = wl_container_of(listener, wlr_xwayland, destroy_listener);
@@ -126,11 +228,25 @@ static void xwayland_destroy_event(struct wl_listener *listener, void *data) {
 	/* don't call client destroy */
 	wlr_xwayland->client = NULL;
 	wl_list_remove(&wlr_xwayland->destroy_listener.link);
+
+	if (wlr_xwayland->lazy) {
+		xwayland_finish_server(wlr_xwayland);
+		if (time(NULL) - wlr_xwayland->server_start <= 5) {
+			// Xwayland failed to start or crashed right away. The client
+			// which triggered it would start it again right away, in a loop.
+			wlr_log(L_ERROR, "Xwayland exited early, dropping X11 clients");
+			xwayland_drop_pending_connections(wlr_xwayland);
+		}
+		// Started again by the next X11 client
+		xwayland_listen(wlr_xwayland);
+		return;
+	}
+
 	wlr_xwayland_finish(wlr_xwayland);
 
 	if (time(NULL) - wlr_xwayland->server_start > 5) {
 		wlr_xwayland_init(wlr_xwayland, wlr_xwayland->wl_display,
-			wlr_xwayland->compositor);
+			wlr_xwayland->compositor, false);
 	}
 }
 
@@ -138,30 +254,42 @@ static void wlr_xwayland_finish(struct wlr_xwayland *wlr_xwayland) {
 	if (!wlr_xwayland || wlr_xwayland->display == -1) {
 		return;
 	}
-	if (wlr_xwayland->client) {
-		wl_list_remove(&wlr_xwayland->destroy_listener.link);
-		wl_client_destroy(wlr_xwayland->client);
+	xwayland_finish_server(wlr_xwayland);
+
+	for (size_t i = 0; i < 2; i++) {
+		if (wlr_xwayland->x_fd_source[i]) {
+			wl_event_source_remove(wlr_xwayland->x_fd_source[i]);
+			wlr_xwayland->x_fd_source[i] = NULL;
+		}
 	}
-	if (wlr_xwayland->sigusr1_source) {
-		wl_event_source_remove(wlr_xwayland->sigusr1_source);
+	if (wlr_xwayland->idle_source) {
+		wl_event_source_remove(wlr_xwayland->idle_source);
+		wlr_xwayland->idle_source = NULL;
 	}
 
-	xwm_destroy(wlr_xwayland->xwm);
-
 	safe_close(wlr_xwayland->x_fd[0]);
 	safe_close(wlr_xwayland->x_fd[1]);
-	safe_close(wlr_xwayland->wl_fd[0]);
-	safe_close(wlr_xwayland->wl_fd[1]);
-	safe_close(wlr_xwayland->wm_fd[0]);
-	safe_close(wlr_xwayland->wm_fd[1]);
+	wlr_xwayland->x_fd[0] = wlr_xwayland->x_fd[1] = -1;
 
 	unlink_display_sockets(wlr_xwayland->display);
 	wlr_xwayland->display = -1;
 	unsetenv("DISPLAY");
-	/* We do not kill the Xwayland process, it dies to broken pipe
-	 * after we close our side of the wm/wl fds. This is more reliable
-	 * than trying to kill something that might no longer be Xwayland.
-	 */
+}
+
+static int xwayland_handle_idle_timeout(void *data) {
+	struct wlr_xwayland *wlr_xwayland = data;
+	wlr_log(L_INFO, "No X11 window left, stopping Xwayland");
+	xwayland_finish_server(wlr_xwayland);
+	xwayland_listen(wlr_xwayland);
+	return 0;
+}
+
+void xwayland_update_idle(struct wlr_xwayland *wlr_xwayland, bool idle) {
+	if (!wlr_xwayland->idle_source) {
+		return;
+	}
+	wl_event_source_timer_update(wlr_xwayland->idle_source,
+		idle ? wlr_xwayland->idle_timeout : 0);
 }
 
 static int xserver_handle_ready(int signal_number, void *data) {
@@ -183,59 +311,59 @@ static int xserver_handle_ready(int signal_number, void *data) {
 
 	wlr_xwayland->xwm = xwm_create(wlr_xwayland);
 	if (!wlr_xwayland->xwm) {
-		wlr_xwayland_finish(wlr_xwayland);
+		if (wlr_xwayland->lazy) {
+			xwayland_finish_server(wlr_xwayland);
+			xwayland_drop_pending_connections(wlr_xwayland);
+			xwayland_listen(wlr_xwayland);
+		} else {
+			wlr_xwayland_finish(wlr_xwayland);
+		}
 		return 1;
 	}
 
 	wl_event_source_remove(wlr_xwayland->sigusr1_source);
 	wlr_xwayland->sigusr1_source = NULL;
 
-	char display_name[16];
-	snprintf(display_name, sizeof(display_name), ":%d", wlr_xwayland->display);
-	setenv("DISPLAY", display_name, true);
+	set_display_env(wlr_xwayland);
+
+	// Disarmed when the first window is created
+	xwayland_update_idle(wlr_xwayland, true);
 
 	return 1; /* wayland event loop dispatcher's count */
 }
 
-static bool wlr_xwayland_init(struct wlr_xwayland *wlr_xwayland,
-		struct wl_display *wl_display, struct wlr_compositor *compositor) {
-	memset(wlr_xwayland, 0, sizeof(struct wlr_xwayland));
-	wlr_xwayland->wl_display = wl_display;
-	wlr_xwayland->compositor = compositor;
-	wlr_xwayland->x_fd[0] = wlr_xwayland->x_fd[1] = -1;
-	wlr_xwayland->wl_fd[0] = wlr_xwayland->wl_fd[1] = -1;
-	wlr_xwayland->wm_fd[0] = wlr_xwayland->wm_fd[1] = -1;
-	wl_signal_init(&wlr_xwayland->events.new_surface);
-
-	wlr_xwayland->display = open_display_sockets(wlr_xwayland->x_fd);
-	if (wlr_xwayland->display < 0) {
-		wlr_xwayland_finish(wlr_xwayland);
-		return false;
-	}
+/**
+ * Starts Xwayland on the display sockets. On failure, the display sockets are
+ * kept open.
+ */
+static bool xwayland_start_server(struct wlr_xwayland *wlr_xwayland) {
 	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wlr_xwayland->wl_fd) != 0 ||
 			socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wlr_xwayland->wm_fd) != 0) {
 		wlr_log_errno(L_ERROR, "failed to create socketpair");
-		wlr_xwayland_finish(wlr_xwayland);
+		xwayland_finish_server(wlr_xwayland);
 		return false;
 	}
 
 	wlr_xwayland->server_start = time(NULL);
 
-	if (!(wlr_xwayland->client = wl_client_create(wl_display, wlr_xwayland->wl_fd[0]))) {
+	if (!(wlr_xwayland->client = wl_client_create(wlr_xwayland->wl_display, wlr_xwayland->wl_fd[0]))) {
 		wlr_log_errno(L_ERROR, "wl_client_create failed");
-		wlr_xwayland_finish(wlr_xwayland);
+		xwayland_finish_server(wlr_xwayland);
 		return false;
 	}
 
-	// unset $DISPLAY while XWayland starts
-	unsetenv("DISPLAY");
+	// unset $DISPLAY while XWayland starts, unless clients are already
+	// waiting for it
+	if (!wlr_xwayland->lazy) {
+		unsetenv("DISPLAY");
+	}
 
 	wlr_xwayland->wl_fd[0] = -1; /* not ours anymore */
 
 	wlr_xwayland->destroy_listener.notify = xwayland_destroy_event;
 	wl_client_add_destroy_listener(wlr_xwayland->client, &wlr_xwayland->destroy_listener);
 
-	struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
+	struct wl_event_loop *loop = wl_display_get_event_loop(wlr_xwayland->wl_display);
 	wlr_xwayland->sigusr1_source = wl_event_loop_add_signal(loop, SIGUSR1, xserver_handle_ready, wlr_xwayland);
 
 	if ((wlr_xwayland->pid = fork()) == 0) {
@@ -269,32 +397,87 @@ static bool wlr_xwayland_init(struct wlr_xwayland *wlr_xwayland,
 	}
 	if (wlr_xwayland->pid < 0) {
 		wlr_log_errno(L_ERROR, "fork failed");
-		wlr_xwayland_finish(wlr_xwayland);
+		xwayland_finish_server(wlr_xwayland);
 		return false;
 	}
 
-	/* close child fds */
-	close(wlr_xwayland->x_fd[0]);
-	close(wlr_xwayland->x_fd[1]);
+	/* close child fds, the display sockets are kept open to start Xwayland
+	 * again in lazy mode */
+	if (!wlr_xwayland->lazy) {
+		close(wlr_xwayland->x_fd[0]);
+		close(wlr_xwayland->x_fd[1]);
+		wlr_xwayland->x_fd[0] = wlr_xwayland->x_fd[1] = -1;
+	}
 	close(wlr_xwayland->wl_fd[1]);
 	close(wlr_xwayland->wm_fd[1]);
-	wlr_xwayland->x_fd[0] = wlr_xwayland->x_fd[1] = -1;
 	wlr_xwayland->wl_fd[1] = wlr_xwayland->wm_fd[1] = -1;
 
 	return true;
 }
 
+static bool wlr_xwayland_init(struct wlr_xwayland *wlr_xwayland,
+		struct wl_display *wl_display, struct wlr_compositor *compositor,
+		bool lazy) {
+	memset(wlr_xwayland, 0, sizeof(struct wlr_xwayland));
+	wlr_xwayland->wl_display = wl_display;
+	wlr_xwayland->compositor = compositor;
+	wlr_xwayland->lazy = lazy;
+	wlr_xwayland->x_fd[0] = wlr_xwayland->x_fd[1] = -1;
+	wlr_xwayland->wl_fd[0] = wlr_xwayland->wl_fd[1] = -1;
+	wlr_xwayland->wm_fd[0] = wlr_xwayland->wm_fd[1] = -1;
+	wl_signal_init(&wlr_xwayland->events.new_surface);
+
+	wlr_xwayland->display = open_display_sockets(wlr_xwayland->x_fd);
+	if (wlr_xwayland->display < 0) {
+		wlr_xwayland_finish(wlr_xwayland);
+		return false;
+	}
+
+	if (lazy) {
+		return xwayland_listen(wlr_xwayland);
+	}
+	if (!xwayland_start_server(wlr_xwayland)) {
+		wlr_xwayland_finish(wlr_xwayland);
+		return false;
+	}
+	return true;
+}
+
 void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland) {
 	wlr_xwayland_finish(wlr_xwayland);
 	free(wlr_xwayland);
 }
 
 struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
-		struct wlr_compositor *compositor) {
+		struct wlr_compositor *compositor, bool lazy) {
 	struct wlr_xwayland *wlr_xwayland = calloc(1, sizeof(struct wlr_xwayland));
-	if (wlr_xwayland_init(wlr_xwayland, wl_display, compositor)) {
+	if (wlr_xwayland_init(wlr_xwayland, wl_display, compositor, lazy)) {
 		return wlr_xwayland;
 	}
 	free(wlr_xwayland);
 	return NULL;
 }
+
+void wlr_xwayland_set_idle_timeout(struct wlr_xwayland *wlr_xwayland,
+		int timeout_ms) {
+	if (!wlr_xwayland->lazy) {
+		wlr_log(L_ERROR, "Xwayland can only be stopped when idle in lazy mode");
+		return;
+	}
+
+	wlr_xwayland->idle_timeout = timeout_ms;
+	if (timeout_ms <= 0) {
+		if (wlr_xwayland->idle_source) {
+			wl_event_source_remove(wlr_xwayland->idle_source);
+			wlr_xwayland->idle_source = NULL;
+		}
+		return;
+	}
+
+	if (!wlr_xwayland->idle_source) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(wlr_xwayland->wl_display);
+		wlr_xwayland->idle_source = wl_event_loop_add_timer(loop,
+			xwayland_handle_idle_timeout, wlr_xwayland);
+	}
+}
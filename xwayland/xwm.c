@@ -1,7 +1,10 @@
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #endif
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <xcb/composite.h>
 #include <xcb/xfixes.h>
@@ -42,16 +45,111 @@ const char *atom_map[ATOM_LAST] = {
 };
 
 /* General helpers */
-// TODO: replace this with hash table?
-static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
-		xcb_window_t window_id) {
-	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->window_id == window_id) {
-			return surface;
+static uint32_t xwm_map_hash(uint32_t key) {
+	// Finalizer of MurmurHash3, X11 ids are mostly sequential
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+static struct xwm_map_entry *xwm_map_find_entry(struct xwm_map *map,
+		uint32_t key) {
+	size_t mask = map->capacity - 1;
+	for (size_t i = xwm_map_hash(key) & mask;; i = (i + 1) & mask) {
+		struct xwm_map_entry *entry = &map->entries[i];
+		if (entry->key == key || entry->key == 0) {
+			return entry;
+		}
+	}
+}
+
+static struct wlr_xwayland_surface *xwm_map_find(struct xwm_map *map,
+		uint32_t key) {
+	if (map->capacity == 0) {
+		return NULL;
+	}
+	struct xwm_map_entry *entry = xwm_map_find_entry(map, key);
+	if (entry->key != key) {
+		return NULL;
+	}
+	return entry->surface;
+}
+
+static bool xwm_map_insert(struct xwm_map *map, uint32_t key,
+		struct wlr_xwayland_surface *surface) {
+	// Key 0 marks empty slots
+	assert(key != 0);
+
+	// Keep the load factor at most 1/2, so that probe sequences stay short
+	if (2 * (map->len + 1) > map->capacity) {
+		size_t capacity = map->capacity ? 2 * map->capacity : 16;
+		struct xwm_map_entry *entries =
+			calloc(capacity, sizeof(struct xwm_map_entry));
+		if (entries == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return false;
+		}
+
+		struct xwm_map old = *map;
+		map->entries = entries;
+		map->capacity = capacity;
+		for (size_t i = 0; i < old.capacity; i++) {
+			if (old.entries[i].key != 0) {
+				*xwm_map_find_entry(map, old.entries[i].key) = old.entries[i];
+			}
+		}
+		free(old.entries);
+	}
+
+	struct xwm_map_entry *entry = xwm_map_find_entry(map, key);
+	if (entry->key == 0) {
+		entry->key = key;
+		map->len++;
+	}
+	entry->surface = surface;
+	return true;
+}
+
+static void xwm_map_remove(struct xwm_map *map, uint32_t key) {
+	if (map->capacity == 0) {
+		return;
+	}
+	struct xwm_map_entry *entry = xwm_map_find_entry(map, key);
+	if (entry->key == 0) {
+		return;
+	}
+
+	// Move back the entries of the probe sequence which would become
+	// unreachable, there are no tombstones
+	size_t mask = map->capacity - 1;
+	size_t i = entry - map->entries;
+	for (size_t j = (i + 1) & mask; map->entries[j].key != 0;
+			j = (j + 1) & mask) {
+		size_t home = xwm_map_hash(map->entries[j].key) & mask;
+		// Whether home lies cyclically in (i, j]
+		bool in_place = i < j ? (home > i && home <= j) :
+			(home > i || home <= j);
+		if (!in_place) {
+			map->entries[i] = map->entries[j];
+			i = j;
 		}
 	}
-	return NULL;
+	map->entries[i].key = 0;
+	map->entries[i].surface = NULL;
+	map->len--;
+}
+
+static void xwm_map_finish(struct xwm_map *map) {
+	free(map->entries);
+	memset(map, 0, sizeof(*map));
+}
+
+static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
+		xcb_window_t window_id) {
+	return xwm_map_find(&xwm->windows, window_id);
 }
 
 static struct wlr_xwayland_surface *wlr_xwayland_surface_create(
@@ -63,6 +161,10 @@ static struct wlr_xwayland_surface *wlr_xwayland_surface_create(
 		wlr_log(L_ERROR, "Could not allocate wlr xwayland surface");
 		return NULL;
 	}
+	if (!xwm_map_insert(&xwm->windows, window_id, surface)) {
+		free(surface);
+		return NULL;
+	}
 
 	xcb_get_geometry_cookie_t geometry_cookie =
 		xcb_get_geometry(xwm->xcb_conn, window_id);
@@ -192,6 +294,22 @@ static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface) {
 		i, property);
 }
 
+/**
+ * Stops waiting for the wl_surface announced with WL_SURFACE_ID. The map entry
+ * is left alone if another window announced the same id since.
+ */
+static void xsurface_clear_surface_id(struct wlr_xwayland_surface *xsurface) {
+	struct wlr_xwm *xwm = xsurface->xwm;
+	if (xsurface->surface_id == 0) {
+		return;
+	}
+	if (xwm_map_find(&xwm->unpaired_surfaces, xsurface->surface_id) ==
+			xsurface) {
+		xwm_map_remove(&xwm->unpaired_surfaces, xsurface->surface_id);
+	}
+	xsurface->surface_id = 0;
+}
+
 static void wlr_xwayland_surface_destroy(
 		struct wlr_xwayland_surface *xsurface) {
 	wl_signal_emit(&xsurface->events.destroy, xsurface);
@@ -201,9 +319,14 @@ static void wlr_xwayland_surface_destroy(
 	}
 
 	wl_list_remove(&xsurface->link);
+	if (lookup_surface(xsurface->xwm, xsurface->window_id) == xsurface) {
+		xwm_map_remove(&xsurface->xwm->windows, xsurface->window_id);
+	}
+
+	xsurface_clear_surface_id(xsurface);
 
-	if (xsurface->surface_id) {
-		wl_list_remove(&xsurface->unpaired_link);
+	if (xsurface->pending_props) {
+		wl_list_remove(&xsurface->pending_props_link);
 	}
 
 	if (xsurface->surface) {
@@ -466,16 +589,9 @@ static void read_surface_net_wm_state(struct wlr_xwm *xwm,
 	}
 }
 
-static void read_surface_property(struct wlr_xwm *xwm,
-		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn, 0,
-		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t *reply = xcb_get_property_reply(xwm->xcb_conn,
-		cookie, NULL);
-	if (reply == NULL) {
-		return;
-	}
-
+static void handle_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property,
+		xcb_get_property_reply_t *reply) {
 	if (property == XCB_ATOM_WM_CLASS) {
 		read_surface_class(xwm, xsurface, reply);
 	} else if (property == XCB_ATOM_WM_NAME ||
@@ -500,8 +616,118 @@ static void read_surface_property(struct wlr_xwm *xwm,
 	} else {
 		wlr_log(L_DEBUG, "unhandled x11 property %u", property);
 	}
+}
 
-	free(reply);
+/**
+ * Sends the requests for the properties in the `props` bitmask, which indexes
+ * wlr_xwm::surface_props.
+ */
+static void send_surface_properties(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, uint32_t props,
+		xcb_get_property_cookie_t *cookies) {
+	for (size_t i = 0; i < XWM_SURFACE_PROPS_LEN; i++) {
+		if (props & (1 << i)) {
+			cookies[i] = xcb_get_property(xwm->xcb_conn, 0,
+				xsurface->window_id, xwm->surface_props[i], XCB_ATOM_ANY,
+				0, 2048);
+		}
+	}
+}
+
+static void read_surface_property_replies(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, uint32_t props,
+		xcb_get_property_cookie_t *cookies) {
+	for (size_t i = 0; i < XWM_SURFACE_PROPS_LEN; i++) {
+		if (!(props & (1 << i))) {
+			continue;
+		}
+		xcb_get_property_reply_t *reply =
+			xcb_get_property_reply(xwm->xcb_conn, cookies[i], NULL);
+		if (reply == NULL) {
+			continue;
+		}
+		handle_surface_property(xwm, xsurface, xwm->surface_props[i], reply);
+		free(reply);
+	}
+}
+
+/**
+ * Reads several properties with a single round-trip: every request is sent
+ * before waiting for the first reply.
+ */
+static void read_surface_properties(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, uint32_t props) {
+	xcb_get_property_cookie_t cookies[XWM_SURFACE_PROPS_LEN];
+	send_surface_properties(xwm, xsurface, props, cookies);
+	read_surface_property_replies(xwm, xsurface, props, cookies);
+}
+
+static void xwm_schedule_dispatch(struct wlr_xwm *xwm);
+
+static void xwm_handle_pending_props(void *data) {
+	struct wlr_xwm *xwm = data;
+	xwm->pending_props_idle = NULL;
+
+	// The requests of all surfaces are sent at once too
+	size_t len = wl_list_length(&xwm->pending_props_surfaces);
+	xcb_get_property_cookie_t (*cookies)[XWM_SURFACE_PROPS_LEN] =
+		calloc(len, sizeof(*cookies));
+	if (cookies == NULL) {
+		wlr_log(L_ERROR, "Allocation failed, reading properties one "
+			"surface at a time");
+	}
+
+	struct wlr_xwayland_surface *xsurface, *tmp;
+	size_t i = 0;
+	if (cookies != NULL) {
+		wl_list_for_each(xsurface, &xwm->pending_props_surfaces,
+				pending_props_link) {
+			send_surface_properties(xwm, xsurface, xsurface->pending_props,
+				cookies[i++]);
+		}
+	}
+
+	i = 0;
+	wl_list_for_each_safe(xsurface, tmp, &xwm->pending_props_surfaces,
+			pending_props_link) {
+		uint32_t props = xsurface->pending_props;
+		xsurface->pending_props = 0;
+		wl_list_remove(&xsurface->pending_props_link);
+
+		if (cookies != NULL) {
+			read_surface_property_replies(xwm, xsurface, props, cookies[i++]);
+		} else {
+			read_surface_properties(xwm, xsurface, props);
+		}
+	}
+
+	free(cookies);
+
+	// xcb queued the events received while waiting for the replies, they
+	// don't wake up the event loop anymore
+	if (len > 0) {
+		xwm_schedule_dispatch(xwm);
+	}
+}
+
+/**
+ * Marks properties of a surface as changed. They are read once the event loop
+ * is idle, so that a burst of PropertyNotify events costs a single read.
+ */
+static void xwm_schedule_surface_props(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, uint32_t props) {
+	if (xsurface->pending_props == 0) {
+		wl_list_insert(xwm->pending_props_surfaces.prev,
+			&xsurface->pending_props_link);
+	}
+	xsurface->pending_props |= props;
+
+	if (xwm->pending_props_idle == NULL) {
+		struct wl_event_loop *event_loop =
+			wl_display_get_event_loop(xwm->xwayland->wl_display);
+		xwm->pending_props_idle = wl_event_loop_add_idle(event_loop,
+			xwm_handle_pending_props, xwm);
+	}
 }
 
 static void handle_surface_commit(struct wl_listener *listener, void *data) {
@@ -529,23 +755,13 @@ static void xwm_map_shell_surface(struct wlr_xwm *xwm,
 		struct wlr_surface *surface) {
 	xsurface->surface = surface;
 
-	// read all surface properties
-	const xcb_atom_t props[] = {
-		XCB_ATOM_WM_CLASS,
-		XCB_ATOM_WM_NAME,
-		XCB_ATOM_WM_TRANSIENT_FOR,
-		xwm->atoms[WM_PROTOCOLS],
-		xwm->atoms[WM_HINTS],
-		xwm->atoms[WM_NORMAL_HINTS],
-		xwm->atoms[MOTIF_WM_HINTS],
-		xwm->atoms[NET_WM_STATE],
-		xwm->atoms[NET_WM_WINDOW_TYPE],
-		xwm->atoms[NET_WM_NAME],
-		xwm->atoms[NET_WM_PID],
-	};
-	for (size_t i = 0; i < sizeof(props)/sizeof(xcb_atom_t); i++) {
-		read_surface_property(xwm, xsurface, props[i]);
+	// read all surface properties, including the ones which changed and
+	// haven't been read yet
+	if (xsurface->pending_props) {
+		xsurface->pending_props = 0;
+		wl_list_remove(&xsurface->pending_props_link);
 	}
+	read_surface_properties(xwm, xsurface, (1 << XWM_SURFACE_PROPS_LEN) - 1);
 
 	xsurface->surface_commit.notify = handle_surface_commit;
 	wl_signal_add(&surface->events.commit, &xsurface->surface_commit);
@@ -562,6 +778,19 @@ static void xwm_handle_create_notify(struct wlr_xwm *xwm,
 	wlr_log(L_DEBUG, "XCB_CREATE_NOTIFY (%u)", ev->window);
 	wlr_xwayland_surface_create(xwm, ev->window, ev->x, ev->y,
 		ev->width, ev->height, ev->override_redirect);
+	if (ev->window != xwm->window) {
+		xwayland_update_idle(xwm->xwayland, false);
+	}
+}
+
+static bool xwm_has_client_windows(struct wlr_xwm *xwm) {
+	struct wlr_xwayland_surface *xsurface;
+	wl_list_for_each(xsurface, &xwm->surfaces, link) {
+		if (xsurface->window_id != xwm->window) {
+			return true;
+		}
+	}
+	return false;
 }
 
 static void xwm_handle_destroy_notify(struct wlr_xwm *xwm,
@@ -572,6 +801,9 @@ static void xwm_handle_destroy_notify(struct wlr_xwm *xwm,
 		return;
 	}
 	wlr_xwayland_surface_destroy(xsurface);
+	if (!xwm_has_client_windows(xwm)) {
+		xwayland_update_idle(xwm->xwayland, true);
+	}
 }
 
 static void xwm_handle_configure_request(struct wlr_xwm *xwm,
@@ -670,13 +902,10 @@ static void xwm_handle_unmap_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
-	if (xsurface->surface_id) {
-		// Make sure we're not on the unpaired surface list or we
-		// could be assigned a surface during surface creation that
-		// was mapped before this unmap request.
-		wl_list_remove(&xsurface->unpaired_link);
-		xsurface->surface_id = 0;
-	}
+	// Make sure we're not on the unpaired surface list or we
+	// could be assigned a surface during surface creation that
+	// was mapped before this unmap request.
+	xsurface_clear_surface_id(xsurface);
 
 	if (xsurface->surface) {
 		wl_list_remove(&xsurface->surface_commit.link);
@@ -700,7 +929,13 @@ static void xwm_handle_property_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
-	read_surface_property(xwm, xsurface, ev->atom);
+	for (size_t i = 0; i < XWM_SURFACE_PROPS_LEN; i++) {
+		if (xwm->surface_props[i] == ev->atom) {
+			xwm_schedule_surface_props(xwm, xsurface, 1 << i);
+			return;
+		}
+	}
+	wlr_log(L_DEBUG, "unhandled x11 property %u", ev->atom);
 }
 
 static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
@@ -712,17 +947,23 @@ static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
 			ev->window);
 		return;
 	}
-	/* Check if we got notified after wayland surface create event */
+	xsurface_clear_surface_id(xsurface);
+
 	uint32_t id = ev->data.data32[0];
+	if (id == 0) {
+		wlr_log(L_DEBUG, "client message WL_SURFACE_ID with invalid id 0 "
+			"for window %u", ev->window);
+		return;
+	}
+
+	/* Check if we got notified after wayland surface create event */
 	struct wl_resource *resource =
 		wl_client_get_object(xwm->xwayland->client, id);
 	if (resource) {
 		struct wlr_surface *surface = wl_resource_get_user_data(resource);
-		xsurface->surface_id = 0;
 		xwm_map_shell_surface(xwm, xsurface, surface);
-	} else {
+	} else if (xwm_map_insert(&xwm->unpaired_surfaces, id, xsurface)) {
 		xsurface->surface_id = id;
-		wl_list_insert(&xwm->unpaired_surfaces, &xsurface->unpaired_link);
 	}
 }
 
@@ -892,62 +1133,228 @@ static void xwm_handle_focus_in(struct wlr_xwm *xwm,
  * others redefine anyway is meh
  */
 #define XCB_EVENT_RESPONSE_TYPE_MASK (0x7f)
-static int x11_event_handler(int fd, uint32_t mask, void *data) {
-	int count = 0;
-	xcb_generic_event_t *event;
-	struct wlr_xwm *xwm = data;
+static xcb_window_t event_window(xcb_generic_event_t *event) {
+	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		return ((xcb_create_notify_event_t *)event)->window;
+	case XCB_DESTROY_NOTIFY:
+		return ((xcb_destroy_notify_event_t *)event)->window;
+	case XCB_CONFIGURE_REQUEST:
+		return ((xcb_configure_request_event_t *)event)->window;
+	case XCB_CONFIGURE_NOTIFY:
+		return ((xcb_configure_notify_event_t *)event)->window;
+	case XCB_MAP_REQUEST:
+		return ((xcb_map_request_event_t *)event)->window;
+	case XCB_MAP_NOTIFY:
+		return ((xcb_map_notify_event_t *)event)->window;
+	case XCB_UNMAP_NOTIFY:
+		return ((xcb_unmap_notify_event_t *)event)->window;
+	case XCB_PROPERTY_NOTIFY:
+		return ((xcb_property_notify_event_t *)event)->window;
+	case XCB_CLIENT_MESSAGE:
+		return ((xcb_client_message_event_t *)event)->window;
+	case XCB_FOCUS_IN:
+		return ((xcb_focus_in_event_t *)event)->event;
+	default:
+		return XCB_WINDOW_NONE;
+	}
+}
 
-	while ((event = xcb_poll_for_event(xwm->xcb_conn))) {
-		count++;
-		switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
-		case XCB_CREATE_NOTIFY:
-			xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
-			break;
-		case XCB_CONFIGURE_REQUEST:
-			xwm_handle_configure_request(xwm,
-				(xcb_configure_request_event_t *)event);
-			break;
-		case XCB_CONFIGURE_NOTIFY:
-			xwm_handle_configure_notify(xwm,
-				(xcb_configure_notify_event_t *)event);
-			break;
-		case XCB_MAP_REQUEST:
-			xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
-			break;
-		case XCB_MAP_NOTIFY:
-			xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
-			break;
-		case XCB_UNMAP_NOTIFY:
-			xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
-			break;
-		case XCB_PROPERTY_NOTIFY:
-			xwm_handle_property_notify(xwm,
-				(xcb_property_notify_event_t *)event);
-			break;
-		case XCB_CLIENT_MESSAGE:
-			xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
-			break;
-		case XCB_FOCUS_IN:
-			xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
+/**
+ * Carries the changes of an earlier ConfigureRequest over to a later one. The
+ * values the later one doesn't set hold the current geometry of the window,
+ * they are replaced by the earlier requested values.
+ */
+static void merge_configure_request(xcb_configure_request_event_t *next,
+		xcb_configure_request_event_t *prev) {
+	uint16_t mask = prev->value_mask & ~next->value_mask;
+	if (mask & XCB_CONFIG_WINDOW_X) {
+		next->x = prev->x;
+	}
+	if (mask & XCB_CONFIG_WINDOW_Y) {
+		next->y = prev->y;
+	}
+	if (mask & XCB_CONFIG_WINDOW_WIDTH) {
+		next->width = prev->width;
+	}
+	if (mask & XCB_CONFIG_WINDOW_HEIGHT) {
+		next->height = prev->height;
+	}
+	if (mask & XCB_CONFIG_WINDOW_BORDER_WIDTH) {
+		next->border_width = prev->border_width;
+	}
+	if (mask & XCB_CONFIG_WINDOW_SIBLING) {
+		next->sibling = prev->sibling;
+	}
+	if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+		next->stack_mode = prev->stack_mode;
+	}
+	next->value_mask |= mask;
+}
+
+/**
+ * Drops the ConfigureRequest and ConfigureNotify events which are followed by
+ * another one of the same type for the same window, with no other event for
+ * this window in between. Only the geometry of the last one matters.
+ */
+static void xwm_collapse_events(struct wlr_xwm *xwm) {
+	for (size_t i = xwm->events_pos; i < xwm->events_len; i++) {
+		xcb_generic_event_t *event = xwm->events[i];
+		uint8_t type = event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK;
+		if (type != XCB_CONFIGURE_REQUEST && type != XCB_CONFIGURE_NOTIFY) {
+			continue;
+		}
+
+		xcb_window_t window = event_window(event);
+		for (size_t j = i + 1; j < xwm->events_len; j++) {
+			xcb_generic_event_t *next = xwm->events[j];
+			if (next == NULL || event_window(next) != window) {
+				continue;
+			}
+			if ((next->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) == type) {
+				if (type == XCB_CONFIGURE_REQUEST) {
+					merge_configure_request(
+						(xcb_configure_request_event_t *)next,
+						(xcb_configure_request_event_t *)event);
+				}
+				free(event);
+				xwm->events[i] = NULL;
+				xwm->xwayland->stats.collapsed_events++;
+			}
 			break;
-		default:
-			wlr_log(L_DEBUG, "X11 event: %d",
-				event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK);
+		}
+	}
+}
+
+static bool xwm_read_events(struct wlr_xwm *xwm) {
+	xwm->events_len = xwm->events_pos = 0;
+	xcb_generic_event_t *event;
+	while (xwm->events_len < XWM_DISPATCH_MAX_EVENTS &&
+			(event = xcb_poll_for_event(xwm->xcb_conn))) {
+		xwm->events[xwm->events_len++] = event;
+	}
+	xwm_collapse_events(xwm);
+	return xwm->events_len > 0;
+}
+
+static void xwm_handle_event(struct wlr_xwm *xwm, xcb_generic_event_t *event) {
+	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		xwm_handle_configure_request(xwm,
+			(xcb_configure_request_event_t *)event);
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		xwm_handle_configure_notify(xwm,
+			(xcb_configure_notify_event_t *)event);
+		break;
+	case XCB_MAP_REQUEST:
+		xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
+		break;
+	case XCB_MAP_NOTIFY:
+		xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
+		break;
+	case XCB_UNMAP_NOTIFY:
+		xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		xwm_handle_property_notify(xwm,
+			(xcb_property_notify_event_t *)event);
+		break;
+	case XCB_CLIENT_MESSAGE:
+		xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
+		break;
+	case XCB_FOCUS_IN:
+		xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
+		break;
+	default:
+		wlr_log(L_DEBUG, "X11 event: %d",
+			event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK);
+		break;
+	}
+}
+
+static int64_t get_time_usec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int xwm_handle_dispatch_timer(void *data);
+
+/**
+ * Handles at most XWM_DISPATCH_MAX_EVENTS events or XWM_DISPATCH_MAX_USEC of
+ * work, so that a client flooding the window manager can't starve rendering
+ * and input. The remaining events are handled from a timer, so that the event
+ * loop polls its other sources first: an idle source would run right away.
+ */
+static int xwm_dispatch_events(struct wlr_xwm *xwm) {
+	int64_t start = get_time_usec();
+	int count = 0;
+	bool done = false;
+
+	while (count < XWM_DISPATCH_MAX_EVENTS) {
+		if (xwm->events_pos == xwm->events_len && !xwm_read_events(xwm)) {
+			done = true;
 			break;
 		}
+
+		xcb_generic_event_t *event = xwm->events[xwm->events_pos++];
+		if (event == NULL) {
+			continue;
+		}
+		xwm_handle_event(xwm, event);
 		free(event);
+		count++;
+
+		if (get_time_usec() - start >= XWM_DISPATCH_MAX_USEC) {
+			break;
+		}
 	}
+	xwm->xwayland->stats.processed_events += count;
 
 	if (count) {
 		xcb_flush(xwm->xcb_conn);
 	}
 
+	// Events read by xcb don't wake up the event loop anymore
+	if (!done) {
+		xwm_schedule_dispatch(xwm);
+	}
+
 	return count;
 }
 
+static int xwm_handle_dispatch_timer(void *data) {
+	struct wlr_xwm *xwm = data;
+	xwm_dispatch_events(xwm);
+	return 0;
+}
+
+static void xwm_schedule_dispatch(struct wlr_xwm *xwm) {
+	if (xwm->dispatch_timer == NULL) {
+		struct wl_event_loop *event_loop =
+			wl_display_get_event_loop(xwm->xwayland->wl_display);
+		xwm->dispatch_timer = wl_event_loop_add_timer(event_loop,
+			xwm_handle_dispatch_timer, xwm);
+	}
+	if (xwm->dispatch_timer != NULL) {
+		wl_event_source_timer_update(xwm->dispatch_timer, 1);
+	} else {
+		wlr_log(L_ERROR, "Failed to create X11 dispatch timer");
+	}
+}
+
+static int x11_event_handler(int fd, uint32_t mask, void *data) {
+	struct wlr_xwm *xwm = data;
+	return xwm_dispatch_events(xwm);
+}
+
 static void handle_compositor_surface_create(struct wl_listener *listener,
 		void *data) {
 	struct wlr_surface *surface = data;
@@ -960,16 +1367,16 @@ static void handle_compositor_surface_create(struct wl_listener *listener,
 	wlr_log(L_DEBUG, "New xwayland surface: %p", surface);
 
 	uint32_t surface_id = wl_resource_get_id(surface->resource);
-	struct wlr_xwayland_surface *xsurface;
-	wl_list_for_each(xsurface, &xwm->unpaired_surfaces, unpaired_link) {
-		if (xsurface->surface_id == surface_id) {
-			xwm_map_shell_surface(xwm, xsurface, surface);
-			xsurface->surface_id = 0;
-			wl_list_remove(&xsurface->unpaired_link);
-			xcb_flush(xwm->xcb_conn);
-			return;
-		}
+	struct wlr_xwayland_surface *xsurface =
+		xwm_map_find(&xwm->unpaired_surfaces, surface_id);
+	if (xsurface == NULL) {
+		return;
 	}
+
+	xwm_map_shell_surface(xwm, xsurface, surface);
+	xsurface->surface_id = 0;
+	xwm_map_remove(&xwm->unpaired_surfaces, surface_id);
+	xcb_flush(xwm->xcb_conn);
 }
 
 void wlr_xwayland_surface_activate(struct wlr_xwayland *wlr_xwayland,
@@ -1036,10 +1443,21 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	if (xwm->event_source) {
 		wl_event_source_remove(xwm->event_source);
 	}
+	if (xwm->pending_props_idle) {
+		wl_event_source_remove(xwm->pending_props_idle);
+	}
+	if (xwm->dispatch_timer) {
+		wl_event_source_remove(xwm->dispatch_timer);
+	}
+	for (size_t i = xwm->events_pos; i < xwm->events_len; i++) {
+		free(xwm->events[i]);
+	}
 	struct wlr_xwayland_surface *xsurface, *tmp;
 	wl_list_for_each_safe(xsurface, tmp, &xwm->surfaces, link) {
 		wlr_xwayland_surface_destroy(xsurface);
 	}
+	xwm_map_finish(&xwm->windows);
+	xwm_map_finish(&xwm->unpaired_surfaces);
 	wl_list_remove(&xwm->compositor_surface_create.link);
 	xcb_disconnect(xwm->xcb_conn);
 
@@ -1189,7 +1607,7 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 
 	xwm->xwayland = wlr_xwayland;
 	wl_list_init(&xwm->surfaces);
-	wl_list_init(&xwm->unpaired_surfaces);
+	wl_list_init(&xwm->pending_props_surfaces);
 
 	xwm->xcb_conn = xcb_connect_to_fd(wlr_xwayland->wm_fd[0], NULL);
 
@@ -1218,6 +1636,21 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 	xwm_get_resources(xwm);
 	xwm_get_visual_and_colormap(xwm);
 
+	const xcb_atom_t surface_props[XWM_SURFACE_PROPS_LEN] = {
+		XCB_ATOM_WM_CLASS,
+		XCB_ATOM_WM_NAME,
+		XCB_ATOM_WM_TRANSIENT_FOR,
+		xwm->atoms[WM_PROTOCOLS],
+		xwm->atoms[WM_HINTS],
+		xwm->atoms[WM_NORMAL_HINTS],
+		xwm->atoms[MOTIF_WM_HINTS],
+		xwm->atoms[NET_WM_STATE],
+		xwm->atoms[NET_WM_WINDOW_TYPE],
+		xwm->atoms[NET_WM_NAME],
+		xwm->atoms[NET_WM_PID],
+	};
+	memcpy(xwm->surface_props, surface_props, sizeof(surface_props));
+
 	uint32_t values[1];
 	values[0] =
 		XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
@@ -33,6 +33,26 @@ enum atom_name {
 
 extern const char *atom_map[ATOM_LAST];
 
+// Number of window properties read by the window manager
+#define XWM_SURFACE_PROPS_LEN 11
+
+// Budget of a single dispatch of X11 events, the remaining events are handled
+// after the event loop polled its other sources
+#define XWM_DISPATCH_MAX_EVENTS 64
+#define XWM_DISPATCH_MAX_USEC 2000
+
+struct xwm_map_entry {
+	uint32_t key; // 0 for an empty slot
+	struct wlr_xwayland_surface *surface;
+};
+
+// Open-addressing hash map of surfaces, with linear probing
+struct xwm_map {
+	struct xwm_map_entry *entries;
+	size_t capacity; // 0 or a power of two
+	size_t len;
+};
+
 enum net_wm_state_action {
 	NET_WM_STATE_REMOVE = 0,
 	NET_WM_STATE_ADD = 1,
@@ -42,6 +62,12 @@ enum net_wm_state_action {
 struct wlr_xwm {
 	struct wlr_xwayland *xwayland;
 	struct wl_event_source *event_source;
+	struct wl_event_source *dispatch_timer;
+
+	// Events read from the connection but not handled yet, NULL for the ones
+	// which were collapsed
+	xcb_generic_event_t *events[XWM_DISPATCH_MAX_EVENTS];
+	size_t events_len, events_pos;
 
 	xcb_atom_t atoms[ATOM_LAST];
 	xcb_connection_t *xcb_conn;
@@ -53,7 +79,16 @@ struct wlr_xwm {
 	struct wlr_xwayland_surface *focus_surface;
 
 	struct wl_list surfaces; // wlr_xwayland_surface::link
-	struct wl_list unpaired_surfaces; // wlr_xwayland_surface::unpaired_link
+	struct xwm_map windows; // keyed by wlr_xwayland_surface::window_id
+	// Surfaces waiting for their wl_surface, keyed by
+	// wlr_xwayland_surface::surface_id
+	struct xwm_map unpaired_surfaces;
+
+	// Indexed by the bits of wlr_xwayland_surface::pending_props
+	xcb_atom_t surface_props[XWM_SURFACE_PROPS_LEN];
+	// wlr_xwayland_surface::pending_props_link
+	struct wl_list pending_props_surfaces;
+	struct wl_event_source *pending_props_idle;
 
 	const xcb_query_extension_reply_t *xfixes;
 
@@ -64,4 +99,7 @@ void xwm_destroy(struct wlr_xwm *xwm);
 
 struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland);
 
+// Arms or disarms the idle shutdown timer of a lazy Xwayland
+void xwayland_update_idle(struct wlr_xwayland *wlr_xwayland, bool idle);
+
 #endif